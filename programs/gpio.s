@@ -0,0 +1,27 @@
+ldr r0,=0x20200004
+mov r1,#1
+lsl r1,#18
+str r1,[r0]
+ldr r2,=0x2020001c
+ldr r3,=0x20200028
+mov r4,#1
+lsl r4,#16
+mov r5,#3
+blink:
+str r4,[r2]
+mov r6,#0x100
+on:
+sub r6,r6,#1
+cmp r6,#0
+bne on
+str r4,[r3]
+mov r6,#0x100
+off:
+sub r6,r6,#1
+cmp r6,#0
+bne off
+sub r5,r5,#1
+cmp r5,#0
+bne blink
+ldr r7,[r0]
+andeq r0,r0,r0
@@ -0,0 +1,442 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "cycle.h"
+#include "instructions.h"
+
+#define WORD_N (MEMORY_SIZE / 4)
+#define ALWAYS 14
+
+// Translates a binary into C that, compiled and linked with aot_runtime.o,
+// runs it natively and prints the same final state as emulate
+//
+// Code is found by following the branches from address 0. Each block is
+// a function that keeps r0-r14 and the CPSR in locals and returns the
+// address of the next block, or AOT_EXIT once it handed the machine to
+// the runtime; the PC is the constant address + 8 inside a block.
+// Every instruction mirrors the order of execute_*() in execute.c,
+// including its flag quirks, so that the final state is identical
+
+typedef struct {
+  BYTE *memory;
+  bool leader[WORD_N];
+  bool translated[WORD_N];   // words the blocks were built from
+  WORD worklist[WORD_N];
+  WORD pending;
+} translation;
+
+// instructions whose effect is left to the runtime's interpreter:
+// writes to the PC (followed by a delay slot), the opcodes that
+// execute_data_processing leaves without a result, swaps and semihosting
+// SWIs
+bool interpret_only(WORD instr) {
+  switch (clarify_instruction(instr)) {
+    case DATA_PROCESSING: {
+      data_processing params = decode_data_processing(instr);
+      bool writes_rd = params.opcode < 0x8 || params.opcode > 0xB;
+      return (params.opcode >= 0x5 && params.opcode <= 0x7)
+             || (writes_rd && params.rd == PC_INDEX);
+    }
+    case MULTIPLY:
+      return decode_multiply(instr).rd == PC_INDEX;
+    case SWAP:
+    case SOFTWARE_INTERRUPT:
+      return true;
+    case SINGLE_DATA_TRANSFER: {
+      single_data_transfer params = decode_single_data_transfer(instr);
+      return (params.l && params.rd == PC_INDEX) || (!params.p && params.rn == PC_INDEX);
+    }
+    default:
+      return false;
+  }
+}
+
+// the address a branch at address jumps to, or false if execute_branch
+// would ignore it for leaving memory
+bool branch_target(WORD address, WORD instr, WORD *target) {
+  WORD delta = decode_branch(instr).offset << 2;
+  if (get_bit(delta, 25)) {
+    delta |= 0x3F << 26;
+  }
+  int new_pc = address + 8 + (signed int) delta;
+  *target = new_pc;
+  return new_pc >= 0 && new_pc < MEMORY_SIZE;
+}
+
+// the condition of cond_check as an expression over the CPSR, or NULL
+// if the instruction never executes; as in cond_check, the signed
+// comparisons test N against bit 1 of NZCV (the C flag)
+const char *condition(WORD cond) {
+  switch (cond) {
+    case 0:  return "Z";
+    case 1:  return "!Z";
+    case 10: return "N == C";
+    case 11: return "N != C";
+    case 12: return "!Z && N == C";
+    case 13: return "Z || N != C";
+    case 14: return "1";
+    default: return NULL;
+  }
+}
+
+void add_leader(translation *t, WORD address) {
+  if (!t->leader[address / 4]) {
+    t->leader[address / 4] = true;
+    t->worklist[t->pending++] = address;
+  }
+}
+
+// marks the starts of blocks reachable from address 0
+void find_leaders(translation *t) {
+  add_leader(t, 0);
+  while (t->pending) {
+    WORD address = t->worklist[--t->pending];
+    for (;; address += 4) {
+      if (address + 8 >= MEMORY_SIZE) {
+        break;
+      }
+      WORD instr = read_word(t->memory, address);
+      instr_type type = clarify_instruction(instr);
+      if (type == HALT) {
+        break;
+      }
+      if (interpret_only(instr)) {
+        add_leader(t, address + 4);
+        break;
+      }
+      WORD target;
+      if (type == BRANCH && condition(get_bits(instr, 28, 31))
+          && branch_target(address, instr, &target)) {
+        add_leader(t, target);
+        if (get_bits(instr, 28, 31) == ALWAYS) {
+          break;
+        }
+      }
+      if (t->leader[(address + 4) / 4]) {
+        break;
+      }
+    }
+  }
+}
+
+// names register r read by the instruction at address
+void reg_name(char *name, WORD r, WORD address) {
+  if (r == PC_INDEX) {
+    sprintf(name, "0x%08xu", address + 8);
+  } else {
+    sprintf(name, "r%u", r);
+  }
+}
+
+// emits value = operand2 for a shifted register, as operand2_decode
+// (the carry it writes with set_c is always overwritten by the N flag)
+void emit_shifted_register(FILE *out, const char *value, WORD operand2, WORD address) {
+  char rm[16];
+  reg_name(rm, get_bits(operand2, 0, 3), address);
+  WORD shift = get_bits(operand2, 7, 11);
+  if (shift == 0) {
+    fprintf(out, "    %s = %s;\n", value, rm);
+    return;
+  }
+  switch (get_bits(operand2, 5, 6)) {
+    case 0:
+      fprintf(out, "    %s = %s << %u;\n", value, rm, shift);
+      break;
+    case 1:
+      fprintf(out, "    %s = %s >> %u;\n", value, rm, shift);
+      break;
+    case 2:
+      fprintf(out, "    %s = shift_arithmetic_right(%s, %u);\n", value, rm, shift);
+      break;
+    default:
+      fprintf(out, "    %s = rotate_right(%s, %u);\n", value, rm, shift);
+      break;
+  }
+}
+
+void emit_data_processing(FILE *out, WORD instr, WORD address) {
+  data_processing params = decode_data_processing(instr);
+  char rn[16];
+  char rd[16];
+  reg_name(rn, params.rn, address);
+  reg_name(rd, params.rd, address);
+  if (params.i) {
+    WORD value = get_bits(params.operand2, 0, 7);
+    WORD rotation = get_bits(params.operand2, 8, 11);
+    fprintf(out, "    op2 = 0x%08xu;\n", (WORD) rotate_right(value, 2 * rotation));
+  } else {
+    emit_shifted_register(out, "op2", params.operand2, address);
+  }
+
+  static const char *results[] = {
+    "%s & op2", "%s ^ op2", "%s - op2", "op2 - %s", "%s + op2", NULL, NULL, NULL,
+    "%s & op2", "%s ^ op2", "%s - op2", "%s + op2", "%s | op2", "op2", "%s & ~op2", "~op2"
+  };
+  fprintf(out, "    result = ");
+  fprintf(out, results[params.opcode], rn);
+  fprintf(out, ";\n");
+  if (params.opcode < 0x8 || params.opcode > 0xB) {
+    fprintf(out, "    %s = result;\n", rd);
+  }
+  // the carry compares with the registers after rd was written
+  if (params.s) {
+    switch (params.opcode) {
+      case 0x2:
+      case 0xA:
+        fprintf(out, "    SET_C(!(%s < op2));\n", rn);
+        break;
+      case 0x3:
+        fprintf(out, "    SET_C(!(op2 < %s));\n", rn);
+        break;
+      case 0x4:
+        fprintf(out, "    SET_C(result < %s);\n", rd);
+        break;
+      case 0xB:
+        fprintf(out, "    SET_C(result < %s);\n", rn);
+        break;
+    }
+    fprintf(out, "    SET_ZN(result);\n");
+  }
+}
+
+void emit_multiply(FILE *out, WORD instr, WORD address) {
+  multiply params = decode_multiply(instr);
+  char rd[16];
+  char rn[16];
+  char rs[16];
+  char rm[16];
+  reg_name(rd, params.rd, address);
+  reg_name(rn, params.rn, address);
+  reg_name(rs, params.rs, address);
+  reg_name(rm, params.rm, address);
+  fprintf(out, "    result = %s * %s;\n", rm, rs);
+  if (params.a) {
+    fprintf(out, "    result += %s;\n", rn);
+  }
+  if (params.s) {
+    fprintf(out, "    if ((int) result < 0) {\n"
+                 "      cpsr |= 1u << 31;\n"
+                 "    } else if (result == 0) {\n"
+                 "      cpsr |= 1u << 30;\n"
+                 "    }\n");
+  }
+  fprintf(out, "    %s = result;\n", rd);
+}
+
+// accesses that leave memory, or stores into translated code, are left
+// to the interpreter before anything is written
+void emit_single_data_transfer(FILE *out, WORD instr, WORD address) {
+  single_data_transfer params = decode_single_data_transfer(instr);
+  char rn[16];
+  char rd[16];
+  reg_name(rn, params.rn, address);
+  reg_name(rd, params.rd, address);
+  if (params.i) {
+    emit_shifted_register(out, "offset", params.offset, address);
+  } else {
+    fprintf(out, "    offset = %u;\n", params.offset);
+  }
+  const char *sign = params.u ? "+" : "-";
+  if (params.p) {
+    fprintf(out, "    address = %s %s offset;\n", rn, sign);
+  } else {
+    fprintf(out, "    address = %s;\n", rn);
+  }
+  fprintf(out, "    if (address < 0 || address >= MEMORY_SIZE%s) {\n"
+               "      EXIT(aot_interpret_at(s, 0x%08xu));\n"
+               "    }\n",
+          params.l ? "" : " || aot_touches_code(address)", address);
+  if (!params.p) {
+    fprintf(out, "    %s = %s %s offset;\n", rn, rn, sign);
+  }
+  if (params.l) {
+    fprintf(out, "    %s = load(s->memory, address);\n", rd);
+  } else {
+    fprintf(out, "    store(s->memory, address, %s);\n", rd);
+  }
+}
+
+// a taken branch continues in the target's block once the pipeline has
+// been refilled there, unless the refill runs off the end of memory
+void emit_branch(FILE *out, WORD target) {
+  if (target + 8 < MEMORY_SIZE) {
+    fprintf(out, "    EXIT(0x%08xu);\n", target);
+  } else {
+    fprintf(out, "    EXIT(aot_branch_to(s, 0x%08xu));\n", target);
+  }
+}
+
+void emit_block(translation *t, FILE *out, WORD start) {
+  fprintf(out, "\nstatic WORD block_%08x(State *s) {\n"
+               "  LOAD;\n", start);
+  for (WORD address = start;; address += 4) {
+    if (address != start && t->leader[address / 4]) {
+      fprintf(out, "  EXIT(0x%08xu);\n", address);
+      break;
+    }
+    if (address + 8 >= MEMORY_SIZE) {
+      fprintf(out, "  EXIT(aot_interpret_at(s, 0x%08xu));\n", address);
+      break;
+    }
+    WORD instr = read_word(t->memory, address);
+    t->translated[address / 4] = true;
+    instr_type type = clarify_instruction(instr);
+    fprintf(out, "  // 0x%08x: %08x\n", address, instr);
+    if (type == HALT) {
+      fprintf(out, "  EXIT(aot_halt_at(s, 0x%08xu));\n", address);
+      break;
+    }
+    if (interpret_only(instr)) {
+      fprintf(out, "  EXIT(aot_interpret_at(s, 0x%08xu));\n", address);
+      break;
+    }
+    WORD cond = get_bits(instr, 28, 31);
+    const char *expression = condition(cond);
+    if (!expression) {
+      continue;
+    }
+    WORD target;
+    if (type == BRANCH && !branch_target(address, instr, &target)) {
+      continue;
+    }
+    fprintf(out, "  if (%s) {\n", expression);
+    switch (type) {
+      case DATA_PROCESSING:
+        emit_data_processing(out, instr, address);
+        break;
+      case MULTIPLY:
+        emit_multiply(out, instr, address);
+        break;
+      case SINGLE_DATA_TRANSFER:
+        emit_single_data_transfer(out, instr, address);
+        break;
+      default:
+        emit_branch(out, target);
+        break;
+    }
+    fprintf(out, "  }\n");
+    if (type == BRANCH && cond == ALWAYS) {
+      break;
+    }
+  }
+  fprintf(out, "}\n");
+}
+
+void emit_prelude(FILE *out, char *binary_name) {
+  fprintf(out, "// Translated from %s by aot\n"
+               "#include <string.h>\n"
+               "#include \"aot_runtime.h\"\n\n"
+               "#define N (cpsr >> 31 & 1)\n"
+               "#define Z (cpsr >> 30 & 1)\n"
+               "#define C (cpsr >> 29 & 1)\n"
+               "#define SET_C(c) (cpsr = (cpsr & ~(1u << 29)) | (WORD) (c) << 29)\n"
+               "#define SET_ZN(r) (cpsr = (cpsr & 0x3FFFFFFFu) | (WORD) ((r) == 0) << 30 | ((r) & 0x80000000u))\n"
+               "#define LOAD \\\n"
+               "  WORD r0 = s->reg[0], r1 = s->reg[1], r2 = s->reg[2], r3 = s->reg[3]; \\\n"
+               "  WORD r4 = s->reg[4], r5 = s->reg[5], r6 = s->reg[6], r7 = s->reg[7]; \\\n"
+               "  WORD r8 = s->reg[8], r9 = s->reg[9], r10 = s->reg[10], r11 = s->reg[11]; \\\n"
+               "  WORD r12 = s->reg[12], r13 = s->reg[13], r14 = s->reg[14], cpsr = s->reg[16]; \\\n"
+               "  WORD op2, result, offset; \\\n"
+               "  int address; \\\n"
+               "  (void) op2; (void) result; (void) offset; (void) address\n"
+               "#define EXIT(next) do { \\\n"
+               "  s->reg[0] = r0; s->reg[1] = r1; s->reg[2] = r2; s->reg[3] = r3; \\\n"
+               "  s->reg[4] = r4; s->reg[5] = r5; s->reg[6] = r6; s->reg[7] = r7; \\\n"
+               "  s->reg[8] = r8; s->reg[9] = r9; s->reg[10] = r10; s->reg[11] = r11; \\\n"
+               "  s->reg[12] = r12; s->reg[13] = r13; s->reg[14] = r14; s->reg[16] = cpsr; \\\n"
+               "  return (next); \\\n"
+               "} while (0)\n\n"
+               "int shift_arithmetic_right(WORD value, int shift);\n"
+               "int rotate_right(WORD value, int rot);\n\n"
+               "static inline WORD load(const BYTE *memory, int address) {\n"
+               "  WORD word;\n"
+               "  memcpy(&word, memory + address, sizeof(WORD));\n"
+               "  return word;\n"
+               "}\n\n"
+               "static inline void store(BYTE *memory, int address, WORD word) {\n"
+               "  memcpy(memory + address, &word, sizeof(WORD));\n"
+               "}\n",
+          binary_name);
+}
+
+void emit_dispatch(translation *t, FILE *out) {
+  fprintf(out, "\nbool aot_is_entry(WORD address) {\n"
+               "  switch (address) {\n");
+  for (WORD i = 0; i < WORD_N; i++) {
+    if (t->leader[i]) {
+      fprintf(out, "    case 0x%08xu:\n", 4 * i);
+    }
+  }
+  fprintf(out, "      return true;\n"
+               "    default:\n"
+               "      return false;\n"
+               "  }\n"
+               "}\n\n"
+               "void aot_run_blocks(State *s, WORD address) {\n"
+               "  while (address != AOT_EXIT) {\n"
+               "    switch (address) {\n");
+  for (WORD i = 0; i < WORD_N; i++) {
+    if (t->leader[i]) {
+      fprintf(out, "      case 0x%08xu: address = block_%08x(s); break;\n", 4 * i, 4 * i);
+    }
+  }
+  fprintf(out, "      default: address = aot_interpret_at(s, address); break;\n"
+               "    }\n"
+               "  }\n"
+               "}\n");
+}
+
+void emit_image(translation *t, FILE *out, WORD size) {
+  fprintf(out, "\nconst WORD aot_image_size = %u;\n"
+               "const BYTE aot_image[] = {", size);
+  for (WORD i = 0; i < size; i++) {
+    fprintf(out, "%s0x%02x,", i % 16 ? " " : "\n  ", t->memory[i]);
+  }
+  fprintf(out, "%s0\n};\n\n"
+               "const WORD aot_code_ranges[][2] = {\n", size % 16 ? " " : "\n  ");
+  WORD range_n = 0;
+  for (WORD i = 0; i < WORD_N; i++) {
+    if (t->translated[i] && (i == 0 || !t->translated[i - 1])) {
+      WORD end = i;
+      while (end < WORD_N && t->translated[end]) {
+        end++;
+      }
+      fprintf(out, "  {0x%08xu, 0x%08xu},\n", 4 * i, 4 * end);
+      range_n++;
+    }
+  }
+  fprintf(out, "  {0, 0}\n"
+               "};\n"
+               "const WORD aot_code_range_n = %u;\n", range_n);
+}
+
+// usage: aot binary output.c
+int main(int argc, char **argv) {
+  fail_if(argc != 3, "Usage: aot binary output.c");
+
+  FILE *input_file = open_file(argv[1], "rb");
+  int size = get_file_size(input_file);
+  fail_if(size > MEMORY_SIZE,
+    "This binary is too large to fit in emulated memory");
+  translation *t = calloc(1, sizeof(translation));
+  fail_if(!t, "Failed to allocate memory");
+  t->memory = allocate_memory();
+  load_memory(input_file, size, t->memory);
+  fclose(input_file);
+
+  find_leaders(t);
+  FILE *out = open_file(argv[2], "w");
+  emit_prelude(out, argv[1]);
+  for (WORD i = 0; i < WORD_N; i++) {
+    if (t->leader[i]) {
+      emit_block(t, out, 4 * i);
+    }
+  }
+  emit_dispatch(t, out);
+  emit_image(t, out, size);
+  fclose(out);
+
+  free(t->memory);
+  free(t);
+}
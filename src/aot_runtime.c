@@ -0,0 +1,153 @@
+#include "aot_runtime.h"
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "cycle.h"
+#include "instructions.h"
+#include "semihost.h"
+#include "bus.h"
+#include "gpio.h"
+
+// the variables of cycle()'s loop, with the addresses their words came
+// from (which differ from the PC in the delay slot of a write to the PC)
+typedef struct {
+  exec_cond cond;
+  WORD decoded;
+  WORD decoded_at;
+  WORD fetched;
+  WORD fetched_at;
+  bool interpret;      // a block handed decoded to the interpreter
+} pipeline;
+
+static pipeline pipe_state;
+static bool code_overwritten;
+static BYTE code_word[MEMORY_SIZE / 4];
+
+static WORD fetch_word(State *s, WORD address) {
+  return address + sizeof(WORD) <= MEMORY_SIZE ? read_word(s->memory, address) : 0;
+}
+
+WORD aot_interpret_at(State *s, WORD address) {
+  pipe_state = (pipeline) {CONTINUE, fetch_word(s, address), address,
+                           fetch_word(s, address + 4), address + 4, true};
+  s->reg[PC_INDEX] = address + 8;
+  return AOT_EXIT;
+}
+
+WORD aot_branch_to(State *s, WORD target) {
+  pipe_state.cond = SKIP;
+  pipe_state.fetched = fetch_word(s, target);
+  pipe_state.fetched_at = target;
+  s->reg[PC_INDEX] = target + 4;
+  return AOT_EXIT;
+}
+
+WORD aot_halt_at(State *s, WORD address) {
+  pipe_state.cond = STOP;
+  s->reg[PC_INDEX] = address + 8;
+  return AOT_EXIT;
+}
+
+bool aot_touches_code(int address) {
+  if (address < 0 || address >= MEMORY_SIZE) {
+    return false;
+  }
+  WORD last = (address + 3) / 4 < MEMORY_SIZE / 4 ? (address + 3) / 4 : address / 4;
+  return code_word[address / 4] || code_word[last];
+}
+
+// a store (or swap) run by the interpreter may overwrite translated code
+// too, as may a semihosting call that fills guest memory
+static void check_interpreted_store(State *s, WORD instr) {
+  instr_type type = clarify_instruction(instr);
+  WORD start, length;
+  if (type == SOFTWARE_INTERRUPT && semihost_stores(s, &start, &length)) {
+    uint64_t word_n = ((uint64_t) length + start % 4 + 3) / 4;
+    for (uint64_t i = start / 4; i < start / 4 + word_n && i < MEMORY_SIZE / 4; i++) {
+      if (code_word[i]) {
+        code_overwritten = true;
+      }
+    }
+    return;
+  }
+  if (type == SWAP) {
+    if (aot_touches_code(s->reg[decode_swap(instr).rn])) {
+      code_overwritten = true;
+    }
+    return;
+  }
+  if (type != SINGLE_DATA_TRANSFER) {
+    return;
+  }
+  single_data_transfer params = decode_single_data_transfer(instr);
+  if (params.l) {
+    return;
+  }
+  int offset = params.i ? offset_decode(params.offset, s->reg) : params.offset;
+  if (!params.u) {
+    offset = -offset;
+  }
+  int address = params.p ? s->reg[params.rn] + offset : s->reg[params.rn];
+  if (aot_touches_code(address)) {
+    code_overwritten = true;
+  }
+}
+
+// cycle(), except that translated blocks take over whenever they can
+static void run(State *s) {
+  // first fetch
+  pipe_state.fetched = fetch_word(s, 0);
+  pipe_state.fetched_at = 0;
+  s->reg[PC_INDEX] = 4;
+  pipe_state.cond = SKIP;
+
+  while (s->reg[PC_INDEX] < MEMORY_SIZE && pipe_state.cond != STOP) {
+    if (pipe_state.cond == CONTINUE && !pipe_state.interpret && !code_overwritten
+        && pipe_state.decoded_at + 8 == s->reg[PC_INDEX] && aot_is_entry(pipe_state.decoded_at)) {
+      aot_run_blocks(s, pipe_state.decoded_at);
+      continue;
+    }
+    if (pipe_state.cond == CONTINUE) {
+      check_interpreted_store(s, pipe_state.decoded);
+      pipe_state.cond = execute(s, pipe_state.decoded);
+      pipe_state.interpret = false;
+    } else if (pipe_state.cond == SKIP) {
+      pipe_state.cond = CONTINUE;
+    }
+    if (pipe_state.cond != STOP) {
+      pipe_state.decoded = pipe_state.fetched;
+      pipe_state.decoded_at = pipe_state.fetched_at;
+      pipe_state.fetched = fetch_word(s, s->reg[PC_INDEX]);
+      pipe_state.fetched_at = s->reg[PC_INDEX];
+      s->reg[PC_INDEX] += 4;
+    }
+  }
+}
+
+int main(void) {
+  BYTE *memory = allocate_memory();
+  WORD *reg = allocate_register();
+  memcpy(memory, aot_image, aot_image_size);
+  for (WORD i = 0; i < aot_code_range_n; i++) {
+    memset(code_word + aot_code_ranges[i][0] / 4, 1,
+           (aot_code_ranges[i][1] - aot_code_ranges[i][0]) / 4);
+  }
+
+  // the devices of emulate, without its GPIO log
+  bus *devices = bus_create();
+  gpio *pins = gpio_create(NULL);
+  gpio_attach(pins, devices);
+  semihost *host = semihost_create(stdin, stdout);
+  State arm_state = {memory, reg, NULL, devices, NULL, host};
+  run(&arm_state);
+  semihost_flush(host);
+  print_state(&arm_state);
+
+  int exit_code = host->exit_code;
+  semihost_free(host);
+  gpio_free(pins);
+  bus_free(devices);
+  free(memory);
+  free(reg);
+  return exit_code;
+}
@@ -0,0 +1,42 @@
+#ifndef AOT_RUNTIME
+#define AOT_RUNTIME
+#include "utils.h"
+
+// Runtime of the native executables written by aot
+//
+// The translated blocks run only while the pipeline is in step (the
+// instruction at address executes with the PC at address + 8) and the
+// translated code has not been overwritten. Anything else (writes to the
+// PC, their delay slot, stores into translated code, the end of memory)
+// is run by the emulator's own execute(), one cycle() iteration at a
+// time, until a block entry is reached in step again.
+// Loads and stores outside memory are interpreted too, and reach the
+// GPIO controller on the runtime's bus as they do under emulate
+
+// returned by a block when it handed the machine back to the interpreter
+#define AOT_EXIT 0xFFFFFFFF
+
+// Provided by the translation
+extern const BYTE aot_image[];
+extern const WORD aot_image_size;
+extern const WORD aot_code_ranges[][2];   // [start, end) of translated words
+extern const WORD aot_code_range_n;
+
+// Runs blocks from the entry at address until one returns AOT_EXIT
+void aot_run_blocks(State *s, WORD address);
+
+// True if a block starts at address
+bool aot_is_entry(WORD address);
+
+// Services for the blocks; each returns AOT_EXIT
+// the instruction at address is run by the interpreter
+WORD aot_interpret_at(State *s, WORD address);
+// a taken branch to target whose refill runs off the end of memory
+WORD aot_branch_to(State *s, WORD target);
+// the instruction at address halts
+WORD aot_halt_at(State *s, WORD address);
+
+// True if storing a word at address overwrites translated code
+bool aot_touches_code(int address);
+
+#endif
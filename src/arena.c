@@ -0,0 +1,74 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+// blocks start small so that tiny tables stay tiny, and double up to
+// the maximum as the arena grows
+#define MIN_BLOCK_SIZE 1024
+#define MAX_BLOCK_SIZE (1 << 20)
+#define ALIGNMENT _Alignof(max_align_t)
+#define HEADER_SIZE ((sizeof(arena_block) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+arena *arena_create(void) {
+  arena *a = malloc(sizeof(arena));
+  fail_if(!a, "Failed to allocate memory");
+  a->head = NULL;
+  a->next_size = MIN_BLOCK_SIZE;
+  return a;
+}
+
+void *arena_alloc(arena *a, size_t size) {
+  size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  arena_block *block = a->head;
+  if (!block || block->size - block->used < size) {
+    size_t block_size = a->next_size > size ? a->next_size : size;
+    block = malloc(HEADER_SIZE + block_size);
+    fail_if(!block, "Failed to allocate memory");
+    block->size = block_size;
+    block->used = 0;
+    block->next = a->head;
+    a->head = block;
+    if (a->next_size < MAX_BLOCK_SIZE) {
+      a->next_size *= 2;
+    }
+  }
+  void *memory = (char *) block + HEADER_SIZE + block->used;
+  block->used += size;
+  return memory;
+}
+
+char *arena_strdup(arena *a, const char *str) {
+  size_t size = strlen(str) + 1;
+  char *copy = arena_alloc(a, size);
+  memcpy(copy, str, size);
+  return copy;
+}
+
+void arena_adopt(arena *dst, arena *src) {
+  if (!src->head) {
+    return;
+  }
+  arena_block *tail = src->head;
+  while (tail->next) {
+    tail = tail->next;
+  }
+  // dst keeps filling its own head block
+  if (dst->head) {
+    tail->next = dst->head->next;
+    dst->head->next = src->head;
+  } else {
+    dst->head = src->head;
+  }
+  src->head = NULL;
+}
+
+void arena_free(arena *a) {
+  arena_block *block = a->head;
+  while (block) {
+    arena_block *next = block->next;
+    free(block);
+    block = next;
+  }
+  free(a);
+}
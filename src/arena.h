@@ -0,0 +1,36 @@
+#ifndef ARENA
+#define ARENA
+#include <stddef.h>
+
+// Bump allocator for memory that lives as long as its owner (a symbol
+// table, a cache): allocations are never freed one by one, the whole arena
+// is released at once by arena_free
+// An arena is not thread-safe; every thread allocates from its own
+
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t size;
+  size_t used;
+  // data follows the header
+} arena_block;
+
+typedef struct {
+  arena_block *head;   // the block being filled, older blocks follow
+  size_t next_size;
+} arena;
+
+arena *arena_create(void);
+
+// Returns size bytes aligned for any type, exits if out of memory
+void *arena_alloc(arena *a, size_t size);
+
+// Returns a copy of str allocated in the arena
+char *arena_strdup(arena *a, const char *str);
+
+// Moves every block of src into dst, so memory allocated from src now
+// lives as long as dst; src is left empty and can still be used
+void arena_adopt(arena *dst, arena *src);
+
+void arena_free(arena *a);
+
+#endif
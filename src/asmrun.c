@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "utils.h"
+#include "assembler.h"
+#include "cycle.h"
+#include "source_map.h"
+#include "bus.h"
+#include "gpio.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "semihost.h"
+
+// Assembles source straight into the emulated memory and runs it
+// The final state is printed exactly as emulate prints it; errors name
+// the source line of the failing instruction
+void assemble_and_run(char *file_name, BYTE *memory, WORD *reg) {
+  size_t source_size;
+  const char *source = map_file(file_name, &source_size);
+  program *p = program_scan(source, source_size, 1);
+  fail_if(p->out_size > MEMORY_SIZE,
+    "This program is too large to fit in emulated memory");
+
+  memset(memory, 0, MEMORY_SIZE);
+  memset(reg, 0, REGISTER_N * sizeof(WORD));
+  program_encode(p, memory);
+  program_free(p);
+  source_map *map = source_map_build(file_name, source, source_size);
+  unmap_file(source, source_size);
+  bus *devices = bus_create();
+  gpio *pins = gpio_create(NULL);
+  gpio_attach(pins, devices);
+  scheduler *events = scheduler_create();
+  arm_timer *clock = arm_timer_create(events);
+  arm_timer_attach(clock, devices);
+  semihost *host = semihost_create(stdin, stdout);
+
+  State arm_state = {memory, reg, map, devices, events, host};
+  cycle(&arm_state);
+  semihost_free(host);
+  print_state(&arm_state);
+  arm_timer_free(clock);
+  scheduler_free(events);
+  gpio_free(pins);
+  bus_free(devices);
+  source_map_free(map);
+}
+
+// usage: asmrun file.s [file.s ...]
+// with several files, each state dump is preceded by the file name
+int main(int argc, char **argv) {
+  fail_if(argc < 2,
+    "You must pass at least one assembly file name");
+
+  BYTE *memory = allocate_memory();
+  WORD *reg = allocate_register();
+
+  for (int i = 1; i < argc; i++) {
+    if (argc > 2) {
+      printf("%s:\n", argv[i]);
+    }
+    assemble_and_run(argv[i], memory, reg);
+  }
+
+  free(memory);
+  free(reg);
+}
@@ -2,52 +2,161 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
 #include "utils.h"
-#include "symbol_table.h"
-#include "encode.h"
+#include "assembler.h"
+#include "cache.h"
+#include "object.h"
+#include "peephole.h"
+#include "source_map.h"
+#include "batch.h"
 
-#define MAX_LINE_LENGTH 512
+// optimises the image in place if asked and writes its source map
+// Returns the final image size
+WORD finish_binary(BYTE *image, WORD code_size, WORD out_size,
+                   bool optimise, char *map_name, char *source_name,
+                   const char *source, size_t source_size) {
+  WORD *address_map = NULL;
+  if (optimise && out_size) {
+    if (map_name) {
+      address_map = calloc(code_size / 4 + 1, sizeof(WORD));
+      fail_if(!address_map, "Failed to allocate memory");
+    }
+    out_size = peephole(image, code_size, out_size, address_map);
+  }
 
+  if (map_name) {
+    source_map *map = source_map_build(source_name, source, source_size);
+    if (address_map) {
+      source_map_remap(map, address_map);
+    }
+    FILE *map_file = open_file(map_name, "wb");
+    source_map_write(map, map_file);
+    fclose(map_file);
+    source_map_free(map);
+  }
+  free(address_map);
+  return out_size;
+}
+
+// usage: assemble [-j threads] [-i cache] [-c] [-O] [-m map] input output
+// -j splits the source into chunks that are assembled in parallel;
+// the binary is identical to the one produced by a single thread
+// -i keeps the encoding of every line in the cache file, so the next run
+// only re-encodes lines that changed or whose label references moved
+// -c writes a relocatable object for link instead of a binary
+// -O runs the peephole optimiser over the encoded instructions
+// -m writes the source map of the binary for emulate -m
+//
+// usage: assemble -b manifest [-j workers] [-c] [-O]
+// -b assembles every file listed in the manifest (see batch.h), -j files
+// at a time; failing files are reported without stopping the others
 int main(int argc, char **argv) {
-  fail_if(argc < 3,
+  int threads = 1;
+  char *cache_file = NULL;
+  bool relocatable = false;
+  bool optimise = false;
+  char *map_name = NULL;
+  char *manifest = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "j:i:cOm:b:")) != -1) {
+    switch (opt) {
+      case 'j':
+        threads = atoi(optarg);
+        break;
+      case 'i':
+        cache_file = optarg;
+        break;
+      case 'c':
+        relocatable = true;
+        break;
+      case 'O':
+        optimise = true;
+        break;
+      case 'm':
+        map_name = optarg;
+        break;
+      case 'b':
+        manifest = optarg;
+        break;
+      default:
+        fail_if(true, "Usage: assemble [-j threads] [-i cache] [-c] [-O] [-m map] input output");
+    }
+  }
+  if (manifest) {
+    fail_if(cache_file || map_name,
+            "Batches can not be assembled incrementally or with source maps");
+    return assemble_batch(manifest, threads, relocatable, optimise)
+           ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+  fail_if(argc - optind < 2,
           "You must pass an input file name as the first argument "
           "and output binary file name as the second argument");
+  fail_if(relocatable && cache_file,
+          "Objects can not be assembled incrementally");
+  fail_if(relocatable && optimise,
+          "Objects can not be optimised before they are linked");
+  fail_if(relocatable && map_name,
+          "Source maps are only written for binaries");
 
-  FILE *input_file  = open_file(argv[1], "r");
-  FILE *output_file = open_file(argv[2], "wb");
+  size_t source_size;
+  char *output_name = argv[optind + 1];
+  const char *source = map_file(argv[optind], &source_size);
 
-  table *sym_table = table_create();
-
-  // first pass
-  WORD address = 0;
-  char line[MAX_LINE_LENGTH];
-  while(fgets(line, sizeof(line), input_file)){
-    if(is_label(line)){
-      table_insert(sym_table, strtok(line,":"), address);
-    }
-    else if (!is_empty(line)){
-        address += 4;
-    }
+  line_cache *cache = cache_file ? cache_load(cache_file) : NULL;
+  if (cache && cache_matches(cache, source, source_size)) {
+    // unchanged source: the cached image is the output
+    WORD out_size = finish_binary(cache->image, 4 * cache->record_n, cache->out_size,
+                                  optimise, map_name, argv[optind], source, source_size);
+    FILE *output_file = open_file(output_name, "wb");
+    write_binary_file(output_file, cache->image, out_size);
+    fclose(output_file);
+    cache_free(cache);
+    unmap_file(source, source_size);
+    return EXIT_SUCCESS;
   }
 
-  // now addr represents number of words we need for all instructions
-  // except for the halt instruction at the end
-  WORD out_size = address;
-  address = 0;
+  // first pass: labels, instruction count and literal pool layout
+  program *p = program_scan(source, source_size, threads);
 
-  // second pass
-  BYTE *output = calloc(out_size, sizeof(BYTE));
-  rewind(input_file);
-  while(fgets(line, sizeof(line), input_file)) {
-    if(!is_label(line) && !is_empty(line)) {
-      assemble(line, sym_table, &output, &out_size, address);
-        address += 4;
-    }
+  // labels of other modules are left for the linker
+  table *externals = relocatable ? program_externals(p) : NULL;
+
+  // second pass, straight into the output file for binaries since the
+  // first pass gave the size of the image
+  BYTE *output;
+  if (relocatable) {
+    output = calloc(p->out_size, sizeof(BYTE));
+    fail_if(p->out_size && !output, "Failed to allocate memory");
+  } else {
+    output = map_output_file(output_name, p->out_size);
+  }
+  if (cache) {
+    cache_prepare(cache, p);
+    p->cache = cache;
+  }
+  program_encode(p, output);
+
+  // the cache keeps the image as encoded, before any optimisation
+  if (cache) {
+    cache_save(cache, cache_file, p, output);
+    cache_free(cache);
   }
 
-  // write encoded bytes to binary file
-  write_binary_file(output_file, output, out_size);
+  if (relocatable) {
+    FILE *output_file = open_file(output_name, "wb");
+    object *o = object_create(p, externals, output);
+    object_write(o, output_file);
+    object_free(o);
+    table_free(externals);
+    fclose(output_file);
+    free(output);
+  } else {
+    WORD out_size = finish_binary(output, p->code_size, p->out_size,
+                                  optimise, map_name, argv[optind], source, source_size);
+    unmap_output_file(output_name, output, p->out_size, out_size);
+  }
 
-  fclose(output_file);
-  fclose(input_file);
+  program_free(p);
+  unmap_file(source, source_size);
 }
@@ -0,0 +1,153 @@
+#include "assembler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "utils.h"
+#include "symbol_table.h"
+#include "encode.h"
+#include "cache.h"
+
+// first pass over one chunk: labels are recorded relative to the chunk
+void scan_chunk(chunk *c) {
+  WORD address = 0;
+  WORD pool_size = 0;
+  char line[MAX_LINE_LENGTH];
+  const char *cursor = c->start;
+  while(read_line(&cursor, c->end, line, sizeof(line))){
+    if(is_label(line)){
+      *strchr(line, ':') = '\0';
+      table_insert(c->labels, line, address);
+    }
+    else if (!is_empty(line)){
+      address += 4;
+      pool_size += literal_pool_size(line);
+    }
+  }
+  c->code_size = address;
+  c->pool_size = pool_size;
+}
+
+typedef struct {
+  program *p;
+  chunk *c;
+  BYTE *output;
+} encode_job;
+
+// second pass over one chunk: writes only inside the chunk's own
+// instruction and literal ranges of the output
+void encode_chunk(program *p, chunk *c, BYTE *output) {
+  WORD address = c->address;
+  WORD pool_address = c->pool_address;
+  char line[MAX_LINE_LENGTH];
+  const char *cursor = c->start;
+  while(read_line(&cursor, c->end, line, sizeof(line))) {
+    if(!is_label(line) && !is_empty(line)) {
+      if (p->cache) {
+        cache_assemble(p->cache, line, p->sym_table, output, address, &pool_address);
+      } else {
+        assemble(line, p->sym_table, &output, &pool_address, address);
+      }
+      address += 4;
+    }
+  }
+}
+
+void *scan_worker(void *arg) {
+  scan_chunk((chunk *) arg);
+  return NULL;
+}
+
+void *encode_worker(void *arg) {
+  encode_job *job = (encode_job *) arg;
+  encode_chunk(job->p, job->c, job->output);
+  return NULL;
+}
+
+// split the source into chunks of roughly equal size ending on a newline
+void split_source(program *p, int threads) {
+  p->chunks = calloc(threads, sizeof(chunk));
+  fail_if(!p->chunks, "Failed to allocate memory");
+  const char *end = p->source + p->source_size;
+  const char *start = p->source;
+  size_t target = p->source_size / threads;
+  p->chunk_n = 0;
+  while (start < end) {
+    const char *split = end;
+    if (p->chunk_n < threads - 1 && (size_t) (end - start) > target) {
+      split = memchr(start + target, '\n', end - start - target);
+      split = split ? split + 1 : end;
+    }
+    chunk *c = &p->chunks[p->chunk_n++];
+    c->start = start;
+    c->end = split;
+    c->labels = table_create();
+    start = split;
+  }
+}
+
+// run work on every chunk, on its own thread unless there is only one
+void run_chunks(int n, void *(*work)(void *), void *args, size_t arg_size) {
+  if (n <= 1) {
+    for (int i = 0; i < n; i++) {
+      work((char *) args + i * arg_size);
+    }
+    return;
+  }
+  pthread_t *threads = calloc(n, sizeof(pthread_t));
+  fail_if(!threads, "Failed to allocate memory");
+  for (int i = 0; i < n; i++) {
+    fail_if(pthread_create(&threads[i], NULL, work, (char *) args + i * arg_size),
+            "Failed to start assembler thread");
+  }
+  for (int i = 0; i < n; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+program *program_scan(const char *source, size_t source_size, int threads) {
+  program *p = calloc(1, sizeof(program));
+  fail_if(!p, "Failed to allocate memory");
+  p->source = source;
+  p->source_size = source_size;
+  p->sym_table = table_create();
+  split_source(p, threads < 1 ? 1 : threads);
+
+  run_chunks(p->chunk_n, &scan_worker, p->chunks, sizeof(chunk));
+
+  // prefix sums give every chunk its global instruction and literal addresses
+  // the pool starts right after the last instruction
+  WORD address = 0;
+  for (int i = 0; i < p->chunk_n; i++) {
+    p->chunks[i].address = address;
+    address += p->chunks[i].code_size;
+  }
+  p->code_size = address;
+  for (int i = 0; i < p->chunk_n; i++) {
+    p->chunks[i].pool_address = address;
+    address += p->chunks[i].pool_size;
+    // merged in source order so a later definition of a label still wins
+    table_merge(p->sym_table, p->chunks[i].labels, p->chunks[i].address);
+  }
+  p->out_size = address;
+  return p;
+}
+
+void program_encode(program *p, BYTE *output) {
+  encode_job *jobs = calloc(p->chunk_n, sizeof(encode_job));
+  fail_if(p->chunk_n && !jobs, "Failed to allocate memory");
+  for (int i = 0; i < p->chunk_n; i++) {
+    jobs[i] = (encode_job) {p, &p->chunks[i], output};
+  }
+  run_chunks(p->chunk_n, &encode_worker, jobs, sizeof(encode_job));
+  free(jobs);
+}
+
+void program_free(program *p) {
+  for (int i = 0; i < p->chunk_n; i++) {
+    table_free(p->chunks[i].labels);
+  }
+  free(p->chunks);
+  table_free(p->sym_table);
+  free(p);
+}
@@ -0,0 +1,46 @@
+#ifndef ASSEMBLER
+#define ASSEMBLER
+#include <stddef.h>
+#include "utils.h"
+#include "symbol_table.h"
+
+#define MAX_LINE_LENGTH 512
+
+// A run of whole source lines and the part of the image it produces
+// Chunks are independent after the first pass, so each can be encoded
+// by its own thread into a disjoint slice of the output
+typedef struct {
+  const char *start;
+  const char *end;
+  WORD address;       // address of the first instruction of the chunk
+  WORD pool_address;  // address of the first literal the chunk emits
+  WORD code_size;     // bytes of instructions in the chunk
+  WORD pool_size;     // bytes of literals in the chunk
+  table *labels;      // labels of the chunk, relative to its first instruction
+} chunk;
+
+// A source file split into chunks, with the layout of its binary image:
+// all instructions in source order, followed by the literal pool
+typedef struct {
+  const char *source;
+  size_t source_size;
+  int chunk_n;
+  chunk *chunks;
+  table *sym_table;
+  WORD code_size;
+  WORD out_size;
+  struct line_cache *cache;  // reuses encodings of a previous run if set
+} program;
+
+// First pass: splits the source at line boundaries into (at most) threads
+// chunks, collects labels and lays out instructions and literals
+// threads <= 1 runs the pass sequentially on the calling thread
+program *program_scan(const char *source, size_t source_size, int threads);
+
+// Second pass: encodes every chunk into output, which must hold out_size bytes
+void program_encode(program *p, BYTE *output);
+
+// Frees the program and its tables (the source is owned by the caller)
+void program_free(program *p);
+
+#endif
@@ -0,0 +1,181 @@
+#include "batch.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "utils.h"
+#include "assembler.h"
+#include "object.h"
+#include "peephole.h"
+
+#define MAX_PATH_LINE 4096
+
+typedef struct {
+  char *input;
+  char *output;
+  const char *error;   // NULL if the file was assembled
+} batch_file;
+
+typedef struct {
+  batch_file *files;
+  WORD file_n;
+  WORD next;           // next file to hand out, shared by the workers
+  bool relocatable;
+  bool optimise;
+} batch;
+
+// everything assembling one file holds, so that it can be released
+// however far the file got before failing
+typedef struct {
+  batch *b;
+  batch_file *file;
+  const char *source;
+  size_t source_size;
+  FILE *output_file;
+  program *p;
+  table *externals;
+  object *o;
+  BYTE **buffer;       // the worker's output buffer, reused across files
+  WORD *capacity;
+} batch_job;
+
+void assemble_job(void *arg) {
+  batch_job *job = (batch_job *) arg;
+  job->source = map_file(job->file->input, &job->source_size);
+  job->output_file = open_file(job->file->output, "wb");
+  job->p = program_scan(job->source, job->source_size, 1);
+  if (job->b->relocatable) {
+    job->externals = program_externals(job->p);
+  }
+
+  WORD out_size = job->p->out_size;
+  if (out_size > *job->capacity) {
+    free(*job->buffer);
+    *job->capacity = 0;
+    *job->buffer = malloc(out_size);
+    fail_if(!*job->buffer, "Failed to allocate memory");
+    *job->capacity = out_size;
+  }
+  memset(*job->buffer, 0, out_size);
+  program_encode(job->p, *job->buffer);
+
+  if (job->b->relocatable) {
+    job->o = object_create(job->p, job->externals, *job->buffer);
+    object_write(job->o, job->output_file);
+  } else {
+    if (job->b->optimise) {
+      out_size = peephole(*job->buffer, job->p->code_size, out_size, NULL);
+    }
+    write_binary_file(job->output_file, *job->buffer, out_size);
+  }
+}
+
+void release_job(batch_job *job) {
+  if (job->o) {
+    object_free(job->o);
+  }
+  if (job->externals) {
+    table_free(job->externals);
+  }
+  if (job->p) {
+    program_free(job->p);
+  }
+  if (job->output_file) {
+    fclose(job->output_file);
+    if (job->file->error) {
+      remove(job->file->output);
+    }
+  }
+  if (job->source) {
+    unmap_file(job->source, job->source_size);
+  }
+}
+
+void *batch_worker(void *arg) {
+  batch *b = (batch *) arg;
+  BYTE *buffer = NULL;
+  WORD capacity = 0;
+  WORD i;
+  while ((i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) < b->file_n) {
+    batch_job job = {b, &b->files[i]};
+    job.buffer = &buffer;
+    job.capacity = &capacity;
+    b->files[i].error = catch_failure(&assemble_job, &job);
+    release_job(&job);
+  }
+  free(buffer);
+  return NULL;
+}
+
+// input with its extension replaced
+char *default_output(const char *input, const char *extension) {
+  const char *dot = strrchr(input, '.');
+  const char *slash = strrchr(input, '/');
+  size_t stem = dot && (!slash || dot > slash) ? dot - input : strlen(input);
+  char *output = malloc(stem + strlen(extension) + 1);
+  fail_if(!output, "Failed to allocate memory");
+  memcpy(output, input, stem);
+  strcpy(output + stem, extension);
+  return output;
+}
+
+void read_manifest(batch *b, char *manifest) {
+  size_t size;
+  const char *text = map_file(manifest, &size);
+  WORD capacity = 0;
+  char line[MAX_PATH_LINE];
+  const char *cursor = text;
+  while (read_line(&cursor, text + size, line, sizeof(line))) {
+    char *save;
+    char *input = strtok_r(line, " \t\r\n", &save);
+    if (!input || input[0] == '#') {
+      continue;
+    }
+    char *output = strtok_r(NULL, " \t\r\n", &save);
+    b->files = reserve(b->files, b->file_n, &capacity, sizeof(batch_file));
+    batch_file *f = &b->files[b->file_n++];
+    f->input = strdup(input);
+    f->output = output ? strdup(output)
+                       : default_output(input, b->relocatable ? ".o" : ".bin");
+    f->error = NULL;
+    fail_if(!f->input || !f->output, "Failed to allocate memory");
+  }
+  if (text) {
+    unmap_file(text, size);
+  }
+}
+
+int assemble_batch(char *manifest, int workers, bool relocatable, bool optimise) {
+  batch b = {NULL, 0, 0, relocatable, optimise};
+  read_manifest(&b, manifest);
+  if (workers < 1) {
+    workers = 1;
+  }
+  if (workers > b.file_n) {
+    workers = b.file_n ? b.file_n : 1;
+  }
+
+  pthread_t *threads = calloc(workers, sizeof(pthread_t));
+  fail_if(!threads, "Failed to allocate memory");
+  for (int i = 0; i < workers; i++) {
+    fail_if(pthread_create(&threads[i], NULL, &batch_worker, &b),
+            "Failed to start assembler thread");
+  }
+  for (int i = 0; i < workers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  // failures in manifest order, whichever worker hit them
+  int failed = 0;
+  for (WORD i = 0; i < b.file_n; i++) {
+    if (b.files[i].error) {
+      printf("%s: ERROR: %s\n", b.files[i].input, b.files[i].error);
+      failed++;
+    }
+    free(b.files[i].input);
+    free(b.files[i].output);
+  }
+  free(b.files);
+  return failed;
+}
@@ -0,0 +1,15 @@
+#ifndef BATCH
+#define BATCH
+#include "utils.h"
+
+// Assembles every file of a manifest in one process
+// Each line of the manifest names an input and an output file; a line
+// with only an input writes next to it, with the extension replaced by
+// .bin (.o for objects). Blank lines and lines starting with # are skipped
+// Files are shared out to workers threads; the mnemonic table is shared,
+// while symbol tables and output buffers belong to each file or worker
+// A file that fails is reported and skipped, and its output removed
+// Returns the number of files that failed
+int assemble_batch(char *manifest, int workers, bool relocatable, bool optimise);
+
+#endif
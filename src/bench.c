@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "utils.h"
+
+typedef struct {
+  double seconds;          // fastest run
+  long peak_rss_kb;        // largest run
+  long out_bytes;
+  long alloc_n;            // -1 when the command does not count allocations
+  long alloc_bytes;
+} measurement;
+
+long count_lines(char *file_name) {
+  size_t size;
+  const char *source = map_file(file_name, &size);
+  long lines = 0;
+  for (size_t i = 0; i < size; i++) {
+    lines += source[i] == '\n';
+  }
+  if (size && source[size - 1] != '\n') {
+    lines++;
+  }
+  unmap_file(source, size);
+  return lines;
+}
+
+double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// runs command with the corpus and the output file appended to its
+// arguments, and waits for it; the child's own rusage gives its peak RSS
+void run_once(char **command, int arg_n, char *corpus, char *out_name,
+              char *count_name, measurement *m) {
+  char *argv[arg_n + 3];
+  memcpy(argv, command, arg_n * sizeof(char *));
+  argv[arg_n] = corpus;
+  argv[arg_n + 1] = out_name;
+  argv[arg_n + 2] = NULL;
+
+  remove(count_name);
+  double start = now();
+  pid_t pid = fork();
+  fail_if(pid < 0, "Failed to start the benchmarked command");
+  if (pid == 0) {
+    setenv("ALLOC_COUNT_FILE", count_name, 1);
+    execvp(argv[0], argv);
+    _exit(127);
+  }
+  int status;
+  struct rusage usage;
+  fail_if(wait4(pid, &status, 0, &usage) != pid, "Failed to wait for the command");
+  double seconds = now() - start;
+  fail_if(!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS,
+          "The benchmarked command failed");
+
+  if (m->seconds == 0 || seconds < m->seconds) {
+    m->seconds = seconds;
+  }
+  if (usage.ru_maxrss > m->peak_rss_kb) {
+    m->peak_rss_kb = usage.ru_maxrss;
+  }
+  struct stat out_stat;
+  m->out_bytes = stat(out_name, &out_stat) ? 0 : out_stat.st_size;
+  FILE *count_file = fopen(count_name, "r");
+  if (!count_file || fscanf(count_file, "%ld %ld", &m->alloc_n, &m->alloc_bytes) != 2) {
+    m->alloc_n = m->alloc_bytes = -1;
+  }
+  if (count_file) {
+    fclose(count_file);
+  }
+}
+
+// usage: bench [-n runs] corpus.s [corpus.s ...] -- command [args]
+// Runs "command args corpus output" runs times for every corpus and prints
+// one line per corpus: the fastest time, the largest peak RSS and the
+// allocations counted by a command linked with alloc_count.o
+// Columns are fixed so the reports of two commits can be diffed
+int main(int argc, char **argv) {
+  int runs = 3;
+  int opt;
+  while ((opt = getopt(argc, argv, "+n:")) != -1) {
+    switch (opt) {
+      case 'n':
+        runs = atoi(optarg);
+        break;
+      default:
+        fail_if(true, "Usage: bench [-n runs] corpus.s [corpus.s ...] -- command [args]");
+    }
+  }
+  int separator = optind;
+  while (separator < argc && strcmp(argv[separator], "--")) {
+    separator++;
+  }
+  fail_if(runs < 1 || separator == optind || separator + 1 >= argc,
+          "Usage: bench [-n runs] corpus.s [corpus.s ...] -- command [args]");
+  char **command = argv + separator + 1;
+  int arg_n = argc - separator - 1;
+
+  char out_name[] = "/tmp/bench_out_XXXXXX";
+  char count_name[] = "/tmp/bench_allocs_XXXXXX";
+  int out_fd = mkstemp(out_name);
+  int count_fd = mkstemp(count_name);
+  fail_if(out_fd < 0 || count_fd < 0, "Failed to create temporary files");
+  close(out_fd);
+  close(count_fd);
+
+  // the command as one column, without the corpus and output
+  char label[256] = "";
+  for (int i = 0; i < arg_n; i++) {
+    strncat(label, i ? " " : "", sizeof(label) - strlen(label) - 1);
+    strncat(label, command[i], sizeof(label) - strlen(label) - 1);
+  }
+
+  printf("%-32s %-24s %10s %10s %9s %12s %12s %10s %10s %12s\n",
+         "corpus", "command", "lines", "bytes", "seconds",
+         "lines/s", "bytes/s", "rss_kb", "allocs", "alloc_bytes");
+  for (int i = optind; i < separator; i++) {
+    measurement m = {0};
+    for (int run = 0; run < runs; run++) {
+      run_once(command, arg_n, argv[i], out_name, count_name, &m);
+    }
+    long lines = count_lines(argv[i]);
+    printf("%-32s %-24s %10ld %10ld %9.4f %12.0f %12.0f %10ld %10ld %12ld\n",
+           argv[i], label, lines, m.out_bytes, m.seconds,
+           lines / m.seconds, m.out_bytes / m.seconds,
+           m.peak_rss_kb, m.alloc_n, m.alloc_bytes);
+    fflush(stdout);
+  }
+
+  remove(out_name);
+  remove(count_name);
+  return EXIT_SUCCESS;
+}
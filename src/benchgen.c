@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "utils.h"
+
+// a label is defined before every LABEL_GAP-th instruction
+#define LABEL_GAP 8
+// branches go at most this many labels back or forward
+#define BRANCH_REACH 64
+
+static uint64_t rng_state;
+
+// xorshift64*: the corpus only depends on the seed, on every platform
+uint64_t next_random(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+WORD random_below(WORD n) {
+  return next_random() % n;
+}
+
+// r0-r12, leaving the pc and the registers the emulator prints apart
+WORD random_register(void) {
+  return random_below(13);
+}
+
+// a label that exists: the last one is always defined at the end
+WORD branch_label(WORD current, WORD label_n) {
+  WORD back = current < BRANCH_REACH ? current : BRANCH_REACH;
+  WORD target = current - back + random_below(back + BRANCH_REACH);
+  return target < label_n ? target : label_n - 1;
+}
+
+// one instruction for every mnemonic the assembler knows, in every
+// operand form it accepts; returns true after an unconditional branch, as
+// the next line can then only be reached by branching to it
+bool print_instruction(FILE *out, WORD label, WORD label_n, bool unreachable) {
+  static const char *results[] = {"and", "eor", "sub", "rsb", "add", "orr"};
+  static const char *compares[] = {"tst", "teq", "cmp", "mov"};
+  static const char *branches[] = {"beq", "bne", "bge", "blt", "bgt", "ble", "b"};
+  WORD rd = random_register();
+  WORD rn = random_register();
+  WORD rm = random_register();
+  // a SWI ends a run that reaches it (see semihost.h), so runs of the
+  // corpus never do
+  if (unreachable && random_below(2)) {
+    fprintf(out, random_below(2) ? "swi #0x%x\n" : "swi 0x%x\n",
+            (WORD)random_below(0x1000000));
+    return false;
+  }
+  switch (random_below(14)) {
+    case 0:
+      fprintf(out, "%s r%u,r%u,#0x%x\n", results[random_below(6)], rd, rn,
+              (WORD)random_below(0x100) << (2 * random_below(12)));
+      break;
+    case 1:
+      fprintf(out, "%s r%u,r%u,r%u\n", results[random_below(6)], rd, rn, rm);
+      break;
+    case 2:
+      fprintf(out, "%s r%u,#%u\n", compares[random_below(4)], rd, (WORD)random_below(0x100));
+      break;
+    case 3:
+      fprintf(out, "%s r%u,r%u\n", compares[random_below(4)], rd, rn);
+      break;
+    case 4:
+      fprintf(out, "mul r%u,r%u,r%u\n", rd, rn, rm);
+      break;
+    case 5:
+      fprintf(out, "mla r%u,r%u,r%u,r%u\n", rd, rn, rm, random_register());
+      break;
+    case 6:
+      // =const: about half of them need the literal pool
+      fprintf(out, "ldr r%u,=0x%x\n", rd, (WORD)random_below(0x200) << random_below(20));
+      break;
+    case 7:
+      switch (random_below(3)) {
+        case 0:
+          fprintf(out, "ldr r%u,[r%u]\n", rd, rn);
+          break;
+        case 1:
+          fprintf(out, "ldr r%u,[r%u,#%u]\n", rd, rn, 4 * (WORD)random_below(64));
+          break;
+        default:
+          fprintf(out, "ldr r%u,[r%u],#%u\n", rd, rn, 4 * (WORD)random_below(64));
+      }
+      break;
+    case 8:
+      fprintf(out, "str r%u,[r%u,#%u]\n", rd, rn, 4 * (WORD)random_below(64));
+      break;
+    case 9:
+    case 10: {
+      WORD branch = random_below(7);
+      fprintf(out, "%s l%u\n", branches[branch], branch_label(label, label_n));
+      return branch == 6;
+    }
+    case 11: {
+      // flag-setting forms, never to the pc: no exception returns
+      char operand[16];
+      if (random_below(2)) {
+        sprintf(operand, "r%u", rm);
+      } else {
+        sprintf(operand, "#%u", (WORD)random_below(0x100));
+      }
+      if (random_below(2)) {
+        fprintf(out, "subs r%u,r%u,%s\n", rd, rn, operand);
+      } else {
+        fprintf(out, "movs r%u,%s\n", rd, operand);
+      }
+      break;
+    }
+    case 12:
+      fprintf(out, "%s r%u,r%u,[r%u]\n", random_below(2) ? "swpb" : "swp", rd, rm, rn);
+      break;
+    default:
+      fprintf(out, "lsl r%u,#%u\n", rd, 1 + (WORD)random_below(31));
+  }
+  return false;
+}
+
+// usage: benchgen lines [seed] > corpus.s
+// Writes a synthetic program of the given number of source lines
+int main(int argc, char **argv) {
+  fail_if(argc < 2, "Usage: benchgen lines [seed]");
+  long lines = atol(argv[1]);
+  rng_state = argc > 2 ? strtoull(argv[2], NULL, 0) : 1;
+  fail_if(lines < 2, "A corpus needs at least two lines");
+  // zero is a fixed point of xorshift
+  rng_state = rng_state ? rng_state : 1;
+
+  // the final label and andeq take the last two lines; every group of
+  // LABEL_GAP + 1 lines before them starts with a label
+  long body = lines - 2;
+  WORD label_n = (body + LABEL_GAP) / (LABEL_GAP + 1) + 1;
+  WORD label = 0;
+  bool unreachable = false;
+  for (long line = 0; line < body; line++) {
+    if (line % (LABEL_GAP + 1) == 0) {
+      printf("l%u:\n", label++);
+      unreachable = false;
+    } else {
+      unreachable = print_instruction(stdout, label, label_n, unreachable);
+    }
+  }
+  printf("l%u:\n", label_n - 1);
+  printf("andeq r0,r0,r0\n");
+  return EXIT_SUCCESS;
+}
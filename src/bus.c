@@ -0,0 +1,103 @@
+#include "bus.h"
+#include <stdlib.h>
+#include "utils.h"
+
+#define DIRECTORY_INDEX(address) ((address) >> (BUS_PAGE_BITS + BUS_TABLE_BITS))
+#define TABLE_INDEX(address) (((address) >> BUS_PAGE_BITS) & (BUS_TABLE_SIZE - 1))
+
+bus *bus_create(void) {
+  bus *b = calloc(1, sizeof(bus));
+  fail_if(!b, "Failed to allocate memory");
+  return b;
+}
+
+void bus_register(bus *b, device d) {
+  fail_if(b->device_n == MAX_DEVICE_N, "Too many devices on the bus");
+  fail_if(d.size == 0 || d.base < MEMORY_SIZE || d.base + d.size - 1 < d.base,
+          "Device range is not outside memory");
+  device *mapped = &b->devices[b->device_n++];
+  *mapped = d;
+  WORD last_page = (d.base + d.size - 1) >> BUS_PAGE_BITS;
+  for (WORD page = d.base >> BUS_PAGE_BITS; page <= last_page; page++) {
+    WORD address = page << BUS_PAGE_BITS;
+    device ***table = &b->tables[DIRECTORY_INDEX(address)];
+    if (!*table) {
+      *table = calloc(BUS_TABLE_SIZE, sizeof(device *));
+      fail_if(!*table, "Failed to allocate memory");
+    }
+    fail_if((*table)[TABLE_INDEX(address)] != NULL, "Device ranges overlap");
+    (*table)[TABLE_INDEX(address)] = mapped;
+  }
+}
+
+device *bus_find(const bus *b, WORD address) {
+  device **table = b->tables[DIRECTORY_INDEX(address)];
+  return table ? table[TABLE_INDEX(address)] : NULL;
+}
+
+// the device decoding address, with the offset into it
+device *decode_address(const bus *b, WORD address, WORD *offset) {
+  device *d = b ? bus_find(b, address) : NULL;
+  if (!d || address - d->base >= d->size) {
+    return NULL;
+  }
+  *offset = address - d->base;
+  return d;
+}
+
+void bus_share(bus *b) {
+  b->lock = malloc(sizeof(pthread_mutex_t));
+  fail_if(!b->lock, "Failed to allocate memory");
+  pthread_mutex_init(b->lock, NULL);
+}
+
+bool bus_load(const bus *b, WORD address, WORD *value, uint64_t time) {
+  WORD offset;
+  device *d = decode_address(b, address, &offset);
+  // mapped host memory is read only, so it needs no lock
+  if (d && d->direct) {
+    if (offset + sizeof(WORD) > d->size) {
+      return false;
+    }
+    *value = read_word(d->direct, offset);
+    return true;
+  }
+  if (!d || !d->load) {
+    return false;
+  }
+  if (b->lock) {
+    pthread_mutex_lock(b->lock);
+  }
+  bool handled = d->load(d->data, offset, value, time);
+  if (b->lock) {
+    pthread_mutex_unlock(b->lock);
+  }
+  return handled;
+}
+
+bool bus_store(const bus *b, WORD address, WORD value, uint64_t time) {
+  WORD offset;
+  device *d = decode_address(b, address, &offset);
+  if (!d || !d->store) {
+    return false;
+  }
+  if (b->lock) {
+    pthread_mutex_lock(b->lock);
+  }
+  bool handled = d->store(d->data, offset, value, time);
+  if (b->lock) {
+    pthread_mutex_unlock(b->lock);
+  }
+  return handled;
+}
+
+void bus_free(bus *b) {
+  for (WORD i = 0; i < BUS_DIRECTORY_SIZE; i++) {
+    free(b->tables[i]);
+  }
+  if (b->lock) {
+    pthread_mutex_destroy(b->lock);
+    free(b->lock);
+  }
+  free(b);
+}
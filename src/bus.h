@@ -0,0 +1,61 @@
+#ifndef BUS
+#define BUS
+#include <stdint.h>
+#include <pthread.h>
+#include "utils.h"
+
+// Device bus for the addresses outside emulated RAM
+// Devices register an address range; the pages it covers point at the
+// device in a two-level page map (a directory of lazily allocated page
+// tables), so that looking up an address costs two indexed loads and
+// RAM accesses never consult the bus at all
+
+#define BUS_PAGE_BITS 12
+#define BUS_PAGE_SIZE (1u << BUS_PAGE_BITS)
+#define BUS_TABLE_BITS 10
+#define BUS_DIRECTORY_SIZE (1u << (32 - BUS_PAGE_BITS - BUS_TABLE_BITS))
+#define BUS_TABLE_SIZE (1u << BUS_TABLE_BITS)
+#define MAX_DEVICE_N 16
+
+// Handlers get the offset of the access from the device's base and the
+// number of instructions executed so far; they return false for an
+// offset the device does not decode
+// A device with direct set is host memory mapped into the guest: loads
+// read the words at direct + offset in place, without a handler
+typedef struct device {
+  const char *name;
+  WORD base;
+  WORD size;
+  bool (*load)(void *data, WORD offset, WORD *value, uint64_t time);
+  bool (*store)(void *data, WORD offset, WORD value, uint64_t time);
+  void *data;
+  const BYTE *direct;
+} device;
+
+typedef struct bus {
+  device **tables[BUS_DIRECTORY_SIZE];   // NULL where nothing is mapped
+  device devices[MAX_DEVICE_N];
+  WORD device_n;
+  pthread_mutex_t *lock;                 // set by bus_share
+} bus;
+
+bus *bus_create(void);
+
+// Maps the pages of [d.base, d.base + d.size) to a copy of d
+// The range must lie outside RAM and not overlap another device's pages
+void bus_register(bus *b, device d);
+
+// The device whose pages contain address, or NULL
+device *bus_find(const bus *b, WORD address);
+
+// Serialises the accesses to the devices from then on, for buses that
+// several cores share (see smp.h)
+void bus_share(bus *b);
+
+// Word accesses at address; false if no device decodes it
+bool bus_load(const bus *b, WORD address, WORD *value, uint64_t time);
+bool bus_store(const bus *b, WORD address, WORD value, uint64_t time);
+
+void bus_free(bus *b);
+
+#endif
@@ -0,0 +1,257 @@
+#include "cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "symbol_table.h"
+#include "assembler.h"
+#include "encode.h"
+
+#define CACHE_MAGIC 0x434d5241 // "ARMC"
+#define CACHE_VERSION 1
+
+line_cache *cache_create(void) {
+  line_cache *c = calloc(1, sizeof(line_cache));
+  fail_if(!c, "Failed to allocate memory");
+  c->names = arena_create();
+  return c;
+}
+
+bool read_words(FILE *file, WORD *words, int n) {
+  return fread(words, sizeof(WORD), n, file) == n;
+}
+
+// index the records of the previous run by line hash
+void build_slots(line_cache *c) {
+  c->slot_n = 1;
+  while (c->slot_n < 2 * c->record_n) {
+    c->slot_n <<= 1;
+  }
+  c->slots = calloc(c->slot_n, sizeof(WORD));
+  fail_if(!c->slots, "Failed to allocate memory");
+  for (WORD i = 0; i < c->record_n; i++) {
+    WORD slot = c->records[i].hash & (c->slot_n - 1);
+    while (c->slots[slot]) {
+      slot = (slot + 1) & (c->slot_n - 1);
+    }
+    c->slots[slot] = i + 1;
+  }
+}
+
+bool load_contents(line_cache *c, FILE *file) {
+  WORD header[2];
+  if (!read_words(file, header, 2)
+      || header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION) {
+    return false;
+  }
+  if (fread(&c->source_hash, sizeof(uint64_t), 1, file) != 1
+      || !read_words(file, &c->out_size, 1)) {
+    return false;
+  }
+  c->image = malloc(c->out_size + 1);
+  if (!c->image || fread(c->image, sizeof(BYTE), c->out_size, file) != c->out_size) {
+    return false;
+  }
+
+  if (!read_words(file, &c->label_n, 1)) {
+    return false;
+  }
+  c->labels = calloc(c->label_n + 1, sizeof(char *));
+  if (!c->labels) {
+    return false;
+  }
+  for (WORD i = 0; i < c->label_n; i++) {
+    WORD entry[2];
+    if (!read_words(file, entry, 2) || entry[1] >= MAX_LINE_LENGTH) {
+      return false;
+    }
+    c->labels[i] = arena_alloc(c->names, entry[1] + 1);
+    if (fread(c->labels[i], sizeof(char), entry[1], file) != entry[1]) {
+      return false;
+    }
+    c->labels[i][entry[1]] = '\0';
+  }
+
+  if (!read_words(file, &c->record_n, 1)) {
+    return false;
+  }
+  c->records = calloc(c->record_n + 1, sizeof(line_record));
+  if (!c->records
+      || fread(c->records, sizeof(line_record), c->record_n, file) != c->record_n) {
+    return false;
+  }
+  for (WORD i = 0; i < c->record_n; i++) {
+    if (c->records[i].kind == LABEL_BRANCH && c->records[i].label >= c->label_n) {
+      return false;
+    }
+  }
+  build_slots(c);
+  return true;
+}
+
+line_cache *cache_load(char *file_name) {
+  line_cache *c = cache_create();
+  FILE *file = fopen(file_name, "rb");
+  if (!file) {
+    return c;
+  }
+  bool loaded = load_contents(c, file);
+  fclose(file);
+  if (!loaded) {
+    verbose_print("Ignoring unreadable assembler cache\n");
+    cache_free(c);
+    c = cache_create();
+  }
+  return c;
+}
+
+bool cache_matches(line_cache *c, const char *source, size_t source_size) {
+  return c->image && c->source_hash == hash_bytes(source, source_size);
+}
+
+void cache_prepare(line_cache *c, program *p) {
+  c->source_hash = hash_bytes(p->source, p->source_size);
+  c->new_record_n = p->code_size / 4;
+  c->new_records = calloc(c->new_record_n + 1, sizeof(line_record));
+  c->new_labels = calloc(c->new_record_n + 1, sizeof(const char *));
+  fail_if(!c->new_records || !c->new_labels, "Failed to allocate memory");
+}
+
+line_record *cache_find(line_cache *c, uint64_t hash) {
+  if (!c->slot_n) {
+    return NULL;
+  }
+  WORD slot = hash & (c->slot_n - 1);
+  while (c->slots[slot]) {
+    line_record *r = &c->records[c->slots[slot] - 1];
+    if (r->hash == hash) {
+      return r;
+    }
+    slot = (slot + 1) & (c->slot_n - 1);
+  }
+  return NULL;
+}
+
+// check whether the old encoding is still right at the new position,
+// and if so store the new value of what it depends on
+bool still_valid(line_cache *c, line_record *old, table *sym_table,
+                 WORD address, WORD pool_address, WORD *dependency) {
+  switch (old->kind) {
+    case PLAIN:
+      *dependency = 0;
+      return true;
+    case LABEL_BRANCH:
+      if (!table_get(sym_table, c->labels[old->label], dependency)) {
+        return false;
+      }
+      return *dependency - address == old->dependency - old->address;
+    case ADDRESS_BRANCH:
+      *dependency = old->dependency;
+      return address == old->address;
+    case LITERAL:
+      *dependency = pool_address;
+      return pool_address - address == old->dependency - old->address;
+    default:
+      return false;
+  }
+}
+
+void cache_assemble(line_cache *c, char *line, table *sym_table,
+                    BYTE *output, WORD address, WORD *pool_address) {
+  uint64_t hash = hash_bytes(line, strlen(line));
+  line_record *record = &c->new_records[address / 4];
+
+  line_record *old = cache_find(c, hash);
+  WORD dependency;
+  if (old && still_valid(c, old, sym_table, address, *pool_address, &dependency)) {
+    *record = *old;
+    record->address = address;
+    record->dependency = dependency;
+    write_word(output, address, old->encoding);
+    if (old->kind == LITERAL) {
+      write_word(output, *pool_address, old->literal);
+      *pool_address += 4;
+    }
+    if (old->kind == LABEL_BRANCH) {
+      c->new_labels[address / 4] = table_key(sym_table, c->labels[old->label]);
+    }
+    return;
+  }
+
+  char copy[MAX_LINE_LENGTH];
+  strncpy(copy, line, MAX_LINE_LENGTH - 1);
+  copy[MAX_LINE_LENGTH - 1] = '\0';
+  WORD pool_before = *pool_address;
+  assemble(line, sym_table, &output, pool_address, address);
+
+  *record = (line_record) {hash, PLAIN, 0, address, 0, read_word(output, address), 0};
+  if (*pool_address != pool_before) {
+    record->kind = LITERAL;
+    record->dependency = pool_before;
+    record->literal = read_word(output, pool_before);
+    return;
+  }
+  char *tokens[1 + MAX_OPERAND_N];
+  int token_n = tokenize(copy, tokens);
+  if (token_n >= 2 && is_branch_mnemonic(tokens[0])) {
+    if (tokens[1][0] == '#') {
+      record->kind = ADDRESS_BRANCH;
+    } else {
+      record->kind = LABEL_BRANCH;
+      table_get(sym_table, tokens[1], &record->dependency);
+      c->new_labels[address / 4] = table_key(sym_table, tokens[1]);
+    }
+  }
+}
+
+int compare_keys(const void *a, const void *b) {
+  return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+void cache_save(line_cache *c, char *file_name, program *p, const BYTE *output) {
+  FILE *file = open_file(file_name, "wb");
+  WORD header[2] = {CACHE_MAGIC, CACHE_VERSION};
+  fwrite(header, sizeof(WORD), 2, file);
+  fwrite(&c->source_hash, sizeof(uint64_t), 1, file);
+  fwrite(&p->out_size, sizeof(WORD), 1, file);
+  fwrite(output, sizeof(BYTE), p->out_size, file);
+
+  // the label table, numbered in sorted order
+  WORD label_n = p->sym_table->size;
+  char **keys = calloc(label_n + 1, sizeof(char *));
+  fail_if(!keys, "Failed to allocate memory");
+  label_n = 0;
+  for (node *n = p->sym_table->start; n; n = n->next) {
+    keys[label_n++] = n->key;
+  }
+  qsort(keys, label_n, sizeof(char *), &compare_keys);
+  fwrite(&label_n, sizeof(WORD), 1, file);
+  for (WORD i = 0; i < label_n; i++) {
+    WORD value;
+    table_get(p->sym_table, keys[i], &value);
+    WORD entry[2] = {value, strlen(keys[i])};
+    fwrite(entry, sizeof(WORD), 2, file);
+    fwrite(keys[i], sizeof(char), entry[1], file);
+  }
+
+  fwrite(&c->new_record_n, sizeof(WORD), 1, file);
+  for (WORD i = 0; i < c->new_record_n; i++) {
+    if (c->new_records[i].kind == LABEL_BRANCH) {
+      char **key = bsearch(&c->new_labels[i], keys, label_n, sizeof(char *), &compare_keys);
+      c->new_records[i].label = key - keys;
+    }
+  }
+  fwrite(c->new_records, sizeof(line_record), c->new_record_n, file);
+  free(keys);
+  fclose(file);
+}
+
+void cache_free(line_cache *c) {
+  arena_free(c->names);
+  free(c->labels);
+  free(c->new_labels);
+  free(c->new_records);
+  free(c->records);
+  free(c->slots);
+  free(c->image);
+  free(c);
+}
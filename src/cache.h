@@ -0,0 +1,71 @@
+#ifndef CACHE
+#define CACHE
+#include <stdint.h>
+#include "utils.h"
+#include "symbol_table.h"
+#include "arena.h"
+#include "assembler.h"
+
+// What the encoding of a line depends on besides its text
+typedef enum line_kind {
+  PLAIN,            // nothing: the encoding can always be reused
+  LABEL_BRANCH,     // the distance to a label
+  ADDRESS_BRANCH,   // the distance to an absolute branch target
+  LITERAL           // the distance to its literal pool slot
+} line_kind;
+
+// The encoding of one instruction line, as stored in the cache file
+typedef struct {
+  uint64_t hash;      // hash of the line text
+  WORD kind;
+  WORD label;         // index into the label table for LABEL_BRANCH
+  WORD address;       // address the line was encoded at
+  WORD dependency;    // branch target or literal address it was encoded with
+  WORD encoding;
+  WORD literal;       // pool word for LITERAL lines
+} line_record;
+
+// Encodings of a previous run, looked up by line hash, and the records
+// of the current run indexed by instruction number
+typedef struct line_cache {
+  uint64_t source_hash;
+  WORD out_size;
+  BYTE *image;
+
+  WORD label_n;
+  char **labels;      // label names, allocated in names
+  arena *names;
+
+  WORD record_n;
+  line_record *records;
+  WORD slot_n;        // power of two, slots hold record index + 1
+  WORD *slots;
+
+  // current run
+  WORD new_record_n;
+  line_record *new_records;
+  // label name of every new LABEL_BRANCH record, owned by the symbol table
+  const char **new_labels;
+} line_cache;
+
+// Loads the cache file, or returns an empty cache when it is missing,
+// unreadable or from another version
+line_cache *cache_load(char *file_name);
+
+// True if the cache holds the image of exactly this source
+bool cache_matches(line_cache *c, const char *source, size_t source_size);
+
+// Prepares the cache to record the encodings of the scanned program
+void cache_prepare(line_cache *c, program *p);
+
+// Encodes line at address, reusing the cached encoding (and literal) when
+// neither its text nor the distance to what it references has changed
+void cache_assemble(line_cache *c, char *line, table *sym_table,
+                    BYTE *output, WORD address, WORD *pool_address);
+
+// Writes the records of the current run and the output image to file_name
+void cache_save(line_cache *c, char *file_name, program *p, const BYTE *output);
+
+void cache_free(line_cache *c);
+
+#endif
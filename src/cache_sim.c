@@ -0,0 +1,272 @@
+#include "cache_sim.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "utils.h"
+#include "source_map.h"
+
+static const char *policy_names[] = {"lru", "fifo", "random"};
+
+bool power_of_two(WORD n) {
+  return n && !(n & (n - 1));
+}
+
+WORD log2_of(WORD n) {
+  WORD bits = 0;
+  while (n >>= 1) {
+    bits++;
+  }
+  return bits;
+}
+
+// a number of bytes, optionally with a k suffix; advances *text past it
+bool parse_size(const char **text, WORD *size) {
+  char *end;
+  unsigned long n = strtoul(*text, &end, 10);
+  if (end == *text) {
+    return false;
+  }
+  if (*end == 'k' || *end == 'K') {
+    n *= 1024;
+    end++;
+  }
+  *size = n;
+  *text = end;
+  return true;
+}
+
+// sizes, ways and lines that are powers of two, with lines of at least a
+// word and room for a set
+bool config_valid(const cache_config *config) {
+  return power_of_two(config->size) && power_of_two(config->ways)
+    && power_of_two(config->line_size) && config->line_size >= sizeof(WORD)
+    && config->size >= config->ways * config->line_size;
+}
+
+bool cache_config_parse(const char *text, cache_config *config) {
+  config->policy = CACHE_LRU;
+  if (!parse_size(&text, &config->size) || *text++ != ':'
+      || !parse_size(&text, &config->ways) || *text++ != ':'
+      || !parse_size(&text, &config->line_size)) {
+    return false;
+  }
+  if (*text == ':') {
+    text++;
+    bool known = false;
+    for (int i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++) {
+      if (!strcmp(text, policy_names[i])) {
+        config->policy = i;
+        known = true;
+      }
+    }
+    if (!known) {
+      return false;
+    }
+  } else if (*text) {
+    return false;
+  }
+  return config_valid(config);
+}
+
+cache_level *level_create(const cache_config *config) {
+  fail_if(!config_valid(config), "Cache sizes, ways and lines must be powers of two that fit");
+  cache_level *l = calloc(1, sizeof(cache_level));
+  fail_if(!l, "Failed to allocate memory");
+  l->config = *config;
+  l->line_bits = log2_of(config->line_size);
+  l->set_n = config->size / (config->ways * config->line_size);
+  l->lines = calloc(config->size / config->line_size, sizeof(cache_line));
+  l->pcs = calloc(MEMORY_SIZE / sizeof(WORD), sizeof(cache_stats));
+  fail_if(!l->lines || !l->pcs, "Failed to allocate memory");
+  l->random = 1;
+  return l;
+}
+
+cache_sim *cache_sim_create(const cache_config *icache, const cache_config *dcache) {
+  cache_sim *c = calloc(1, sizeof(cache_sim));
+  fail_if(!c, "Failed to allocate memory");
+  c->icache = icache ? level_create(icache) : NULL;
+  c->dcache = dcache ? level_create(dcache) : NULL;
+  return c;
+}
+
+// the line of the set to fill: an invalid one, or the policy's victim
+cache_line *choose_victim(cache_level *l, cache_line *set) {
+  WORD ways = l->config.ways;
+  for (WORD i = 0; i < ways; i++) {
+    if (!set[i].valid) {
+      return &set[i];
+    }
+  }
+  if (l->config.policy == CACHE_RANDOM) {
+    l->random ^= l->random << 13;
+    l->random ^= l->random >> 7;
+    l->random ^= l->random << 17;
+    return &set[l->random & (ways - 1)];
+  }
+  // the oldest use (LRU) or fill (FIFO)
+  cache_line *oldest = &set[0];
+  for (WORD i = 1; i < ways; i++) {
+    if (set[i].stamp < oldest->stamp) {
+      oldest = &set[i];
+    }
+  }
+  return oldest;
+}
+
+// looks line (an address >> line_bits) up, filling it on a miss; returns
+// true on a hit
+bool cache_lookup(cache_level *l, WORD line, bool store) {
+  cache_line *set = &l->lines[(line & (l->set_n - 1)) * l->config.ways];
+  l->clock++;
+  for (WORD i = 0; i < l->config.ways; i++) {
+    if (set[i].valid && set[i].tag == line) {
+      if (l->config.policy == CACHE_LRU) {
+        set[i].stamp = l->clock;
+      }
+      set[i].dirty |= store;
+      return true;
+    }
+  }
+  cache_line *fill = choose_victim(l, set);
+  l->write_backs += fill->valid && fill->dirty;
+  *fill = (cache_line) {line, true, store, l->clock};
+  return false;
+}
+
+void add_access(cache_stats *stats, bool hit) {
+  stats->accesses++;
+  stats->misses += !hit;
+}
+
+// looks up every line of the size bytes at address, within memory
+void access_lines(cache_level *l, WORD pc, WORD address, WORD size, bool store) {
+  WORD last = (address + size - 1) >> l->line_bits;
+  for (WORD line = address >> l->line_bits; line <= last; line++) {
+    WORD line_address = line << l->line_bits;
+    if (line_address >= MEMORY_SIZE) {
+      break;
+    }
+    bool hit = cache_lookup(l, line, store);
+    add_access(&l->total, hit);
+    add_access(&l->regions[line_address >> CACHE_REGION_BITS], hit);
+    if (pc < MEMORY_SIZE) {
+      add_access(&l->pcs[pc / sizeof(WORD)], hit);
+    }
+  }
+}
+
+void cache_fetch(cache_sim *c, WORD pc) {
+  if (c->icache && pc < MEMORY_SIZE) {
+    access_lines(c->icache, pc, pc, sizeof(WORD), false);
+  }
+}
+
+void cache_data(cache_sim *c, WORD pc, WORD address, bool store) {
+  if (address >= MEMORY_SIZE) {
+    c->uncached++;
+  } else if (c->dcache) {
+    access_lines(c->dcache, pc, address, sizeof(WORD), store);
+  }
+}
+
+double miss_rate(const cache_stats *stats) {
+  return stats->accesses ? 100.0 * stats->misses / stats->accesses : 0;
+}
+
+void print_level(const char *name, const cache_level *l) {
+  printf("%s: %u bytes, %u ways, %u-byte lines, %s: %" PRIu64 " accesses, %" PRIu64
+         " misses (%.2f%%)", name, l->config.size, l->config.ways, l->config.line_size,
+         policy_names[l->config.policy], l->total.accesses, l->total.misses,
+         miss_rate(&l->total));
+  if (l->write_backs) {
+    printf(", %" PRIu64 " write backs", l->write_backs);
+  }
+  printf("\n");
+}
+
+// the stats of a level for the PC at index * 4, zero if it is not modelled
+cache_stats pc_stats(const cache_level *l, WORD index) {
+  return l ? l->pcs[index] : (cache_stats) {0, 0};
+}
+
+cache_stats region_stats(const cache_level *l, WORD region) {
+  return l ? l->regions[region] : (cache_stats) {0, 0};
+}
+
+uint64_t pc_misses(const cache_sim *c, WORD index) {
+  return pc_stats(c->icache, index).misses + pc_stats(c->dcache, index).misses;
+}
+
+void print_hot_pcs(const cache_sim *c, const source_map *map) {
+  WORD hot[CACHE_HOT_PC_N];
+  WORD hot_n = 0;
+  // insertion into the list of the most misses so far
+  for (WORD i = 0; i < MEMORY_SIZE / sizeof(WORD); i++) {
+    uint64_t misses = pc_misses(c, i);
+    if (!misses || (hot_n == CACHE_HOT_PC_N && misses <= pc_misses(c, hot[hot_n - 1]))) {
+      continue;
+    }
+    WORD j = hot_n < CACHE_HOT_PC_N ? hot_n++ : hot_n - 1;
+    while (j > 0 && pc_misses(c, hot[j - 1]) < misses) {
+      hot[j] = hot[j - 1];
+      j--;
+    }
+    hot[j] = i;
+  }
+  if (!hot_n) {
+    return;
+  }
+  printf("Hot PCs:\n");
+  for (WORD i = 0; i < hot_n; i++) {
+    WORD pc = hot[i] * sizeof(WORD);
+    cache_stats fetches = pc_stats(c->icache, hot[i]);
+    cache_stats data = pc_stats(c->dcache, hot[i]);
+    printf("0x%08x: %" PRIu64 "/%" PRIu64 " fetches missed, %" PRIu64 "/%" PRIu64
+           " loads and stores missed", pc, fetches.misses, fetches.accesses,
+           data.misses, data.accesses);
+    print_source_location(map, pc);
+    printf("\n");
+  }
+}
+
+void print_regions(const cache_sim *c) {
+  printf("Regions:\n");
+  for (WORD r = 0; r < CACHE_REGION_N; r++) {
+    cache_stats fetches = region_stats(c->icache, r);
+    cache_stats data = region_stats(c->dcache, r);
+    if (!fetches.accesses && !data.accesses) {
+      continue;
+    }
+    printf("0x%08x-0x%08x: %" PRIu64 "/%" PRIu64 " fetches missed (%.2f%%), %" PRIu64 "/%"
+           PRIu64 " loads and stores missed (%.2f%%)\n", r * CACHE_REGION_SIZE,
+           (r + 1) * CACHE_REGION_SIZE - 1, fetches.misses, fetches.accesses,
+           miss_rate(&fetches), data.misses, data.accesses, miss_rate(&data));
+  }
+}
+
+void cache_sim_report(const cache_sim *c, const source_map *map) {
+  if (c->icache) {
+    print_level("L1 instruction cache", c->icache);
+  }
+  if (c->dcache) {
+    print_level("L1 data cache", c->dcache);
+  }
+  printf("Uncached device accesses: %" PRIu64 "\n", c->uncached);
+  print_hot_pcs(c, map);
+  print_regions(c);
+}
+
+void level_free(cache_level *l) {
+  if (l) {
+    free(l->lines);
+    free(l->pcs);
+    free(l);
+  }
+}
+
+void cache_sim_free(cache_sim *c) {
+  level_free(c->icache);
+  level_free(c->dcache);
+  free(c);
+}
@@ -0,0 +1,94 @@
+#ifndef CACHE_SIM
+#define CACHE_SIM
+#include <stdint.h>
+#include "utils.h"
+#include "source_map.h"
+
+// Models of L1 instruction and data caches fed by a run
+//
+// With arm_state->caches set, every instruction fetched in cycle() goes
+// through the instruction cache and every load and store of a single data
+// transfer through the data cache; accesses outside memory go to devices
+// and are counted as uncached. Each cache has a size, a number of ways, a
+// line size (all powers of two) and a replacement policy, and is write
+// back and write allocate: a store that misses fills the line, and a
+// dirty line evicted counts as a write back. An access that straddles two
+// lines looks up both
+// Besides the totals of each cache, hits and misses are kept for every
+// PC (the fetches of the instruction there, and the loads and stores it
+// makes) and for every CACHE_REGION_SIZE bytes of memory accessed
+// Fast-forwarding busy-wait loops would skip their fetches, so it is off
+// while the caches are modelled. With caches NULL, nothing is looked up
+//
+// A cache is described as "size:ways:line[:policy]", the size in bytes
+// or with a k suffix, the policy lru (the default), fifo or random; an
+// ARM1176's L1 caches are "16k:4:32:random"
+
+#define CACHE_REGION_BITS 12
+#define CACHE_REGION_SIZE (1u << CACHE_REGION_BITS)
+#define CACHE_REGION_N (MEMORY_SIZE / CACHE_REGION_SIZE)
+#define CACHE_HOT_PC_N 10
+
+typedef enum {
+  CACHE_LRU,
+  CACHE_FIFO,
+  CACHE_RANDOM
+} cache_policy;
+
+typedef struct cache_config {
+  WORD size;
+  WORD ways;
+  WORD line_size;
+  cache_policy policy;
+} cache_config;
+
+typedef struct cache_line {
+  WORD tag;
+  bool valid;
+  bool dirty;
+  uint64_t stamp;          // last use for LRU, fill for FIFO
+} cache_line;
+
+typedef struct cache_stats {
+  uint64_t accesses;
+  uint64_t misses;
+} cache_stats;
+
+typedef struct cache_level {
+  cache_config config;
+  WORD line_bits;
+  WORD set_n;
+  cache_line *lines;       // set_n sets of config.ways lines
+  uint64_t clock;
+  uint64_t random;         // xorshift state for CACHE_RANDOM
+  cache_stats total;
+  uint64_t write_backs;
+  cache_stats regions[CACHE_REGION_N];
+  cache_stats *pcs;        // by PC / 4
+} cache_level;
+
+typedef struct cache_sim {
+  cache_level *icache;     // either may be NULL, and is then not modelled
+  cache_level *dcache;
+  uint64_t uncached;       // loads and stores that went to devices
+} cache_sim;
+
+// Parses a description into config; returns false if it is malformed
+bool cache_config_parse(const char *text, cache_config *config);
+
+// The caches described by icache and dcache, either of which may be NULL
+cache_sim *cache_sim_create(const cache_config *icache, const cache_config *dcache);
+
+// The fetch of the instruction at pc
+void cache_fetch(cache_sim *c, WORD pc);
+
+// A load or store of the word at address by the instruction at pc
+void cache_data(cache_sim *c, WORD pc, WORD address, bool store);
+
+// Prints the totals of each cache, the CACHE_HOT_PC_N PCs with the most
+// misses (with their source lines if map is set) and the regions accessed
+void cache_sim_report(const cache_sim *c, const source_map *map);
+
+void cache_sim_free(cache_sim *c);
+
+#endif
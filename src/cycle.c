@@ -1,8 +1,22 @@
 #include "utils.h"
 #include "cycle.h"
 #include "instructions.h"
+#include "execute.h"
+#include "fast_forward.h"
+#include "scheduler.h"
+#include "semihost.h"
+#include "smp.h"
+#include "trace.h"
+#include "fuzz.h"
+#include "cache_sim.h"
+
+#define IRQ_VECTOR 0x18
+#define IRQ_DISABLE_BIT 7
 
 void fetch(State *arm_state, BYTE *buffer) {
+  if (arm_state->caches) {
+    cache_fetch(arm_state->caches, arm_state->reg[PC_INDEX]);
+  }
   for(int i = 0; i < sizeof(WORD); i++) {
     buffer[i] = arm_state->memory[arm_state->reg[PC_INDEX] + i];
   }
@@ -22,49 +36,61 @@ WORD decode(const BYTE *bytes) {
   return decoded;
 }
 
-instr_type clarify_instruction(WORD decoded){
-  // decoded[31..0] = 0
-  if(!decoded){
-    return HALT;
+// swaps r13 and r14 with the banked ones, entering or leaving IRQ mode
+void swap_banked(State *arm_state) {
+  for (int i = 0; i < 2; i++) {
+    WORD r = arm_state->reg[13 + i];
+    arm_state->reg[13 + i] = arm_state->banked[i];
+    arm_state->banked[i] = r;
   }
+}
 
-  // clarify instruction based on bit 27, 26
-  WORD bits = get_bits(decoded, 26, 27);
-  switch(bits) {
-    // decoded[27..26] = 00
-    case 0: {
-      WORD bit25 = get_bits(decoded, 25, 25);
-      WORD bit7 = get_bits(decoded, 7, 7);
-      WORD bit4 = get_bits(decoded, 4, 4);
-      if(!bit25 && bit7 && bit4) {
-        return MULTIPLY;
-      } else {
-        return DATA_PROCESSING;
-      }
-    }
-    // decoded[27..26] = 01
-    case 1: {
-      return SINGLE_DATA_TRANSFER;
-    }
-    // decoded[27..26] = 10
-    case 2: {
-      return BRANCH;
-    }
-    // decoded[27..26] = 11
-    default: {
-      return HALT;
+// Fires the due events, then takes an asserted interrupt unless the CPSR
+// masks it; called at a taken branch, with the PC at its target
+void service_events(State *arm_state) {
+  scheduler_run(arm_state->scheduler, arm_state->instructions);
+  WORD *cpsr = &arm_state->reg[16];
+  if (arm_state->scheduler->irq && !get_bit(*cpsr, IRQ_DISABLE_BIT)) {
+    arm_state->spsr = *cpsr;
+    set_bit(cpsr, IRQ_DISABLE_BIT);
+    swap_banked(arm_state);
+    // subs r15,r14,#4 resumes at the branch target
+    arm_state->reg[14] = arm_state->reg[PC_INDEX] + 4;
+    arm_state->reg[PC_INDEX] = IRQ_VECTOR;
+    if (arm_state->trace) {
+      trace_irq(arm_state);
     }
   }
 }
 
+// true once a run with stop_at set executed that many instructions
+bool stop_reached(const State *arm_state) {
+  return arm_state->stop_at && arm_state->instructions >= arm_state->stop_at;
+}
+
+// subs/movs to the PC, which ends an interrupt handler
+bool is_exception_return(data_processing *params) {
+  bool writes_rd = params->opcode < 0x8 || params->opcode > 0xB;
+  return params->s && writes_rd && params->rd == PC_INDEX;
+}
+
 exec_cond execute(State *arm_state, WORD decoded) {
   instr_type instruction = clarify_instruction(decoded);
+  arm_state->instructions++;
 
   // execute instruction based on its type
   switch(instruction) {
     case DATA_PROCESSING: {
       data_processing params = decode_data_processing(decoded);
-      execute_data_processing(arm_state, &params);
+      bool executed = execute_data_processing(arm_state, &params);
+      // with interrupts, the CPSR and the interrupted code's r13 and r14
+      // come back and the pipeline is refilled
+      if (executed && arm_state->scheduler && is_exception_return(&params)) {
+        arm_state->reg[16] = arm_state->spsr;
+        swap_banked(arm_state);
+        recheck_irq(arm_state->scheduler);
+        return SKIP;
+      }
       return CONTINUE;
     }
     case MULTIPLY: {
@@ -72,14 +98,54 @@ exec_cond execute(State *arm_state, WORD decoded) {
       execute_multiply(arm_state, &params);
       return CONTINUE;
     }
+    case SWAP: {
+      swap params = decode_swap(decoded);
+      // with several cores, shared operations may be ordered (see smp.h)
+      if (arm_state->smp && !smp_enter(arm_state, false)) {
+        return STOP;
+      }
+      execute_swap(arm_state, &params);
+      if (arm_state->smp) {
+        smp_leave(arm_state, false);
+      }
+      return CONTINUE;
+    }
     case SINGLE_DATA_TRANSFER: {
       single_data_transfer params = decode_single_data_transfer(decoded);
+      if (arm_state->smp && !smp_enter(arm_state, false)) {
+        return STOP;
+      }
       execute_single_data_transfer(arm_state, &params);
+      if (arm_state->smp) {
+        smp_leave(arm_state, false);
+      }
       return CONTINUE;
     }
     case BRANCH: {
-      branch params = decode_branch(decoded);
-      return execute_branch(arm_state, &params) ? SKIP : CONTINUE;
+      // a completed busy-wait loop falls through its branch; its fetches
+      // are only skipped when no caches are modelled
+      bool taken = false;
+      if (arm_state->reference || arm_state->caches
+          || !fast_forward_loop(arm_state, decoded)) {
+        branch params = decode_branch(decoded);
+        taken = execute_branch(arm_state, &params);
+      }
+      // the next block starts at the target, or after the branch
+      if (arm_state->coverage) {
+        coverage_edge(arm_state->coverage, arm_state->reg[PC_INDEX] - (taken ? 0 : 4));
+      }
+      return taken ? SKIP : CONTINUE;
+    }
+    case SOFTWARE_INTERRUPT: {
+      software_interrupt params = decode_software_interrupt(decoded);
+      if (arm_state->smp && !smp_enter(arm_state, true)) {
+        return STOP;
+      }
+      bool go_on = execute_software_interrupt(arm_state, &params);
+      if (arm_state->smp) {
+        smp_leave(arm_state, true);
+      }
+      return go_on ? CONTINUE : STOP;
     }
     default: {
       return STOP;
@@ -87,10 +153,21 @@ exec_cond execute(State *arm_state, WORD decoded) {
   }
 }
 
-void cycle(State *arm_state) {
+bool cycle(State *arm_state) {
   BYTE *fetched = malloc(sizeof(WORD));
   WORD decoded;
 
+  // a run resumed from a checkpoint (see trace.h) may start at a taken
+  // branch with events due
+  if (stop_reached(arm_state)) {
+    free(fetched);
+    return false;
+  }
+  if (arm_state->scheduler
+      && arm_state->instructions >= arm_state->scheduler->next_check) {
+    service_events(arm_state);
+  }
+
   // first cycle
   fetch(arm_state, fetched);
   increment_pc(arm_state);
@@ -101,6 +178,18 @@ void cycle(State *arm_state) {
     if (cond == CONTINUE) {
       //execute as usual
       cond = execute(arm_state, decoded);
+      // events are only looked at between blocks
+      if (cond != STOP && stop_reached(arm_state)) {
+        // pause with the PC at the next instruction, where cycle() resumes
+        if (cond == CONTINUE) {
+          arm_state->reg[PC_INDEX] -= sizeof(WORD);
+        }
+        free(fetched);
+        return false;
+      } else if (cond == SKIP && arm_state->scheduler
+          && arm_state->instructions >= arm_state->scheduler->next_check) {
+        service_events(arm_state);
+      }
     } else if (cond == SKIP) {
       // skip current execution (refresh pipeline)
       cond = CONTINUE;
@@ -112,4 +201,5 @@ void cycle(State *arm_state) {
     }
   }
   free(fetched);
+  return true;
 }
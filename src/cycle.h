@@ -8,6 +8,15 @@ typedef enum execution_condition {
   CONTINUE
 } exec_cond;
 
-void cycle(State *arm_state);
+// Runs the program in arm_state from its PC until it stops (returning
+// true), or until arm_state->stop_at instructions were executed: the run
+// is then paused with the PC at the next instruction to execute (returning
+// false), and another cycle() resumes it. Resuming after a taken branch
+// is exact; elsewhere, events due on resumption fire early (see
+// service_events)
+bool cycle(State *arm_state);
+
+// Executes one decoded instruction; SKIP means the pipeline was flushed
+exec_cond execute(State *arm_state, WORD decoded);
 
 #endif
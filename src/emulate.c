@@ -1,26 +1,444 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
 #include "utils.h"
 #include "cycle.h"
+#include "source_map.h"
+#include "bus.h"
+#include "gpio.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "semihost.h"
+#include "input.h"
+#include "smp.h"
+#include "mailbox.h"
+#include "trace.h"
+#include "snapshot.h"
+#include "fuzz.h"
+#include "lockstep.h"
+#include "cache_sim.h"
 
-int main(int argc, char** argv) {
-  fail_if(argc < 2,
-    "You must pass a file name as the first argument");
+// what a single-core run records, replays, saves or starts from
+typedef struct {
+  FILE *trace_file;        // recorded with a checkpoint every interval
+  bool replaying;          // instructions, or replayed up to seek
+  uint64_t interval;
+  uint64_t seek;
+  char *save_name;         // the snapshot file, saved at save_at (if not 0)
+  uint64_t save_at;        // and on SYS_SNAPSHOT
+  char *restore_name;      // the snapshot the run starts from
+  cache_sim *caches;       // reported after the final state, if set
+} core_options;
 
-  FILE *input_file = open_file(argv[1], "rb");
-  int size = get_file_size(input_file);
+// runs the program on a single core, with the timer
+void run_core(BYTE *memory, source_map *map, bus *devices, semihost *host,
+              bool quiet, bool count, const core_options *options) {
+  scheduler *events = scheduler_create();
+  arm_timer *clock = arm_timer_create(events);
+  arm_timer_attach(clock, devices);
+  WORD *reg = allocate_register();
 
-  BYTE *memory = allocate_memory();
-  load_memory(input_file, size, memory);
+  State arm_state = {memory, reg, map, devices, events, host};
+  arm_state.caches = options->caches;
+  if (options->restore_name) {
+    snapshot_map(options->restore_name, &arm_state);
+  }
+  snapshot_request request = {options->save_name, &arm_state};
+  host->snapshot = options->save_name;
+  if (options->save_name && options->save_at) {
+    schedule_event(events, options->save_at, &snapshot_due, &request);
+  }
+  trace *run_trace = NULL;
+  if (options->trace_file) {
+    run_trace = options->replaying
+      ? trace_replay_run(options->trace_file, options->seek, &arm_state)
+      : trace_record_run(options->trace_file, options->interval, &arm_state);
+  }
+  cycle(&arm_state);
+  if (run_trace) {
+    trace_close(run_trace);
+  }
+  semihost_flush(host);
+  if (!quiet) {
+    print_state(&arm_state);
+  }
+  if (count) {
+    printf("Instructions: %" PRIu64 "\n", arm_state.instructions);
+  }
+  if (options->caches) {
+    cache_sim_report(options->caches, map);
+  }
+
+  if (options->restore_name) {
+    snapshot_unmap(arm_state.memory);
+  }
+  arm_timer_free(clock);
+  scheduler_free(events);
+  free(reg);
+}
 
-  fclose(input_file);
+// runs the program on core_n cores, recording or replaying the order of
+// their shared operations in the file order_name
+void run_cores(WORD core_n, smp_mode mode, char *order_name, BYTE *memory,
+               source_map *map, bus *devices, semihost *host, bool quiet, bool count) {
+  mailbox *boxes = mailbox_create();
+  mailbox_attach(boxes, devices);
+  bus_share(devices);
+  FILE *order = order_name ? open_file(order_name, mode == SMP_RECORD ? "wb" : "rb") : NULL;
+  smp *m = smp_create(core_n, mode, order);
 
+  State cores[MAX_CORE_N];
+  for (WORD i = 0; i < core_n; i++) {
+    cores[i] = (State) {memory, allocate_register(), map, devices, NULL, host};
+  }
+  smp_run(m, cores);
+  semihost_flush(host);
+  if (!quiet) {
+    smp_print_state(m, cores);
+  }
+  uint64_t instructions = 0;
+  for (WORD i = 0; i < core_n; i++) {
+    instructions += cores[i].instructions;
+    free(cores[i].reg);
+  }
+  if (count) {
+    printf("Instructions: %" PRIu64 "\n", instructions);
+  }
+
+  smp_free(m);
+  if (order) {
+    fclose(order);
+  }
+  mailbox_free(boxes);
+}
+
+// runs the program once for each of the input_n files in inputs, from
+// the memory the binary left, with the input at input_address; prints
+// how each run ended and the edges it covered first. Returns the number
+// of runs that crashed
+int run_fuzz(BYTE *memory, source_map *map, bus *devices, semihost *host,
+             WORD input_address, uint64_t budget, char **inputs, int input_n) {
+  static const char *results[] = {"ok", "crash", "hang"};
+  fuzz_target *target = fuzz_create(memory, input_address, budget);
+  coverage *edges = coverage_create();
+  BYTE *seen = calloc(COVERAGE_MAP_SIZE, 1);
+  fail_if(!seen, "Failed to allocate memory");
   WORD *reg = allocate_register();
+  State arm_state = {memory, reg, map, devices, NULL, host};
+  arm_state.coverage = edges;
 
-  State arm_state = {memory, reg};
-  cycle(&arm_state);
-  print_state(&arm_state);
+  int crashes = 0;
+  WORD covered = 0;
+  for (int i = 0; i < input_n; i++) {
+    size_t length;
+    const char *input = map_file(inputs[i], &length);
+    fuzz_result result = fuzz_run(target, &arm_state, (const BYTE *) (input ? input : ""),
+                                  (WORD) length);
+    unmap_file(input, length);
+    semihost_flush(host);
+    WORD fresh = coverage_merge(edges, seen);
+    covered += fresh;
+    crashes += result == FUZZ_CRASH;
+    printf("%s: %s, %u new edges\n", inputs[i], results[result], fresh);
+  }
+  printf("Edges: %u\n", covered);
 
-  free(memory);
   free(reg);
+  free(seen);
+  coverage_free(edges);
+  fuzz_free(target);
+  return crashes;
+}
+
+// runs the program with its fast paths checked against the reference
+// every interval instructions, for at most limit (0 for no limit); the
+// reference gets a copy of the memory and devices of its own. Semihosting
+// input reads as ended for both, and only the fast run's output is shown
+// Returns whether they agreed
+bool run_lockstep(BYTE *memory, source_map *map, bus *devices, input_window *input,
+                  bool quiet, bool count, uint64_t interval, uint64_t limit) {
+  FILE *null = open_file("/dev/null", "r+");
+  semihost *host = semihost_create(null, stdout);
+  semihost *reference_host = semihost_create(null, null);
+  bus *reference_devices = bus_create();
+  gpio *reference_pins = gpio_create(NULL);
+  gpio_attach(reference_pins, reference_devices);
+  if (input) {
+    input_attach(input, reference_devices);
+  }
+  BYTE *reference_memory = allocate_memory();
+  memcpy(reference_memory, memory, MEMORY_SIZE);
+  State fast = {memory, allocate_register(), map, devices, NULL, host};
+  State reference = {reference_memory, allocate_register(), map, reference_devices, NULL,
+                     reference_host};
+
+  bool agree = lockstep_run(&reference, &fast, interval, limit);
+  semihost_flush(host);
+  if (!quiet) {
+    print_state(&fast);
+  }
+  if (count) {
+    printf("Instructions: %" PRIu64 "\n", fast.instructions);
+  }
+
+  free(fast.reg);
+  free(reference.reg);
+  free(reference_memory);
+  gpio_free(reference_pins);
+  bus_free(reference_devices);
+  semihost_free(reference_host);
+  semihost_free(host);
+  fclose(null);
+  return agree;
+}
+
+// usage: emulate [-c] [-q] [-m map] [-g gpio_log] [--input file
+//                [--input-base address]] [--cores n]
+//                [--record log | --replay log] [--trace file
+//                [--interval n] | --replay-trace file [--seek n]]
+//                [--save file [--save-at n]] [--restore file]
+//                [--fuzz address | --lockstep n] [--budget n]
+//                [--icache cache] [--dcache cache] binary [input...]
+// -m loads the source map written by assemble -m, so that errors name
+// the source line of the failing instruction
+// -c prints the number of instructions executed after the final state
+// -g writes the GPIO pin changes to gpio_log (see gpio.h)
+// -q leaves out the final state, for programs that print their results
+// through semihosting (see semihost.h); the exit status is the one the
+// program exited with
+// --input (-i) maps file read-only at address (by default 0x40000000), or
+// at --input-base (-b); see input.h
+// --cores (-n) runs the program on n cores, with the mailboxes of
+// mailbox.h and without the timer; the state of each core is printed
+// --record (-r) logs the order of the cores' shared operations, which
+// --replay (-p) then repeats; see smp.h
+// --trace (-t) records a single-core run into file, with a checkpoint
+// every --interval (-k) instructions (by default 1000000), and
+// --replay-trace (-R) replays it, without the binary, up to --seek (-s)
+// instructions; see trace.h
+// --save (-S) writes a snapshot of a single-core run to file at the first
+// taken branch after --save-at (-A) instructions, and whenever the
+// program asks for one through SYS_SNAPSHOT; --restore (-W) starts the
+// run from such a snapshot, without the binary; see snapshot.h
+// --fuzz (-F) runs the program on each input file in turn, from the
+// state the binary left and with the input at address, recording edge
+// coverage (in AFL's bitmap if __AFL_SHM_ID is set); runs longer than
+// --budget (-B) instructions (by default 10000000) are hangs, and the
+// exit status is 1 if a run crashed; see fuzz.h
+// --lockstep (-L) runs the program twice side by side, with and without
+// the fast paths, compares them every n instructions (0 for the default
+// 100000) for at most --budget instructions (by default until they
+// stop), and reports the first instruction on which they differ; the exit
+// status is 1 if they did. See lockstep.h
+// --icache (-I) and --dcache (-D) model the L1 instruction and data caches
+// of a single-core run, described as size:ways:line[:policy], and report
+// their hits and misses after the final state, with the PCs that miss
+// most (on their source lines with -m) and each region; see cache_sim.h
+int main(int argc, char** argv) {
+  char *map_file_name = NULL;
+  char *gpio_log_name = NULL;
+  bool count = false;
+  bool quiet = false;
+  char *input_name = NULL;
+  WORD input_base = INPUT_DEFAULT_BASE;
+  WORD core_n = 1;
+  smp_mode mode = SMP_FREE;
+  char *order_name = NULL;
+  char *trace_name = NULL;
+  core_options options = {NULL, false, TRACE_DEFAULT_INTERVAL};
+  bool fuzzing = false;
+  WORD fuzz_address = 0;
+  uint64_t budget = 0;
+  bool lockstepping = false;
+  uint64_t lockstep_interval = 0;
+  cache_config icache;
+  cache_config dcache;
+  bool icache_set = false;
+  bool dcache_set = false;
+  const struct option long_options[] = {
+    {"input", required_argument, NULL, 'i'},
+    {"input-base", required_argument, NULL, 'b'},
+    {"cores", required_argument, NULL, 'n'},
+    {"record", required_argument, NULL, 'r'},
+    {"replay", required_argument, NULL, 'p'},
+    {"trace", required_argument, NULL, 't'},
+    {"interval", required_argument, NULL, 'k'},
+    {"replay-trace", required_argument, NULL, 'R'},
+    {"seek", required_argument, NULL, 's'},
+    {"save", required_argument, NULL, 'S'},
+    {"save-at", required_argument, NULL, 'A'},
+    {"restore", required_argument, NULL, 'W'},
+    {"fuzz", required_argument, NULL, 'F'},
+    {"budget", required_argument, NULL, 'B'},
+    {"lockstep", required_argument, NULL, 'L'},
+    {"icache", required_argument, NULL, 'I'},
+    {"dcache", required_argument, NULL, 'D'},
+    {NULL, 0, NULL, 0}
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "cqm:g:i:b:n:r:p:t:k:R:s:S:A:W:F:B:L:I:D:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'c':
+        count = true;
+        break;
+      case 'q':
+        quiet = true;
+        break;
+      case 'm':
+        map_file_name = optarg;
+        break;
+      case 'g':
+        gpio_log_name = optarg;
+        break;
+      case 'i':
+        input_name = optarg;
+        break;
+      case 'b':
+        input_base = strtoul(optarg, NULL, 0);
+        break;
+      case 'n':
+        core_n = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+      case 'p':
+        mode = opt == 'r' ? SMP_RECORD : SMP_REPLAY;
+        order_name = optarg;
+        break;
+      case 't':
+      case 'R':
+        options.replaying = opt == 'R';
+        trace_name = optarg;
+        break;
+      case 'k':
+        options.interval = strtoull(optarg, NULL, 10);
+        break;
+      case 's':
+        options.seek = strtoull(optarg, NULL, 10);
+        break;
+      case 'S':
+        options.save_name = optarg;
+        break;
+      case 'A':
+        options.save_at = strtoull(optarg, NULL, 10);
+        break;
+      case 'W':
+        options.restore_name = optarg;
+        break;
+      case 'F':
+        fuzzing = true;
+        fuzz_address = strtoul(optarg, NULL, 0);
+        break;
+      case 'B':
+        budget = strtoull(optarg, NULL, 10);
+        break;
+      case 'L':
+        lockstepping = true;
+        lockstep_interval = strtoull(optarg, NULL, 10);
+        break;
+      case 'I':
+        icache_set = true;
+        fail_if(!cache_config_parse(optarg, &icache), "Caches are size:ways:line[:policy]");
+        break;
+      case 'D':
+        dcache_set = true;
+        fail_if(!cache_config_parse(optarg, &dcache), "Caches are size:ways:line[:policy]");
+        break;
+      default:
+        fail_if(true, "Usage: emulate [-c] [-q] [-m map] [-g gpio_log] [--input file [--input-base address]]"
+                      " [--cores n] [--record log | --replay log]"
+                      " [--trace file [--interval n] | --replay-trace file [--seek n]]"
+                      " [--save file [--save-at n]] [--restore file]"
+                      " [--fuzz address | --lockstep n] [--budget n]"
+                      " [--icache cache] [--dcache cache] binary [input...]");
+    }
+  }
+  // a replayed trace or a snapshot holds the memory
+  bool from_file = options.replaying || options.restore_name;
+  fail_if(optind >= argc && !from_file,
+    "You must pass a file name as the first argument");
+  fail_if(optind < argc && from_file,
+    "A replayed trace or a snapshot replaces the binary");
+  fail_if((trace_name || options.save_name || options.restore_name)
+          && (core_n > 1 || order_name),
+    "Traces and snapshots are of single-core runs");
+  fail_if((fuzzing || lockstepping)
+          && (from_file || trace_name || options.save_name || core_n > 1 || order_name),
+    "Fuzzing and lockstep checks run a binary on a single core");
+  fail_if(fuzzing && lockstepping, "Fuzzing and lockstep checks are separate runs");
+  fail_if((icache_set || dcache_set) && (fuzzing || lockstepping || core_n > 1 || order_name),
+    "Caches are modelled on plain single-core runs");
+  if (icache_set || dcache_set) {
+    options.caches = cache_sim_create(icache_set ? &icache : NULL, dcache_set ? &dcache : NULL);
+  }
+
+  // a snapshot brings its own memory
+  BYTE *memory = options.restore_name ? NULL : allocate_memory();
+  if (optind < argc) {
+    FILE *input_file = open_file(argv[optind], "rb");
+    int size = get_file_size(input_file);
+    load_memory(input_file, size, memory);
+    fclose(input_file);
+  }
+  if (trace_name) {
+    options.trace_file = open_file(trace_name, options.replaying ? "rb" : "wb");
+  }
+
+  source_map *map = NULL;
+  if (map_file_name) {
+    FILE *map_file = open_file(map_file_name, "rb");
+    map = source_map_read(map_file);
+    fclose(map_file);
+  }
+
+  FILE *gpio_log = gpio_log_name ? open_file(gpio_log_name, "w") : NULL;
+  bus *devices = bus_create();
+  gpio *pins = gpio_create(gpio_log);
+  gpio_attach(pins, devices);
+  input_window *input = NULL;
+  if (input_name) {
+    input = input_open(input_name, input_base);
+    input_attach(input, devices);
+  }
+  semihost *host = semihost_create(stdin, stdout);
+
+  int crashes = 0;
+  bool agree = true;
+  if (fuzzing) {
+    crashes = run_fuzz(memory, map, devices, host, fuzz_address,
+                       budget ? budget : FUZZ_DEFAULT_BUDGET,
+                       argv + optind + 1, argc - optind - 1);
+  } else if (lockstepping) {
+    agree = run_lockstep(memory, map, devices, input, quiet, count,
+                         lockstep_interval ? lockstep_interval : LOCKSTEP_DEFAULT_INTERVAL,
+                         budget);
+  } else if (core_n > 1 || order_name) {
+    run_cores(core_n, mode, order_name, memory, map, devices, host, quiet, count);
+  } else {
+    run_core(memory, map, devices, host, quiet, count, &options);
+  }
+  if (options.trace_file) {
+    fclose(options.trace_file);
+  }
+  if (options.caches) {
+    cache_sim_free(options.caches);
+  }
+
+  int exit_code = fuzzing ? crashes > 0 : lockstepping ? !agree : host->exit_code;
+  semihost_free(host);
+  if (input) {
+    input_free(input);
+  }
+  gpio_free(pins);
+  bus_free(devices);
+  if (gpio_log) {
+    fclose(gpio_log);
+  }
+  if (map) {
+    source_map_free(map);
+  }
+  free(memory);
+  return exit_code;
 }
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "utils.h"
 #include "symbol_table.h"
 #include "instructions.h"
@@ -18,10 +19,14 @@ ftable *map_opcode_to_function(void){
   ftable_insert(opfunc, "tst", &assemble_tst);
   ftable_insert(opfunc, "teq", &assemble_teq);
   ftable_insert(opfunc, "cmp", &assemble_cmp);
+  ftable_insert(opfunc, "subs", &assemble_subs);
+  ftable_insert(opfunc, "movs", &assemble_movs);
   ftable_insert(opfunc, "mul", &assemble_mul);
   ftable_insert(opfunc, "mla", &assemble_mla);
   ftable_insert(opfunc, "ldr", &assemble_ldr);
   ftable_insert(opfunc, "str", &assemble_str);
+  ftable_insert(opfunc, "swp", &assemble_swp);
+  ftable_insert(opfunc, "swpb", &assemble_swpb);
   ftable_insert(opfunc, "beq", &assemble_beq);
   ftable_insert(opfunc, "bne", &assemble_bne);
   ftable_insert(opfunc, "bge", &assemble_bge);
@@ -31,6 +36,7 @@ ftable *map_opcode_to_function(void){
   ftable_insert(opfunc, "b",   &assemble_bal);
   ftable_insert(opfunc, "lsl", &assemble_lsl);
   ftable_insert(opfunc, "andeq", &assemble_andeq);
+  ftable_insert(opfunc, "swi", &assemble_swi);
   return opfunc;
 }
 
@@ -42,14 +48,23 @@ void byte_output(WORD instr, BYTE *output, WORD address){
   }
 }
 
-void assemble(char *line, table *sym_table, BYTE **output, WORD *out_size, WORD address){
-  char **tokens = calloc(1 + MAX_OPERAND_N, sizeof(char *));
+// the mnemonic table is built once and only read afterwards, so every
+// assembler thread shares it
+static ftable *opfunc;
+static pthread_once_t opfunc_once = PTHREAD_ONCE_INIT;
+
+void build_opfunc(void){
+  opfunc = map_opcode_to_function();
+}
+
+void assemble(char *line, table *sym_table, BYTE **output, WORD *pool_address, WORD address){
+  char *tokens[1 + MAX_OPERAND_N];
   int token_n = tokenize(line, tokens);
   if (token_n < 2) {
     return;
   }
   char *opcode = tokens[0];
-  ftable *opfunc = map_opcode_to_function();
+  pthread_once(&opfunc_once, &build_opfunc);
   word_func func;
 
   fail_if(!ftable_get(opfunc, opcode, &func), "Wrong instruction mnemonic");
@@ -57,7 +72,7 @@ void assemble(char *line, table *sym_table, BYTE **output, WORD *out_size, WORD
   WORD (*assemble_func) (char **, int, table *, BYTE **, WORD *, WORD)
     = (WORD (*)(char **, int, table *, BYTE **, WORD *, WORD))func;
 
-  WORD encoded_instr = assemble_func(tokens, token_n, sym_table, output, out_size, address);
+  WORD encoded_instr = assemble_func(tokens, token_n, sym_table, output, pool_address, address);
   byte_output(encoded_instr, *output, address);
 }
 
@@ -77,6 +92,87 @@ WORD parse_register(char *token){
   return strtoul(token + sizeof(char), NULL, 10);
 }
 
+bool is_encodable(WORD instr_opcode, WORD value);
+
+WORD literal_pool_size(char *line){
+  // only numeric constants of the form =expression, and mov of constants
+  // that have no immediate encoding, need the pool
+  if (!strchr(line, '=') && !strchr(line, '#')) {
+    return 0;
+  }
+  char copy[strlen(line) + 1];
+  strcpy(copy, line);
+  char *tokens[1 + MAX_OPERAND_N];
+  int token_n = tokenize(copy, tokens);
+  if (token_n < 3) {
+    return 0;
+  }
+  if (!strcmp(tokens[0], "mov") && tokens[2][0] == '#') {
+    return is_encodable(13, parse_value(tokens[2])) ? 0 : 4;
+  }
+  if (tokens[2][0] != '=' || (strcmp(tokens[0], "ldr") && strcmp(tokens[0], "str"))) {
+    return 0;
+  }
+  return parse_value(tokens[2]) > 0xFF ? 4 : 0;
+}
+
+bool is_branch_mnemonic(const char *opcode) {
+  const char *branches[] = {"b", "beq", "bne", "bge", "blt", "bgt", "ble"};
+  for (int i = 0; i < sizeof(branches) / sizeof(branches[0]); i++) {
+    if (!strcmp(opcode, branches[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool encode_immediate(WORD value, WORD *operand2){
+  for (WORD rot = 0; rot < 16; rot++) {
+    // the emulator rotates the 8-bit value right by 2 * rot
+    WORD shift = 2 * rot;
+    WORD rotated = shift ? (value << shift) | (value >> (32 - shift)) : value;
+    if (rotated <= 0xFF) {
+      *operand2 = rot << 8 | rotated;
+      return true;
+    }
+  }
+  return false;
+}
+
+// opcode that gives the same result on the negated (add/sub, cmp/cmn)
+// or inverted (and/bic, mov/mvn) immediate, or -1 if there is none
+int complement_opcode(WORD instr_opcode, WORD value, WORD *complement){
+  switch (instr_opcode) {
+    case 0x4: *complement = -value; return 0x2;
+    case 0x2: *complement = -value; return 0x4;
+    case 0xA: *complement = -value; return 0xB;
+    case 0x0: *complement = ~value; return 0xE;
+    case 0xD: *complement = ~value; return 0xF;
+    default:  return -1;
+  }
+}
+
+// the immediate encoder shared by every data processing mnemonic
+// falls back to the complementary opcode when only the complemented value
+// can be encoded; returns false if neither can
+bool set_immediate(data_processing *instr, WORD value){
+  WORD complement;
+  int opcode = complement_opcode(instr->opcode, value, &complement);
+  if (encode_immediate(value, &instr->operand2)) {
+    return true;
+  }
+  if (opcode >= 0 && encode_immediate(complement, &instr->operand2)) {
+    instr->opcode = opcode;
+    return true;
+  }
+  return false;
+}
+
+bool is_encodable(WORD instr_opcode, WORD value){
+  data_processing instr = {.opcode = instr_opcode};
+  return set_immediate(&instr, value);
+}
+
 // encode (assemble) assemble_data_processing that compute result
 // and eor sub rsb add orr
 WORD assemble_data_processing_with_result(char **tokens, WORD instr_opcode){
@@ -87,7 +183,12 @@ WORD assemble_data_processing_with_result(char **tokens, WORD instr_opcode){
   instr.s        = 0;
   instr.rn       = parse_register(tokens[2]);
   instr.rd       = parse_register(tokens[1]);
-  instr.operand2 = instr.i ? parse_value(tokens[3]) : parse_register(tokens[3]);
+  if (instr.i) {
+    fail_if(!set_immediate(&instr, parse_value(tokens[3])),
+            "Immediate value can not be encoded");
+  } else {
+    instr.operand2 = parse_register(tokens[3]);
+  }
   return encode_data_processing(instr);
 }
 
@@ -113,13 +214,8 @@ WORD assemble_data_processing(char **tokens, WORD instr_opcode, WORD set){
   instr.rn       =  set ? parse_register(tokens[1]) : 0;
   instr.rd       = !set ? parse_register(tokens[1]) : 0;
   if (instr.i) {
-    WORD value = parse_value(tokens[2]);
-    WORD rot;
-    for(rot = 0; rot < 16 && value > 0xFF; rot++) {
-      value = rotate_left(value, 2);
-    }
-    set_bits_to(&value, 8, 11, rot);
-    instr.operand2 = value;
+    fail_if(!set_immediate(&instr, parse_value(tokens[2])),
+            "Immediate value can not be encoded");
   } else {
     instr.operand2 = parse_register(tokens[2]);
   }
@@ -133,7 +229,6 @@ WORD assemble_data_processing(char **tokens, WORD instr_opcode, WORD set){
 DP_FUNC(tst, 8, 1)
 DP_FUNC(teq, 9, 1)
 DP_FUNC(cmp, 10, 1)
-DP_FUNC(mov, 13, 0)
 
 // encode (assemble) multiply instructions (mul, mla)
 WORD assemble_multiply(char **tokens, int token_n, WORD accum){
@@ -157,9 +252,10 @@ MULTIPLY_FUNC(mla, 1)
 
 // encode (assemble) single data transfer instructions
 // 4 cases of input (excluding the optional ones)
-WORD assemble_single_data_transfer(char **tokens, int token_n, BYTE **output, WORD *out_size,
+WORD assemble_single_data_transfer(char **tokens, int token_n, BYTE **output, WORD *pool_address,
         WORD current_address, int load_store){
   single_data_transfer instr;
+  char *save;
   instr.cond   = 0xE;
   instr.i      = 0;
   instr.u      = 1;
@@ -174,18 +270,17 @@ WORD assemble_single_data_transfer(char **tokens, int token_n, BYTE **output, WO
       return assemble_data_processing(tokens, 13, 0);
     }
     instr.p      = 1;
-    instr.offset = *out_size - current_address - 8;
+    instr.offset = *pool_address - current_address - 8;
     instr.rn     = 15;
 
-    *output = realloc(*output, *out_size + 4);
-    byte_output(expression, *output, *out_size);
-    *out_size   += 4;
+    byte_output(expression, *output, *pool_address);
+    *pool_address += 4;
   }
 
   // pre-indexed with no offset
   else if(token_n == 3){
     instr.p      = 1;
-    instr.rn     = parse_register(strtok(&tokens[2][1],"]"));
+    instr.rn     = parse_register(strtok_r(&tokens[2][1], "]", &save));
     instr.offset = 0;
   }
 
@@ -204,7 +299,7 @@ WORD assemble_single_data_transfer(char **tokens, int token_n, BYTE **output, WO
   //post-indexed
   else{
     instr.p      = 0;
-    instr.rn     = parse_register(strtok(&tokens[2][1], ",]"));
+    instr.rn     = parse_register(strtok_r(&tokens[2][1], ",]", &save));
     instr.offset = parse_value(tokens[3]);
   }
 
@@ -212,12 +307,31 @@ WORD assemble_single_data_transfer(char **tokens, int token_n, BYTE **output, WO
 }
 
 #define SINGLE_DATA_TRANSFER_FUNC(type, load_store) ASSEMBLE_FUNC(type) {\
-  return assemble_single_data_transfer(tokens, token_n, output, out_size, current_address, load_store);\
+  return assemble_single_data_transfer(tokens, token_n, output, pool_address, current_address, load_store);\
 }
 
 SINGLE_DATA_TRANSFER_FUNC(str, 0)
 SINGLE_DATA_TRANSFER_FUNC(ldr, 1)
 
+// encode (assemble) swap instructions: swp rd,rm,[rn]
+WORD assemble_swap(char **tokens, WORD byte) {
+  swap instr;
+  instr.cond = 0xE;
+  instr.b    = byte;
+  instr.rd   = parse_register(tokens[1]);
+  instr.rm   = parse_register(tokens[2]);
+  instr.rn   = parse_register(&tokens[3][1]);
+  return encode_swap(instr);
+}
+
+ASSEMBLE_FUNC(swp) {
+  return assemble_swap(tokens, 0);
+}
+
+ASSEMBLE_FUNC(swpb) {
+  return assemble_swap(tokens, 1);
+}
+
 // encode (assemble) branch instructions
 WORD parse_branch_address(char *token, table *symbol_table) {
   WORD address;
@@ -250,13 +364,31 @@ BRANCH_FUNC(gt, 12)
 BRANCH_FUNC(le, 13)
 BRANCH_FUNC(al, 14)
 
+// mov of a constant with no immediate encoding loads it from the pool
+ASSEMBLE_FUNC(mov) {
+  if (tokens[2][0] == '#' && !is_encodable(13, parse_value(tokens[2]))) {
+    char literal[strlen(tokens[2]) + 1];
+    strcpy(literal, tokens[2]);
+    literal[0] = '=';
+    char *ldr_tokens[3] = {"ldr", tokens[1], literal};
+    return assemble_single_data_transfer(ldr_tokens, 3, output, pool_address,
+                                         current_address, 1);
+  }
+  return assemble_data_processing(tokens, 13, 0);
+}
+
+#define S_BIT (1u << 20)
+
+ASSEMBLE_FUNC(subs) {
+  return assemble_data_processing_with_result(tokens, 2) | S_BIT;
+}
+
+ASSEMBLE_FUNC(movs) {
+  return assemble_data_processing(tokens, 13, 0) | S_BIT;
+}
+
 ASSEMBLE_FUNC(lsl) {
-  char **new_tokens = calloc(5, sizeof(char *));
-  new_tokens[0] = "mov";
-  new_tokens[1] = tokens[1];
-  new_tokens[2] = tokens[1];
-  new_tokens[3] = "lsl";
-  new_tokens[4] = tokens[2];
+  char *new_tokens[5] = {"mov", tokens[1], tokens[1], "lsl", tokens[2]};
   WORD instr = assemble_data_processing(new_tokens, 13, 0);
   //shifted register is not implemented in mov
   set_bits_to(&instr, 7, 11, parse_value(tokens[2]));
@@ -266,3 +398,10 @@ ASSEMBLE_FUNC(lsl) {
 ASSEMBLE_FUNC(andeq) {
   return 0;
 }
+
+// swi #number (or swi number); semihosting calls use swi 0x123456
+ASSEMBLE_FUNC(swi) {
+  char *number = tokens[1];
+  WORD comment = number[0] == '#' ? parse_value(number) : strtoul(number, NULL, 0);
+  return encode_software_interrupt((software_interrupt) {0xe, comment});
+}
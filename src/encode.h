@@ -9,10 +9,24 @@ ftable *map_opcode_to_function(void);
 // Main assemble function for all instructions
 // tokenize line and map the mnemonic opcode to a function pointer of its assemble function
 // the encoded instructions result is put into the passed output array
-void assemble(char *line, table *sym_table, BYTE **output, WORD *out_size, WORD address);
+// literals are written at *pool_address, which is advanced past them;
+// the output array must already be large enough to hold the whole pool
+void assemble(char *line, table *sym_table, BYTE **output, WORD *pool_address, WORD address);
+
+// Returns the number of literal pool bytes the given line will emit
+// Used by the first pass so the pool can be laid out before encoding
+WORD literal_pool_size(char *line);
+
+// Finds the 8-bit value and 4-bit rotation that make up value as a data
+// processing immediate and stores them in operand2
+// Returns false if value can not be encoded as an immediate
+bool encode_immediate(WORD value, WORD *operand2);
+
+// True if opcode is one of the branch mnemonics
+bool is_branch_mnemonic(const char *opcode);
 
 #define ASSEMBLE_FUNC(mnemonic)\
-WORD assemble_##mnemonic(char **tokens, int token_n, table *symbol_table, BYTE **output, WORD *out_size, WORD current_address)
+WORD assemble_##mnemonic(char **tokens, int token_n, table *symbol_table, BYTE **output, WORD *pool_address, WORD current_address)
 
 // Assembles the data processing instruction variants
 ASSEMBLE_FUNC(add);
@@ -25,6 +39,9 @@ ASSEMBLE_FUNC(mov);
 ASSEMBLE_FUNC(tst);
 ASSEMBLE_FUNC(teq);
 ASSEMBLE_FUNC(cmp);
+// flag-setting forms; to the PC, they return from an interrupt handler
+ASSEMBLE_FUNC(subs);
+ASSEMBLE_FUNC(movs);
 
 // Assembles the multiply instruction variants
 ASSEMBLE_FUNC(mul);
@@ -34,6 +51,10 @@ ASSEMBLE_FUNC(mla);
 ASSEMBLE_FUNC(ldr);
 ASSEMBLE_FUNC(str);
 
+// Assembles the swap instruction variants
+ASSEMBLE_FUNC(swp);
+ASSEMBLE_FUNC(swpb);
+
 // Assembles the branch instruction variants
 ASSEMBLE_FUNC(beq);
 ASSEMBLE_FUNC(bne);
@@ -46,5 +67,6 @@ ASSEMBLE_FUNC(bal);
 // Assembles the special instruction variants
 ASSEMBLE_FUNC(lsl);
 ASSEMBLE_FUNC(andeq);
+ASSEMBLE_FUNC(swi);
 
 #endif //ARM11_21_ENCODE_H
@@ -0,0 +1,279 @@
+#include "execute.h"
+#include "utils.h"
+#include "instructions.h"
+#include "source_map.h"
+#include "bus.h"
+#include "cache_sim.h"
+
+bool execute_data_processing(State *arm_state, data_processing *params){
+  WORD nczv = get_bits((WORD)arm_state->reg[16], 28, 31);
+  bool exec  = cond_check(nczv, params->cond);
+  if (exec){
+    //finding how much to offset by
+    WORD operand2;
+    if (params->i) {
+      WORD value = get_bits(params->operand2, 0, 7);
+      WORD rotation = get_bits(params->operand2, 8, 11);
+      operand2 = rotate_right(value, 2 * rotation);
+    } else {
+      //same exact method is used to decode operand2
+      operand2 = operand2_decode(params->operand2, arm_state->reg, params->s);
+    }
+
+    WORD result;
+    switch (params->opcode){
+      //case AND
+      case 0x0:
+        result = arm_state->reg[params->rn] & operand2;
+        arm_state->reg[params->rd] = result;
+        break;
+      //case EOR
+      case 0x1:
+        result = arm_state->reg[params->rn] ^ operand2;
+        arm_state->reg[params->rd] = result;
+        break;
+      //case SUB
+      case 0x2:
+        result = arm_state->reg[params->rn] - operand2;
+        arm_state->reg[params->rd] = result;
+        if (params->s) {
+          if (arm_state->reg[params->rn] < operand2) {
+            clear_bit(&(arm_state->reg[16]), 29);
+          } else {
+            set_bit(&(arm_state->reg[16]), 29);
+          }
+        }
+        break;
+      //case RSB
+      case 0x3:
+        result = operand2 - arm_state->reg[params->rn];
+        arm_state->reg[params->rd] = result;
+        if (params->s) {
+          if (operand2 < arm_state->reg[params->rn]) {
+            clear_bit(&(arm_state->reg[16]), 29);
+          } else {
+            set_bit(&(arm_state->reg[16]), 29);
+          }
+        }
+        break;
+      //case ADD
+      case 0x4:
+        result = arm_state->reg[params->rn] + operand2;
+        arm_state->reg[params->rd] = result;
+        if (params->s) {
+          if (result < arm_state->reg[params->rd]) {
+            set_bit(&(arm_state->reg[16]), 29);
+          } else {
+            clear_bit(&(arm_state->reg[16]), 29);
+          }
+        }
+        break;
+      //case TST
+      case 0x8:
+        result = arm_state->reg[params->rn] & operand2;
+        break;
+      //case TEQ
+      case 0x9:
+        result = arm_state->reg[params->rn] ^ operand2;
+        break;
+      //case CMP
+      case 0xA:
+        result = arm_state->reg[params->rn] - operand2;
+        if (params->s) {
+          if (arm_state->reg[params->rn] < operand2) {
+            clear_bit(&(arm_state->reg[16]), 29);
+          } else {
+            set_bit(&(arm_state->reg[16]), 29);
+          }
+        }
+        break;
+      //case CMN
+      case 0xB:
+        result = arm_state->reg[params->rn] + operand2;
+        if (params->s) {
+          if (result < arm_state->reg[params->rn]) {
+            set_bit(&(arm_state->reg[16]), 29);
+          } else {
+            clear_bit(&(arm_state->reg[16]), 29);
+          }
+        }
+        break;
+      //case ORR
+      case 0xC:
+        result = arm_state->reg[params->rn] | operand2;
+        arm_state->reg[params->rd] = result;
+        break;
+      //case MOV
+      case 0xD:
+        result = operand2;
+        arm_state->reg[params->rd] = result;
+        break;
+      //case BIC
+      case 0xE:
+        result = arm_state->reg[params->rn] & ~operand2;
+        arm_state->reg[params->rd] = result;
+        break;
+      //case MVN
+      case 0xF:
+        result = ~operand2;
+        arm_state->reg[params->rd] = result;
+        break;
+      // ADC, SBC and RSC (5-7) are not implemented: they change nothing
+      default:
+        return exec;
+    }
+    if (params->s) {
+      //set Z
+      if (result == 0) {
+        set_bit(&(arm_state->reg[16]), 30);
+      } else {
+        clear_bit(&(arm_state->reg[16]), 30);
+      }
+      //set N
+      set_bits_to(&(arm_state->reg[16]), 31, 31, get_bit(result, 31));
+    }
+  }
+  return exec;
+}
+
+bool execute_multiply(State *arm_state, multiply *params){
+  WORD nczv  = get_bits((WORD)arm_state->reg[16], 28, 31);
+  bool exec   = cond_check(nczv, params->cond);
+  int result = arm_state->reg[params -> rm] * arm_state->reg[params -> rs];
+
+  if (exec) {
+    if (params->a) {
+      result += arm_state->reg[params -> rn];
+    }
+    //Update CPSR flags
+    if (params->s){
+      if (result < 0) {
+        set_bit((WORD *)&arm_state->reg[16], 31);
+      } else if (result == 0) {
+        set_bit((WORD *)&arm_state->reg[16], 30);
+      }
+      // The spec does not tell us to add this but it might become useful, so I left this here.
+      /*else if (result >= (1 << 31) || result < -(1 << 31)) {
+        set_bit(&arm_state->reg[16], 29);
+      }*/
+    }
+
+    arm_state->reg[params->rd] = result;
+
+    }
+  return exec;
+}
+
+bool execute_swap(State *arm_state, swap *params) {
+  WORD nczv = get_bits((WORD)arm_state->reg[16], 28, 31);
+  bool exec = cond_check(nczv, params->cond);
+  if (exec) {
+    WORD address = arm_state->reg[params->rn];
+    WORD size = params->b ? 1 : sizeof(WORD);
+    if (address > MEMORY_SIZE - size || address % size) {
+      arm_state->errors++;
+      printf("Error: Unaligned or out of bounds swap at address 0x%08x", address);
+      print_source_location(arm_state->map, executing_pc(arm_state));
+      printf("\n");
+      return false;
+    }
+    BYTE *location = &arm_state->memory[address];
+    WORD value = arm_state->reg[params->rm];
+    if (params->b) {
+      arm_state->reg[params->rd] = __atomic_exchange_n(location, (BYTE) value, __ATOMIC_SEQ_CST);
+    } else {
+      arm_state->reg[params->rd] = __atomic_exchange_n((WORD *) location, value, __ATOMIC_SEQ_CST);
+    }
+  }
+  return exec;
+}
+
+bool execute_single_data_transfer(State *arm_state, single_data_transfer *params){
+  WORD nczv = get_bits((WORD)arm_state->reg[16], 28, 31);
+  bool exec = cond_check(nczv, params->cond);
+  int mem_location;
+
+  if (exec) {
+    //finding how much to offset by
+    int offset_value;
+    if (!(params->i)) {
+      offset_value = params->offset;
+    } else {
+      offset_value = offset_decode(params->offset, arm_state->reg);
+    }
+
+    //deciding whether to add or subtract
+    if (!(params->u)) {
+      offset_value = -offset_value;
+    }
+
+    //pre-index vs post-index
+    if (params->p) {
+      mem_location = arm_state->reg[params->rn] + offset_value;
+    } else {
+      mem_location = arm_state->reg[params->rn];
+      arm_state->reg[params->rn] += offset_value;
+    }
+
+    if (arm_state->caches) {
+      cache_data(arm_state->caches, executing_pc(arm_state), mem_location, !params->l);
+    }
+
+    // one unsigned comparison keeps RAM accesses on a single branch
+    if ((WORD) mem_location >= MEMORY_SIZE) {
+      bool handled = params->l
+        ? bus_load(arm_state->bus, mem_location, &arm_state->reg[params->rd],
+                   arm_state->instructions)
+        : bus_store(arm_state->bus, mem_location, arm_state->reg[params->rd],
+                    arm_state->instructions);
+      if (handled) {
+        return exec;
+      }
+      arm_state->errors++;
+      printf("Error: Out of bounds memory access at address 0x%08x", mem_location);
+      print_source_location(arm_state->map, executing_pc(arm_state));
+      printf("\n");
+      return false;
+    }
+
+    //store vs load
+    WORD *mem_ptr = (WORD *)&(arm_state->memory[mem_location]);
+    // other cores may access the word at the same time (see smp.h)
+    if (arm_state->smp) {
+      if (params->l) {
+        arm_state->reg[params->rd] = __atomic_load_n(mem_ptr, __ATOMIC_RELAXED);
+      } else {
+        __atomic_store_n(mem_ptr, arm_state->reg[params->rd], __ATOMIC_RELAXED);
+      }
+    } else if (params->l) {
+      WORD fetched = *(mem_ptr);
+      arm_state->reg[params->rd] = fetched;
+    } else {
+      *(mem_ptr) = arm_state->reg[params->rd];
+    }
+
+  }
+  return exec;
+}
+
+bool execute_branch(State *arm_state, branch *params){
+  WORD nczv = get_bits((WORD)arm_state->reg[16], 28, 31);
+  bool exec  = cond_check(nczv, params->cond);
+  if (exec) {
+    WORD delta = params->offset << 2;
+    //sign extend
+    WORD sign = get_bit(delta, 25);
+    if(sign) {
+      WORD set_bits = 0x3F << 26;
+      delta = delta | set_bits;
+    }
+    signed int offset = (signed int) delta;
+    //check if the offset will cause memory OOB
+    int new_pc = arm_state->reg[15] + offset;
+    if (new_pc < 0 || new_pc >= MEMORY_SIZE) {
+      return false;
+    }
+    arm_state->reg[15] = new_pc;
+  }
+  return exec;
+}
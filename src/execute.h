@@ -0,0 +1,27 @@
+#ifndef EXECUTE
+#define EXECUTE
+#include "utils.h"
+#include "instructions.h"
+#include <stdbool.h>
+
+// Execution of decoded instructions on an arm_state (see instructions.h
+// for the decoders)
+//
+// Each execute_* returns false if the condition code failed or the
+// instruction could not complete, and true otherwise
+// Kept apart from the decoders so that the assembler, linker and
+// verifier do not pull in what execution reports to: the source map of
+// arm_state->map, the devices of arm_state->bus and the cache models of
+// arm_state->caches
+
+bool execute_data_processing(State *arm_state, data_processing *params);
+
+bool execute_multiply(State *arm_state, multiply *params);
+
+bool execute_swap(State *arm_state, swap *params);
+
+bool execute_single_data_transfer(State *arm_state, single_data_transfer *params);
+
+bool execute_branch(State *arm_state, branch *params);
+
+#endif
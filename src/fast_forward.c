@@ -0,0 +1,105 @@
+#include "fast_forward.h"
+#include "utils.h"
+#include "instructions.h"
+#include "scheduler.h"
+
+#define SUB_OPCODE 0x2
+#define CMP_OPCODE 0xA
+#define COND_NE 0x1
+#define COND_AL 0xE
+#define LOOP_INSTRUCTIONS 3
+
+// an unconditional op rX,rX,#imm (or op rX,#imm), storing rX and imm
+bool is_immediate_op(WORD instr, WORD opcode, WORD s, WORD *rx, WORD *imm) {
+  if (clarify_instruction(instr) != DATA_PROCESSING) {
+    return false;
+  }
+  data_processing params = decode_data_processing(instr);
+  if (params.cond != COND_AL || !params.i || params.opcode != opcode
+      || params.s != s || params.rn == 15) {
+    return false;
+  }
+  if (opcode == SUB_OPCODE && params.rd != params.rn) {
+    return false;
+  }
+  *rx = params.rn;
+  *imm = rotate_right(get_bits(params.operand2, 0, 7),
+                      2 * get_bits(params.operand2, 8, 11));
+  return true;
+}
+
+// the inverse of an odd a modulo 2^32, by Newton's iteration
+WORD odd_inverse(WORD a) {
+  WORD x = a;
+  for (int i = 0; i < 5; i++) {
+    x *= 2 - a * x;
+  }
+  return x;
+}
+
+// the least m > 0 with distance - m * step == 0 (mod 2^32), or 0 if the
+// register never gets there
+uint64_t iterations_left(WORD distance, WORD step) {
+  if (step == 0) {
+    return 0;
+  }
+  int zeros = __builtin_ctz(step);
+  if (distance & ((1u << zeros) - 1)) {
+    return 0;
+  }
+  uint64_t modulus = 1ull << (32 - zeros);
+  return (uint64_t) ((distance >> zeros) * odd_inverse(step >> zeros)) % modulus;
+}
+
+bool fast_forward_loop(State *arm_state, WORD branch_instr) {
+  if (clarify_instruction(branch_instr) != BRANCH) {
+    return false;
+  }
+  branch params = decode_branch(branch_instr);
+  WORD *cpsr = &arm_state->reg[16];
+  // a bne back over exactly the sub and the cmp, about to be taken
+  if (params.cond != COND_NE || get_bit(*cpsr, 30)
+      || params.offset != get_bits(-(LOOP_INSTRUCTIONS + 1), 0, 23)) {
+    return false;
+  }
+  WORD start = executing_pc(arm_state) - 4 * (LOOP_INSTRUCTIONS - 1);
+  if (start >= MEMORY_SIZE) {
+    return false;
+  }
+  WORD sub_rx, step, cmp_rx, target;
+  if (!is_immediate_op(read_word(arm_state->memory, start), SUB_OPCODE, 0, &sub_rx, &step)
+      || !is_immediate_op(read_word(arm_state->memory, start + 4), CMP_OPCODE, 1,
+                          &cmp_rx, &target)
+      || sub_rx != cmp_rx) {
+    return false;
+  }
+
+  uint64_t m = iterations_left(arm_state->reg[sub_rx] - target, step);
+  if (m == 0) {
+    return false;
+  }
+  // only as far as the next event, which fires at the following bne, and
+  // no further than the run may go
+  uint64_t limit = arm_state->scheduler ? arm_state->scheduler->next_check : NO_EVENT;
+  if (arm_state->stop_at && arm_state->stop_at < limit) {
+    limit = arm_state->stop_at;
+  }
+  uint64_t now = arm_state->instructions;
+  if (limit < now + LOOP_INSTRUCTIONS * m) {
+    uint64_t partial = limit > now ? (limit - now) / LOOP_INSTRUCTIONS : 0;
+    WORD rx = arm_state->reg[sub_rx] - (WORD) partial * step;
+    arm_state->reg[sub_rx] = rx;
+    if (partial) {
+      // cmp of a register that is not yet target
+      set_bits_to(cpsr, 29, 29, !(rx < target));
+      clear_bit(cpsr, 30);
+      set_bits_to(cpsr, 31, 31, get_bit(rx - target, 31));
+    }
+    arm_state->instructions += LOOP_INSTRUCTIONS * partial;
+    return false;
+  }
+  arm_state->reg[sub_rx] = target;
+  set_bits_to(cpsr, 29, 31, 0x3);   // N clear, Z and C set
+  arm_state->instructions += LOOP_INSTRUCTIONS * m;
+  return true;
+}
@@ -0,0 +1,26 @@
+#ifndef FAST_FORWARD
+#define FAST_FORWARD
+#include "utils.h"
+
+// Busy-wait loops of the form
+//   loop:
+//   sub rX,rX,#k
+//   cmp rX,#c
+//   bne loop
+// only count a register down, so their remaining iterations can be
+// skipped: rX ends equal to c and the last cmp leaves Z and C set and N
+// clear, as execute_data_processing would
+//
+// Called with the bne of such a loop about to be taken (the PC is 8
+// bytes ahead of it), completes the loop and returns true; the caller
+// then continues past the bne as if it fell through. The skipped
+// instructions are added to arm_state->instructions
+// With a scheduler, iterations are only skipped up to its next event;
+// the loop is then left mid-way and false is returned, so that the bne
+// is taken and the event fires at the boundary as it would have. Nor
+// are iterations skipped past arm_state->stop_at
+// Returns false (changing nothing) for any other instruction, and for a
+// loop that never reaches c
+bool fast_forward_loop(State *arm_state, WORD branch_instr);
+
+#endif
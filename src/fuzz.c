@@ -0,0 +1,114 @@
+#include "fuzz.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/shm.h>
+#include "utils.h"
+#include "cycle.h"
+#include "instructions.h"
+#include "semihost.h"
+
+coverage *coverage_create(void) {
+  coverage *c = calloc(1, sizeof(coverage));
+  fail_if(!c, "Failed to allocate memory");
+  const char *id = getenv("__AFL_SHM_ID");
+  if (id) {
+    c->map = shmat(atoi(id), NULL, 0);
+    fail_if(c->map == (void *) -1, "Failed to attach the coverage bitmap");
+    c->shared = true;
+  } else {
+    c->map = calloc(COVERAGE_MAP_SIZE, 1);
+    fail_if(!c->map, "Failed to allocate memory");
+  }
+  return c;
+}
+
+void coverage_edge(coverage *c, WORD address) {
+  // Fibonacci hashing spreads the word-aligned addresses over the map
+  WORD id = (address >> 2) * 0x9E3779B1u >> (32 - COVERAGE_MAP_BITS);
+  BYTE *hits = &c->map[id ^ c->previous];
+  *hits += 1;
+  *hits += *hits == 0;
+  c->previous = id >> 1;
+}
+
+WORD coverage_merge(coverage *c, BYTE *seen) {
+  WORD fresh = 0;
+  for (WORD i = 0; i < COVERAGE_MAP_SIZE; i++) {
+    if (c->map[i] && !seen[i]) {
+      seen[i] = 1;
+      fresh++;
+    }
+  }
+  return fresh;
+}
+
+void coverage_free(coverage *c) {
+  if (c->shared) {
+    shmdt(c->map);
+  } else {
+    free(c->map);
+  }
+  free(c);
+}
+
+fuzz_target *fuzz_create(const BYTE *memory, WORD input_address, uint64_t budget) {
+  fail_if(input_address >= MEMORY_SIZE, "The fuzzed input must go in memory");
+  fuzz_target *target = calloc(1, sizeof(fuzz_target));
+  fail_if(!target, "Failed to allocate memory");
+  target->pristine = malloc(MEMORY_SIZE);
+  fail_if(!target->pristine, "Failed to allocate memory");
+  memcpy(target->pristine, memory, MEMORY_SIZE);
+  target->input_address = input_address;
+  target->input_capacity = MEMORY_SIZE - input_address;
+  target->budget = budget;
+  return target;
+}
+
+fuzz_result fuzz_run(fuzz_target *target, State *arm_state, const BYTE *input, WORD length) {
+  memcpy(arm_state->memory, target->pristine, MEMORY_SIZE);
+  memset(arm_state->reg, 0, REGISTER_N * sizeof(WORD));
+  arm_state->spsr = 0;
+  memset(arm_state->banked, 0, sizeof(arm_state->banked));
+  arm_state->instructions = 0;
+  arm_state->stop_at = target->budget;
+  arm_state->errors = 0;
+  // the bitmap holds the edges of this run only, as the fuzzer expects
+  if (arm_state->coverage) {
+    memset(arm_state->coverage->map, 0, COVERAGE_MAP_SIZE);
+    arm_state->coverage->previous = 0;
+  }
+  if (arm_state->host) {
+    arm_state->host->exited = false;
+    arm_state->host->exit_code = 0;
+  }
+  if (length > target->input_capacity) {
+    length = target->input_capacity;
+  }
+  memcpy(arm_state->memory + target->input_address, input, length);
+  arm_state->reg[0] = target->input_address;
+  arm_state->reg[1] = length;
+
+  cycle(arm_state);
+
+  if (arm_state->instructions >= target->budget) {
+    return FUZZ_HANG;
+  }
+  if (arm_state->errors) {
+    return FUZZ_CRASH;
+  }
+  if (arm_state->host && arm_state->host->exited) {
+    return FUZZ_OK;
+  }
+  // the last instruction executed was a halt unless something else
+  // stopped the run; a PC further on than the end of memory went past it
+  if (arm_state->reg[PC_INDEX] > MEMORY_SIZE
+      || clarify_instruction(read_word(arm_state->memory, executing_pc(arm_state))) != HALT) {
+    return FUZZ_CRASH;
+  }
+  return FUZZ_OK;
+}
+
+void fuzz_free(fuzz_target *target) {
+  free(target->pristine);
+  free(target);
+}
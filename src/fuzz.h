@@ -0,0 +1,75 @@
+#ifndef FUZZ
+#define FUZZ
+#include <stdint.h>
+#include "utils.h"
+
+// Coverage feedback and a persistent loop for fuzzing guest programs
+//
+// Coverage
+// With arm_state->coverage set, every branch executed records the edge
+// from the block before it to the block after it (the target, or the
+// instruction after a branch not taken) in a bitmap laid out as AFL's:
+// COVERAGE_MAP_SIZE hit counters, indexed by the ids of the two blocks
+// xored, the previous id halved so that A->B and B->A differ. Counters
+// skip 0 when they wrap. If __AFL_SHM_ID is set, the bitmap is the
+// shared memory segment it names, so that the fuzzer reads it directly
+//
+// Persistent loop
+// fuzz_run runs one input on a State that is reset first: its memory
+// comes back from a copy taken after the binary was loaded (the binary
+// is not loaded again), its registers are cleared and the input is
+// copied to input_address, with r0 holding that address and r1 the
+// length. The bitmap is cleared too, so that after a run it holds that
+// run's edges. A run ends as
+//   FUZZ_OK     at a halt or a semihosting exit (whatever its code)
+//               without errors
+//   FUZZ_CRASH  after an error (out of bounds access, unsupported call,
+//               ...; see State.errors), or with the PC run off the end of
+//               memory
+//   FUZZ_HANG   after budget instructions
+
+#define COVERAGE_MAP_BITS 16
+#define COVERAGE_MAP_SIZE (1u << COVERAGE_MAP_BITS)
+#define FUZZ_DEFAULT_BUDGET 10000000
+
+typedef struct coverage {
+  BYTE *map;
+  WORD previous;           // the halved id of the block executing
+  bool shared;
+} coverage;
+
+typedef enum {
+  FUZZ_OK,
+  FUZZ_CRASH,
+  FUZZ_HANG
+} fuzz_result;
+
+typedef struct fuzz_target {
+  BYTE *pristine;          // the memory as the binary left it
+  WORD input_address;
+  WORD input_capacity;     // longer inputs are cut
+  uint64_t budget;
+} fuzz_target;
+
+// The bitmap named by __AFL_SHM_ID, or else a private one
+coverage *coverage_create(void);
+
+// Records the edge into the block at address
+void coverage_edge(coverage *c, WORD address);
+
+// Adds the edges in the bitmap to seen (COVERAGE_MAP_SIZE bytes) and
+// returns the number of edges seen for the first time
+WORD coverage_merge(coverage *c, BYTE *seen);
+
+void coverage_free(coverage *c);
+
+// Keeps a copy of memory to reset the runs to
+fuzz_target *fuzz_create(const BYTE *memory, WORD input_address, uint64_t budget);
+
+// Resets arm_state (which may have a host and devices, but no scheduler
+// or trace) and runs the input on it
+fuzz_result fuzz_run(fuzz_target *target, State *arm_state, const BYTE *input, WORD length);
+
+void fuzz_free(fuzz_target *target);
+
+#endif
@@ -0,0 +1,102 @@
+#include "gpio.h"
+#include <stdlib.h>
+#include <inttypes.h>
+#include "utils.h"
+
+#define FSEL_END 0x18
+#define SET0 0x1C
+#define SET1 0x20
+#define CLR0 0x28
+#define CLR1 0x2C
+#define LEV0 0x34
+#define LEV1 0x38
+#define OUTPUT_FUNCTION 1
+#define PIN_MASK ((1ull << GPIO_PIN_N) - 1)
+
+gpio *gpio_create(FILE *log) {
+  gpio *g = calloc(1, sizeof(gpio));
+  fail_if(!g, "Failed to allocate memory");
+  g->log = log;
+  return g;
+}
+
+void gpio_flush(gpio *g) {
+  if (g->log) {
+    for (WORD i = 0; i < g->event_n; i++) {
+      fprintf(g->log, "%" PRIu64 " pin %u %s\n", g->events[i].time,
+              g->events[i].pin, g->events[i].high ? "high" : "low");
+    }
+  }
+  g->event_n = 0;
+}
+
+void record_event(gpio *g, uint64_t time, WORD pin, bool high) {
+  if (g->event_n == GPIO_LOG_BUFFER) {
+    gpio_flush(g);
+  }
+  g->events[g->event_n++] = (gpio_event) {time, pin, high};
+}
+
+// recomputes the pin levels after a register was written, recording
+// each pin that changed
+void update_levels(gpio *g, uint64_t time) {
+  uint64_t outputs = 0;
+  for (WORD pin = 0; pin < GPIO_PIN_N; pin++) {
+    WORD function = get_bits(g->function_select[pin / 10], 3 * (pin % 10), 3 * (pin % 10) + 2);
+    if (function == OUTPUT_FUNCTION) {
+      outputs |= 1ull << pin;
+    }
+  }
+  uint64_t level = g->output & outputs;
+  uint64_t changed = level ^ g->level;
+  for (WORD pin = 0; changed; pin++, changed >>= 1) {
+    if (changed & 1) {
+      record_event(g, time, pin, (level >> pin) & 1);
+    }
+  }
+  g->level = level;
+}
+
+bool gpio_load(void *data, WORD offset, WORD *value, uint64_t time) {
+  gpio *g = (gpio *) data;
+  if (offset % 4) {
+    return false;
+  }
+  if (offset < FSEL_END) {
+    *value = g->function_select[offset / 4];
+  } else if (offset == LEV0 || offset == LEV1) {
+    *value = g->level >> (offset == LEV0 ? 0 : 32);
+  } else {
+    // set and clear read as 0, as do the reserved words
+    *value = 0;
+  }
+  return true;
+}
+
+bool gpio_store(void *data, WORD offset, WORD value, uint64_t time) {
+  gpio *g = (gpio *) data;
+  if (offset % 4) {
+    return false;
+  }
+  if (offset < FSEL_END) {
+    g->function_select[offset / 4] = value;
+  } else if (offset == SET0 || offset == SET1) {
+    g->output |= ((uint64_t) value << (offset == SET0 ? 0 : 32)) & PIN_MASK;
+  } else if (offset == CLR0 || offset == CLR1) {
+    g->output &= ~((uint64_t) value << (offset == CLR0 ? 0 : 32));
+  } else {
+    // the levels and reserved words ignore writes
+    return true;
+  }
+  update_levels(g, time);
+  return true;
+}
+
+void gpio_attach(gpio *g, bus *b) {
+  bus_register(b, (device) {"gpio", GPIO_BASE, GPIO_SIZE, &gpio_load, &gpio_store, g});
+}
+
+void gpio_free(gpio *g) {
+  gpio_flush(g);
+  free(g);
+}
@@ -0,0 +1,53 @@
+#ifndef GPIO
+#define GPIO
+#include <stdio.h>
+#include <stdint.h>
+#include "utils.h"
+#include "bus.h"
+
+// GPIO controller at the Raspberry Pi's addresses:
+//   0x20200000-0x20200014  GPFSEL0-5  function select, 3 bits per pin
+//   0x2020001c-0x20200020  GPSET0-1   writing 1 sets a pin's output
+//   0x20200028-0x2020002c  GPCLR0-1   writing 1 clears a pin's output
+//   0x20200034-0x20200038  GPLEV0-1   pin levels (read only)
+// A pin is high when it is selected as an output (function 001) and
+// its output is set
+//
+// Every change of a pin's level is recorded with the number of
+// instructions executed when it happened, as a line
+//   <time> pin <n> high|low
+// Events are buffered and written when the buffer fills or the
+// controller is freed
+
+#define GPIO_BASE 0x20200000
+#define GPIO_SIZE 0xB4
+#define GPIO_PIN_N 54
+#define GPIO_LOG_BUFFER 256
+
+typedef struct {
+  uint64_t time;
+  WORD pin;
+  bool high;
+} gpio_event;
+
+typedef struct {
+  WORD function_select[6];
+  uint64_t output;
+  uint64_t level;
+  FILE *log;                     // NULL to discard the events
+  gpio_event events[GPIO_LOG_BUFFER];
+  WORD event_n;
+} gpio;
+
+gpio *gpio_create(FILE *log);
+
+// Registers the controller's registers on b
+void gpio_attach(gpio *g, bus *b);
+
+// Writes the buffered events to the log
+void gpio_flush(gpio *g);
+
+// Flushes and frees g (the log file is left open)
+void gpio_free(gpio *g);
+
+#endif
@@ -0,0 +1,52 @@
+#include "input.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "utils.h"
+
+#define INPUT_LENGTH 0x0
+#define INPUT_BASE 0x4
+
+input_window *input_open(char *file_name, WORD base) {
+  fail_if(base % BUS_PAGE_SIZE || base < MEMORY_SIZE,
+          "The input window must be page-aligned and outside memory");
+  input_window *w = calloc(1, sizeof(input_window));
+  fail_if(!w, "Failed to allocate memory");
+  w->mapped = (const BYTE *) map_file(file_name, &w->length);
+  w->base = base;
+  fail_if(w->length > (1ull << 32) - base,
+          "The input file does not fit in the guest's address space");
+  if (w->mapped) {
+    // guests mostly stream through their input
+    madvise((void *) w->mapped, w->length, MADV_SEQUENTIAL);
+  }
+  return w;
+}
+
+bool input_status_load(void *data, WORD offset, WORD *value, uint64_t time) {
+  input_window *w = (input_window *) data;
+  switch (offset) {
+    case INPUT_LENGTH:
+      *value = w->length;
+      return true;
+    case INPUT_BASE:
+      *value = w->base;
+      return true;
+    default:
+      return false;
+  }
+}
+
+void input_attach(input_window *w, bus *b) {
+  bus_register(b, (device) {"input status", INPUT_STATUS_BASE, INPUT_STATUS_SIZE,
+                            &input_status_load, NULL, w});
+  if (w->mapped) {
+    // the mapping is zero-filled up to the end of its last page
+    WORD size = (w->length + BUS_PAGE_SIZE - 1) & ~(BUS_PAGE_SIZE - 1);
+    bus_register(b, (device) {"input", w->base, size, NULL, NULL, NULL, w->mapped});
+  }
+}
+
+void input_free(input_window *w) {
+  unmap_file((const char *) w->mapped, w->length);
+  free(w);
+}
@@ -0,0 +1,34 @@
+#ifndef INPUT
+#define INPUT
+#include <stddef.h>
+#include "utils.h"
+#include "bus.h"
+
+// Input file mapped read-only into a window of guest addresses, so that
+// ldr reads it in place, without copying it into the memory image:
+//   base ... base + length  the file's bytes; the rest of the window's
+//                           last 4 KB page reads as 0 and stores fail
+//   0x2000c000  INPUT_LENGTH  the length of the file in bytes
+//   0x2000c004  INPUT_BASE    the address of the window
+// The window starts at INPUT_DEFAULT_BASE unless another page-aligned
+// address outside RAM is given
+
+#define INPUT_STATUS_BASE 0x2000C000
+#define INPUT_STATUS_SIZE 0x8
+#define INPUT_DEFAULT_BASE 0x40000000
+
+typedef struct {
+  const BYTE *mapped;   // NULL for an empty file
+  size_t length;
+  WORD base;
+} input_window;
+
+input_window *input_open(char *file_name, WORD base);
+
+// Registers the window and the status registers on b
+void input_attach(input_window *w, bus *b);
+
+// Unmaps the file and frees w
+void input_free(input_window *w);
+
+#endif
@@ -1,6 +1,46 @@
 #include "instructions.h"
 #include "utils.h"
 
+instr_type clarify_instruction(WORD decoded){
+  // decoded[31..0] = 0
+  if(!decoded){
+    return HALT;
+  }
+
+  // clarify instruction based on bit 27, 26
+  WORD bits = get_bits(decoded, 26, 27);
+  switch(bits) {
+    // decoded[27..26] = 00
+    case 0: {
+      WORD bit25 = get_bits(decoded, 25, 25);
+      WORD bit7 = get_bits(decoded, 7, 7);
+      WORD bit4 = get_bits(decoded, 4, 4);
+      if(!bit25 && bit7 && bit4) {
+        // decoded[27..23] = 00010 for SWP, 00000 for MUL
+        return get_bit(decoded, 24) ? SWAP : MULTIPLY;
+      } else {
+        return DATA_PROCESSING;
+      }
+    }
+    // decoded[27..26] = 01
+    case 1: {
+      return SINGLE_DATA_TRANSFER;
+    }
+    // decoded[27..26] = 10
+    case 2: {
+      return BRANCH;
+    }
+    // decoded[27..26] = 11: SWI if decoded[25..24] = 11 too, except
+    // with condition 1111, which is not a condition
+    default: {
+      if (get_bits(decoded, 24, 27) == 0xF && get_bits(decoded, 28, 31) != 0xF) {
+        return SOFTWARE_INTERRUPT;
+      }
+      return HALT;
+    }
+  }
+}
+
 data_processing decode_data_processing(WORD src) {
   WORD cond     = get_bits(src, 28, 31);
   WORD i        = get_bit(src, 25);
@@ -90,6 +130,20 @@ WORD encode_branch(branch instr) {
   return result;
 }
 
+software_interrupt decode_software_interrupt(WORD src) {
+  WORD cond    = get_bits(src, 28, 31);
+  WORD comment = get_bits(src, 0, 23);
+  return (software_interrupt) {cond, comment};
+}
+
+WORD encode_software_interrupt(software_interrupt instr) {
+  WORD result = 0;
+  set_bits_to(&result, 28, 31, instr.cond);
+  set_bits(&result, 24, 27);
+  set_bits_to(&result, 0, 23, instr.comment);
+  return result;
+}
+
 bool cond_check(WORD nzcv, WORD cond) {
   switch(cond) {
     case 0:
@@ -111,204 +165,24 @@ bool cond_check(WORD nzcv, WORD cond) {
   }
 }
 
-bool execute_data_processing(State *arm_state, data_processing *params){
-  WORD nczv = get_bits((WORD)arm_state->reg[16], 28, 31);
-  bool exec  = cond_check(nczv, params->cond);
-  if (exec){
-    //finding how much to offset by
-    WORD operand2;
-    if (params->i) {
-      WORD value = get_bits(params->operand2, 0, 7);
-      WORD rotation = get_bits(params->operand2, 8, 11);
-      operand2 = rotate_right(value, 2 * rotation);
-    } else {
-      //same exact method is used to decode operand2
-      operand2 = operand2_decode(params->operand2, arm_state->reg, params->s);
-    }
-
-    WORD result;
-    switch (params->opcode){
-      //case AND
-      case 0x0:
-        result = arm_state->reg[params->rn] & operand2;
-        arm_state->reg[params->rd] = result;
-        break;
-      //case EOR
-      case 0x1:
-        result = arm_state->reg[params->rn] ^ operand2;
-        arm_state->reg[params->rd] = result;
-        break;
-      //case SUB
-      case 0x2:
-        result = arm_state->reg[params->rn] - operand2;
-        arm_state->reg[params->rd] = result;
-        if (params->s) {
-          if (arm_state->reg[params->rn] < operand2) {
-            clear_bit(&(arm_state->reg[16]), 29);
-          } else {
-            set_bit(&(arm_state->reg[16]), 29);
-          }
-        }
-        break;
-      //case RSB
-      case 0x3:
-        result = operand2 - arm_state->reg[params->rn];
-        arm_state->reg[params->rd] = result;
-        if (params->s) {
-          if (operand2 < arm_state->reg[params->rn]) {
-            clear_bit(&(arm_state->reg[16]), 29);
-          } else {
-            set_bit(&(arm_state->reg[16]), 29);
-          }
-        }
-        break;
-      //case ADD
-      case 0x4:
-        result = arm_state->reg[params->rn] + operand2;
-        arm_state->reg[params->rd] = result;
-        if (params->s) {
-          if (result < arm_state->reg[params->rd]) {
-            set_bit(&(arm_state->reg[16]), 29);
-          } else {
-            clear_bit(&(arm_state->reg[16]), 29);
-          }
-        }
-        break;
-      //case TST
-      case 0x8:
-        result = arm_state->reg[params->rn] & operand2;
-        break;
-      //case TEQ
-      case 0x9:
-        result = arm_state->reg[params->rn] ^ operand2;
-        break;
-      //case CMP
-      case 0xA:
-        result = arm_state->reg[params->rn] - operand2;
-        if (params->s) {
-          if (arm_state->reg[params->rn] < operand2) {
-            clear_bit(&(arm_state->reg[16]), 29);
-          } else {
-            set_bit(&(arm_state->reg[16]), 29);
-          }
-        }
-        break;
-      //case ORR
-      case 0xC:
-        result = arm_state->reg[params->rn] | operand2;
-        arm_state->reg[params->rd] = result;
-        break;
-      //case MOV
-      case 0xD:
-        result = operand2;
-        arm_state->reg[params->rd] = result;
-        break;
-    }
-    if (params->s) {
-      //set Z
-      if (result == 0) {
-        set_bit(&(arm_state->reg[16]), 30);
-      } else {
-        clear_bit(&(arm_state->reg[16]), 30);
-      }
-      //set N
-      set_bits_to(&(arm_state->reg[16]), 31, 31, get_bit(result, 31));
-    }
-  }
-  return exec;
-}
-
-bool execute_multiply(State *arm_state, multiply *params){
-  WORD nczv  = get_bits((WORD)arm_state->reg[16], 28, 31);
-  bool exec   = cond_check(nczv, params->cond);
-  int result = arm_state->reg[params -> rm] * arm_state->reg[params -> rs];
-
-  if (exec) {
-    if (params->a) {
-      result += arm_state->reg[params -> rn];
-    }
-    //Update CPSR flags
-    if (params->s){
-      if (result < 0) {
-        set_bit((WORD *)&arm_state->reg[16], 31);
-      } else if (result == 0) {
-        set_bit((WORD *)&arm_state->reg[16], 30);
-      }
-      // The spec does not tell us to add this but it might become useful, so I left this here.
-      /*else if (result >= (1 << 31) || result < -(1 << 31)) {
-        set_bit(&arm_state->reg[16], 29);
-      }*/
-    }
-
-    arm_state->reg[params->rd] = result;
-
-    }
-  return exec;
-}
-
-bool execute_single_data_transfer(State *arm_state, single_data_transfer *params){
-  WORD nczv = get_bits((WORD)arm_state->reg[16], 28, 31);
-  bool exec = cond_check(nczv, params->cond);
-  int mem_location;
-
-  if (exec) {
-    //finding how much to offset by
-    int offset_value;
-    if (!(params->i)) {
-      offset_value = params->offset;
-    } else {
-      offset_value = offset_decode(params->offset, arm_state->reg);
-    }
-
-    //deciding whether to add or subtract
-    if (!(params->u)) {
-      offset_value = -offset_value;
-    }
-
-    //pre-index vs post-index
-    if (params->p) {
-      mem_location = arm_state->reg[params->rn] + offset_value;
-    } else {
-      mem_location = arm_state->reg[params->rn];
-      arm_state->reg[params->rn] += offset_value;
-    }
-
-    if (0 > mem_location || mem_location >= MEMORY_SIZE) {
-      printf("Error: Out of bounds memory access at address 0x%08x\n", mem_location);
-      return false;
-    }
-
-    //store vs load
-    WORD *mem_ptr = (WORD *)&(arm_state->memory[mem_location]);
-    if (params->l) {
-      WORD fetched = *(mem_ptr);
-      arm_state->reg[params->rd] = fetched;
-    } else {
-      *(mem_ptr) = arm_state->reg[params->rd];
-    }
-
-  }
-  return exec;
+swap decode_swap(WORD src) {
+  WORD cond = get_bits(src, 28, 31);
+  WORD b    = get_bit(src, 22);
+  WORD rn   = get_bits(src, 16, 19);
+  WORD rd   = get_bits(src, 12, 15);
+  WORD rm   = get_bits(src, 0, 3);
+  return (swap) {cond, b, rn, rd, rm};
 }
 
-bool execute_branch(State *arm_state, branch *params){
-  WORD nczv = get_bits((WORD)arm_state->reg[16], 28, 31);
-  bool exec  = cond_check(nczv, params->cond);
-  if (exec) {
-    WORD delta = params->offset << 2;
-    //sign extend
-    WORD sign = get_bit(delta, 25);
-    if(sign) {
-      WORD set_bits = 0x3F << 26;
-      delta = delta | set_bits;
-    }
-    signed int offset = (signed int) delta;
-    //check if the offset will cause memory OOB
-    int new_pc = arm_state->reg[15] + offset;
-    if (new_pc < 0 || new_pc >= MEMORY_SIZE) {
-      return false;
-    }
-    arm_state->reg[15] = new_pc;
-  }
-  return exec;
+WORD encode_swap(swap instr) {
+  WORD result = 0;
+  set_bits_to(&result, 28, 31, instr.cond);
+  set_bit(&result, 24);
+  set_bits_to(&result, 22, 22, instr.b);
+  set_bits_to(&result, 16, 19, instr.rn);
+  set_bits_to(&result, 12, 15, instr.rd);
+  set_bit(&result, 7);
+  set_bit(&result, 4);
+  set_bits_to(&result, 0, 3, instr.rm);
+  return result;
 }
@@ -6,11 +6,19 @@
 typedef enum instruction_type {
   DATA_PROCESSING,
   MULTIPLY,
+  SWAP,
   SINGLE_DATA_TRANSFER,
   BRANCH,
+  SOFTWARE_INTERRUPT,
   HALT
 } instr_type;
 
+// Classify an instruction word by its fixed bits
+instr_type clarify_instruction(WORD decoded);
+
+// True if the NZCV flags (CPSR bits 31..28) satisfy condition code cond
+bool cond_check(WORD nzcv, WORD cond);
+
 typedef struct data_processing {
   WORD cond;
   WORD i;
@@ -24,8 +32,6 @@ typedef struct data_processing {
 data_processing decode_data_processing(WORD src);
 WORD encode_data_processing(data_processing instr);
 
-bool execute_data_processing(State *arm_state, data_processing *params);
-
 typedef struct multiply {
   WORD cond;
   WORD a;
@@ -39,7 +45,18 @@ typedef struct multiply {
 multiply decode_multiply(WORD src);
 WORD encode_multiply(multiply instr);
 
-bool execute_multiply(State *arm_state, multiply *params);
+// SWP/SWPB: rd = [rn] and [rn] = rm as a single atomic access, even while
+// other cores run (see smp.h); rn must hold an aligned address in memory
+typedef struct swap {
+  WORD cond;
+  WORD b;
+  WORD rn;
+  WORD rd;
+  WORD rm;
+} swap;
+
+swap decode_swap(WORD src);
+WORD encode_swap(swap instr);
 
 typedef struct single_data_transfer {
   WORD cond;
@@ -55,8 +72,6 @@ typedef struct single_data_transfer {
 single_data_transfer decode_single_data_transfer(WORD src);
 WORD encode_single_data_transfer(single_data_transfer instr);
 
-bool execute_single_data_transfer(State *arm_state, single_data_transfer *params);
-
 typedef struct branch {
   WORD cond;
   WORD offset;
@@ -65,6 +80,13 @@ typedef struct branch {
 branch decode_branch(WORD src);
 WORD encode_branch(branch instr);
 
-bool execute_branch(State *arm_state, branch *params);
+// SWI; executed by the semihosting interface (see semihost.h)
+typedef struct software_interrupt {
+  WORD cond;
+  WORD comment;
+} software_interrupt;
+
+software_interrupt decode_software_interrupt(WORD src);
+WORD encode_software_interrupt(software_interrupt instr);
 
 #endif
@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "utils.h"
+#include "object.h"
+
+// usage: link -o output object [object ...]
+// The text of the objects is laid out in the given order, so the first
+// object holds the entry point; all literal pools follow the last text
+int main(int argc, char **argv) {
+  char *output_name = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "o:")) != -1) {
+    switch (opt) {
+      case 'o':
+        output_name = optarg;
+        break;
+      default:
+        fail_if(true, "Usage: link -o output object [object ...]");
+    }
+  }
+  fail_if(!output_name || optind >= argc,
+          "You must pass an output file name with -o and at least one object");
+
+  int object_n = argc - optind;
+  object **objects = calloc(object_n, sizeof(object *));
+  fail_if(!objects, "Failed to allocate memory");
+  for (int i = 0; i < object_n; i++) {
+    FILE *input_file = open_file(argv[optind + i], "rb");
+    objects[i] = object_read(input_file);
+    fclose(input_file);
+  }
+
+  WORD out_size;
+  BYTE *output = link_objects(objects, object_n, &out_size);
+
+  FILE *output_file = open_file(output_name, "wb");
+  write_binary_file(output_file, output, out_size);
+  fclose(output_file);
+
+  for (int i = 0; i < object_n; i++) {
+    object_free(objects[i]);
+  }
+  free(objects);
+  free(output);
+}
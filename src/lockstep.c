@@ -0,0 +1,192 @@
+#include "lockstep.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "utils.h"
+#include "cycle.h"
+#include "instructions.h"
+#include "semihost.h"
+
+#define REPORTED_WORD_N 8
+#define CPSR_INDEX 16
+
+static const char *type_names[] = {
+  "data processing", "multiply", "swap", "single data transfer", "branch",
+  "software interrupt", "halt"
+};
+
+void save_state(saved_state *saved, const State *arm_state) {
+  memcpy(saved->memory, arm_state->memory, MEMORY_SIZE);
+  memcpy(saved->reg, arm_state->reg, sizeof(saved->reg));
+  saved->spsr = arm_state->spsr;
+  memcpy(saved->banked, arm_state->banked, sizeof(saved->banked));
+  saved->instructions = arm_state->instructions;
+  saved->errors = arm_state->errors;
+}
+
+void restore_state(State *arm_state, const saved_state *saved) {
+  memcpy(arm_state->memory, saved->memory, MEMORY_SIZE);
+  memcpy(arm_state->reg, saved->reg, sizeof(saved->reg));
+  arm_state->spsr = saved->spsr;
+  memcpy(arm_state->banked, saved->banked, sizeof(saved->banked));
+  arm_state->instructions = saved->instructions;
+  arm_state->errors = saved->errors;
+}
+
+bool same_state(const State *a, const State *b) {
+  return a->instructions == b->instructions && a->errors == b->errors && a->spsr == b->spsr
+    && !memcmp(a->banked, b->banked, sizeof(a->banked))
+    && !memcmp(a->reg, b->reg, REGISTER_N * sizeof(WORD))
+    && !memcmp(a->memory, b->memory, MEMORY_SIZE);
+}
+
+// runs arm_state up to instruction count at, unless it already stopped
+void run_until(State *arm_state, bool *ended, uint64_t at) {
+  if (!*ended) {
+    arm_state->stop_at = at;
+    *ended = cycle(arm_state);
+  }
+}
+
+// runs both from the saved states up to instruction count at; true if
+// they agree there
+bool agree_at(State *reference, State *fast, const saved_state *saved, uint64_t at) {
+  bool ended[2] = {false, false};
+  restore_state(reference, &saved[0]);
+  restore_state(fast, &saved[1]);
+  run_until(reference, &ended[0], at);
+  run_until(fast, &ended[1], at);
+  return same_state(reference, fast);
+}
+
+void report_word(const char *field, WORD reference, WORD fast) {
+  if (reference != fast) {
+    printf("  %s: reference 0x%08x, fast 0x%08x\n", field, reference, fast);
+  }
+}
+
+// the NZCV flags of cpsr, upper case when set
+void flag_string(WORD cpsr, char *flags) {
+  for (int i = 0; i < 4; i++) {
+    flags[i] = get_bit(cpsr, 31 - i) ? "NZCV"[i] : "nzcv"[i];
+  }
+  flags[4] = '\0';
+}
+
+void report(const State *reference, const State *fast, uint64_t at, WORD pc, WORD word) {
+  printf("Error: The fast paths diverged from the reference at instruction %" PRIu64 "\n", at);
+  printf("  PC 0x%08x: 0x%08x (%s)\n", pc, word, type_names[clarify_instruction(word)]);
+  if (reference->instructions != fast->instructions) {
+    printf("  instructions: reference %" PRIu64 ", fast %" PRIu64 "\n",
+           reference->instructions, fast->instructions);
+  }
+  report_word("errors", reference->errors, fast->errors);
+  for (int i = 0; i < CPSR_INDEX; i++) {
+    char name[4];
+    sprintf(name, "r%d", i);
+    report_word(name, reference->reg[i], fast->reg[i]);
+  }
+  if (reference->reg[CPSR_INDEX] != fast->reg[CPSR_INDEX]) {
+    char reference_flags[5];
+    char fast_flags[5];
+    flag_string(reference->reg[CPSR_INDEX], reference_flags);
+    flag_string(fast->reg[CPSR_INDEX], fast_flags);
+    printf("  cpsr: reference 0x%08x (%s), fast 0x%08x (%s)\n", reference->reg[CPSR_INDEX],
+           reference_flags, fast->reg[CPSR_INDEX], fast_flags);
+  }
+  report_word("spsr", reference->spsr, fast->spsr);
+  report_word("banked r13", reference->banked[0], fast->banked[0]);
+  report_word("banked r14", reference->banked[1], fast->banked[1]);
+  int reported = 0;
+  for (WORD address = 0; address < MEMORY_SIZE && reported < REPORTED_WORD_N;
+       address += sizeof(WORD)) {
+    WORD a = read_word(reference->memory, address);
+    WORD b = read_word(fast->memory, address);
+    if (a != b) {
+      printf("  memory 0x%08x: reference 0x%08x, fast 0x%08x\n", address, a, b);
+      reported++;
+    }
+  }
+}
+
+// a host like arm_state's that discards its output, so that the reruns
+// do not print the guest's output again; NULL if arm_state has none
+semihost *discarding_host(const State *arm_state, FILE *null) {
+  if (!arm_state->host) {
+    return NULL;
+  }
+  semihost *host = semihost_create(arm_state->host->in, null);
+  host->snapshot = arm_state->host->snapshot;
+  return host;
+}
+
+// bisects (saved, bad] for the first instruction after which the
+// backends differ, and reports it
+void locate(State *reference, State *fast, const saved_state *saved, uint64_t bad) {
+  FILE *null = open_file("/dev/null", "r+");
+  semihost *hosts[2] = {reference->host, fast->host};
+  reference->host = discarding_host(reference, null);
+  fast->host = discarding_host(fast, null);
+
+  uint64_t good = saved[0].instructions;
+  while (bad - good > 1) {
+    uint64_t middle = good + (bad - good) / 2;
+    if (agree_at(reference, fast, saved, middle)) {
+      good = middle;
+    } else {
+      bad = middle;
+    }
+  }
+  // paused after good instructions, the PC is at the next one
+  agree_at(reference, fast, saved, good);
+  WORD pc = reference->reg[PC_INDEX];
+  WORD word = pc <= MEMORY_SIZE - sizeof(WORD) ? read_word(reference->memory, pc) : 0;
+  agree_at(reference, fast, saved, bad);
+  report(reference, fast, bad, pc, word);
+
+  State *states[2] = {reference, fast};
+  for (int i = 0; i < 2; i++) {
+    if (states[i]->host) {
+      semihost_free(states[i]->host);
+    }
+    states[i]->host = hosts[i];
+  }
+  fclose(null);
+}
+
+bool lockstep_run(State *reference, State *fast, uint64_t interval, uint64_t limit) {
+  reference->reference = true;
+  fast->reference = false;
+  saved_state saved[2];
+  for (int i = 0; i < 2; i++) {
+    saved[i].memory = malloc(MEMORY_SIZE);
+    fail_if(!saved[i].memory, "Failed to allocate memory");
+  }
+  save_state(&saved[0], reference);
+  save_state(&saved[1], fast);
+
+  bool ended[2] = {false, false};
+  bool agree = true;
+  while (!ended[0] || !ended[1]) {
+    uint64_t at = reference->instructions + interval;
+    if (limit && at > limit) {
+      at = limit;
+    }
+    run_until(reference, &ended[0], at);
+    run_until(fast, &ended[1], at);
+    if (!same_state(reference, fast)) {
+      locate(reference, fast, saved, at);
+      agree = false;
+      break;
+    }
+    if (limit && at == limit) {
+      break;
+    }
+    save_state(&saved[0], reference);
+    save_state(&saved[1], fast);
+  }
+
+  free(saved[0].memory);
+  free(saved[1].memory);
+  return agree;
+}
@@ -0,0 +1,44 @@
+#ifndef LOCKSTEP
+#define LOCKSTEP
+#include <stdint.h>
+#include "utils.h"
+
+// Lockstep cross-checking of the fast paths against the reference
+//
+// Two States loaded with the same program run side by side, one with
+// reference set (every instruction through execute.c) and one with
+// the fast paths (fast_forward.h). Every interval instructions both are
+// paused (see cycle()) and their registers, CPSR, SPSR, instruction
+// counts, error counts and memory compared; the memory is 64 KB, so it is
+// compared whole rather than through hashes of the pages written.
+// At the first difference, the check goes back to the last interval on
+// which the backends agreed and bisects it, rerunning both from there, to
+// the first instruction after which they differ, then reports its PC and
+// word and each field that differs
+//
+// The States must not have a scheduler (events would fire at the pauses)
+// nor share devices that keep state
+// The reruns write semihosting output nowhere, so the guest's output is
+// not repeated, but devices are not rolled back: a rerun starts from the
+// registers and memory of the checkpoint and the devices as they were at
+// the divergence, so a difference that comes from a device may move or
+// not be found
+
+#define LOCKSTEP_DEFAULT_INTERVAL 100000
+
+// What a check keeps of a State to go back to
+typedef struct saved_state {
+  BYTE *memory;
+  WORD reg[REGISTER_N];
+  WORD spsr;
+  WORD banked[2];
+  uint64_t instructions;
+  WORD errors;
+} saved_state;
+
+// Runs reference and fast until both stop, or for at most limit
+// instructions (0 for no limit); returns true if they agreed throughout,
+// and otherwise prints the report and returns false
+bool lockstep_run(State *reference, State *fast, uint64_t interval, uint64_t limit);
+
+#endif
@@ -0,0 +1,43 @@
+#include "mailbox.h"
+#include <stdlib.h>
+#include "utils.h"
+
+#define MBOX_SET 0x0
+#define MBOX_CLR 0x4
+
+mailbox *mailbox_create(void) {
+  mailbox *m = calloc(1, sizeof(mailbox));
+  fail_if(!m, "Failed to allocate memory");
+  return m;
+}
+
+bool mailbox_load(void *data, WORD offset, WORD *value, uint64_t time) {
+  mailbox *m = (mailbox *) data;
+  if (offset % 4) {
+    return false;
+  }
+  *value = m->box[offset / 8];
+  return true;
+}
+
+bool mailbox_store(void *data, WORD offset, WORD value, uint64_t time) {
+  mailbox *m = (mailbox *) data;
+  if (offset % 4) {
+    return false;
+  }
+  if (offset % 8 == MBOX_SET) {
+    m->box[offset / 8] |= value;
+  } else {
+    m->box[offset / 8] &= ~value;
+  }
+  return true;
+}
+
+void mailbox_attach(mailbox *m, bus *b) {
+  bus_register(b, (device) {"mailbox", MAILBOX_BASE, MAILBOX_SIZE,
+                            &mailbox_load, &mailbox_store, m});
+}
+
+void mailbox_free(mailbox *m) {
+  free(m);
+}
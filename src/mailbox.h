@@ -0,0 +1,29 @@
+#ifndef MAILBOX
+#define MAILBOX
+#include "utils.h"
+#include "bus.h"
+#include "smp.h"
+
+// Mailboxes for signalling between cores, a word of flags per core (as
+// the BCM2836's per-core mailboxes):
+//   0x2000d000 + 8n  MBOX_SET  writing sets the written bits in core n's
+//                              mailbox; reads the mailbox
+//   0x2000d004 + 8n  MBOX_CLR  reads core n's mailbox; writing clears the
+//                              written bits
+// A core typically polls its own MBOX_CLR and clears what it handled
+
+#define MAILBOX_BASE 0x2000D000
+#define MAILBOX_SIZE (8 * MAX_CORE_N)
+
+typedef struct {
+  WORD box[MAX_CORE_N];
+} mailbox;
+
+mailbox *mailbox_create(void);
+
+// Registers the mailboxes on b
+void mailbox_attach(mailbox *m, bus *b);
+
+void mailbox_free(mailbox *m);
+
+#endif
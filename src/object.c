@@ -0,0 +1,300 @@
+#include "object.h"
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "symbol_table.h"
+#include "assembler.h"
+#include "encode.h"
+#include "instructions.h"
+
+#define OBJECT_MAGIC 0x4f4d5241 // "ARMO"
+#define OBJECT_VERSION 1
+#define HEADER_WORDS 6
+#define SECTION_N 2
+
+// the label a line branches to, or NULL if it is not a branch to a label
+char *branch_label(char *line, char **tokens) {
+  int token_n = tokenize(line, tokens);
+  if (token_n < 2 || !is_branch_mnemonic(tokens[0]) || tokens[1][0] == '#') {
+    return NULL;
+  }
+  return tokens[1];
+}
+
+table *program_externals(program *p) {
+  table *externals = table_create();
+  char line[MAX_LINE_LENGTH];
+  char *tokens[1 + MAX_OPERAND_N];
+  const char *cursor = p->source;
+  const char *end = p->source + p->source_size;
+  while (read_line(&cursor, end, line, sizeof(line))) {
+    if (is_label(line) || is_empty(line)) {
+      continue;
+    }
+    WORD address;
+    char *label = branch_label(line, tokens);
+    if (label && !table_get(p->sym_table, label, &address)) {
+      // any value will do, the linker rewrites the whole offset
+      table_insert(externals, label, 0);
+      table_insert(p->sym_table, label, 0);
+    }
+  }
+  return externals;
+}
+
+WORD add_string(object *o, const char *string, WORD *capacity) {
+  WORD offset = o->strings_size;
+  WORD length = strlen(string) + 1;
+  while (o->strings_size + length > *capacity) {
+    o->strings = reserve(o->strings, *capacity, capacity, sizeof(char));
+  }
+  memcpy(o->strings + offset, string, length);
+  o->strings_size += length;
+  return offset;
+}
+
+void add_symbol(object *o, const char *name, WORD section, WORD value,
+                WORD *capacity, WORD *strings_capacity) {
+  o->symbols = reserve(o->symbols, o->symbol_n, capacity, sizeof(object_symbol));
+  WORD offset = add_string(o, name, strings_capacity);
+  o->symbols[o->symbol_n++] = (object_symbol) {offset, section, value};
+}
+
+void add_relocation(object *o, WORD type, WORD offset, WORD target, WORD *capacity) {
+  o->relocations = reserve(o->relocations, o->relocation_n, capacity, sizeof(relocation));
+  o->relocations[o->relocation_n++] = (relocation) {type, offset, target};
+}
+
+object *object_create(program *p, table *externals, const BYTE *output) {
+  object *o = calloc(1, sizeof(object));
+  fail_if(!o, "Failed to allocate memory");
+  o->text_size = p->code_size;
+  o->pool_size = p->out_size - p->code_size;
+  o->text = malloc(o->text_size + 1);
+  o->pool = malloc(o->pool_size + 1);
+  fail_if(!o->text || !o->pool, "Failed to allocate memory");
+  memcpy(o->text, output, o->text_size);
+  memcpy(o->pool, output + p->code_size, o->pool_size);
+
+  // externals come first so that their index is their position in the table
+  WORD symbol_capacity = 0;
+  WORD strings_capacity = 0;
+  WORD value;
+  for (node *n = externals->start; n; n = n->next) {
+    add_symbol(o, n->key, UNDEFINED_SECTION, 0, &symbol_capacity, &strings_capacity);
+  }
+  for (node *n = p->sym_table->start; n; n = n->next) {
+    if (!table_get(externals, n->key, &value)) {
+      add_symbol(o, n->key, TEXT_SECTION, n->value, &symbol_capacity, &strings_capacity);
+    }
+  }
+
+  WORD relocation_capacity = 0;
+  WORD address = 0;
+  WORD pool_offset = 0;
+  char line[MAX_LINE_LENGTH];
+  const char *cursor = p->source;
+  const char *end = p->source + p->source_size;
+  while (read_line(&cursor, end, line, sizeof(line))) {
+    if (is_label(line) || is_empty(line)) {
+      continue;
+    }
+    char *tokens[1 + MAX_OPERAND_N] = {NULL};
+    WORD pool_size = literal_pool_size(line);
+    if (pool_size) {
+      add_relocation(o, LITERAL_RELOCATION, address, pool_offset, &relocation_capacity);
+      pool_offset += pool_size;
+    }
+    WORD instr = read_word(o->text, address);
+    char *label = branch_label(line, tokens);
+    WORD index = 0;
+    for (node *n = externals->start; label && n; n = n->next, index++) {
+      if (!strcmp(n->key, label)) {
+        add_relocation(o, BRANCH_RELOCATION, address, index, &relocation_capacity);
+        break;
+      }
+    }
+    if (!label && tokens[0] && is_branch_mnemonic(tokens[0])) {
+      // absolute target, recovered from the encoded offset
+      WORD offset = decode_branch(instr).offset << 2;
+      if (get_bit(offset, 25)) {
+        offset |= 0x3F << 26;
+      }
+      add_relocation(o, ABSOLUTE_RELOCATION, address, address + 8 + offset,
+                     &relocation_capacity);
+    }
+    address += 4;
+  }
+  return o;
+}
+
+void object_write(object *o, FILE *file) {
+  WORD strings_padded = (o->strings_size + 3) & ~3u;
+  WORD data_offset = sizeof(WORD) * (HEADER_WORDS + 3 * SECTION_N
+                     + 3 * o->symbol_n + 3 * o->relocation_n) + strings_padded;
+  WORD header[HEADER_WORDS] = {OBJECT_MAGIC, OBJECT_VERSION, SECTION_N,
+                               o->symbol_n, o->relocation_n, o->strings_size};
+  object_section sections[SECTION_N] = {
+    {TEXT_SECTION, data_offset, o->text_size},
+    {POOL_SECTION, data_offset + o->text_size, o->pool_size}
+  };
+  BYTE padding[4] = {0};
+
+  fwrite(header, sizeof(WORD), HEADER_WORDS, file);
+  fwrite(sections, sizeof(object_section), SECTION_N, file);
+  fwrite(o->symbols, sizeof(object_symbol), o->symbol_n, file);
+  fwrite(o->relocations, sizeof(relocation), o->relocation_n, file);
+  fwrite(o->strings, sizeof(char), o->strings_size, file);
+  fwrite(padding, sizeof(BYTE), strings_padded - o->strings_size, file);
+  fwrite(o->text, sizeof(BYTE), o->text_size, file);
+  fwrite(o->pool, sizeof(BYTE), o->pool_size, file);
+}
+
+void read_exactly(void *buffer, size_t size, size_t n, FILE *file) {
+  fail_if(fread(buffer, size, n, file) != n, "Malformed object file");
+}
+
+object *object_read(FILE *file) {
+  object *o = calloc(1, sizeof(object));
+  fail_if(!o, "Failed to allocate memory");
+  WORD header[HEADER_WORDS];
+  read_exactly(header, sizeof(WORD), HEADER_WORDS, file);
+  fail_if(header[0] != OBJECT_MAGIC || header[1] != OBJECT_VERSION,
+    "Not an object file of this assembler");
+  WORD section_n = header[2];
+  o->symbol_n = header[3];
+  o->relocation_n = header[4];
+  o->strings_size = header[5];
+
+  object_section *sections = calloc(section_n + 1, sizeof(object_section));
+  o->symbols = calloc(o->symbol_n + 1, sizeof(object_symbol));
+  o->relocations = calloc(o->relocation_n + 1, sizeof(relocation));
+  o->strings = calloc(o->strings_size + 1, sizeof(char));
+  fail_if(!sections || !o->symbols || !o->relocations || !o->strings,
+    "Failed to allocate memory");
+  read_exactly(sections, sizeof(object_section), section_n, file);
+  read_exactly(o->symbols, sizeof(object_symbol), o->symbol_n, file);
+  read_exactly(o->relocations, sizeof(relocation), o->relocation_n, file);
+  read_exactly(o->strings, sizeof(char), o->strings_size, file);
+
+  for (WORD i = 0; i < section_n; i++) {
+    BYTE **data = sections[i].type == TEXT_SECTION ? &o->text : &o->pool;
+    WORD *size = sections[i].type == TEXT_SECTION ? &o->text_size : &o->pool_size;
+    fail_if(sections[i].type > POOL_SECTION || *data, "Malformed object file");
+    *size = sections[i].size;
+    *data = malloc(*size + 1);
+    fail_if(!*data, "Failed to allocate memory");
+    fail_if(fseek(file, sections[i].file_offset, SEEK_SET), "Malformed object file");
+    read_exactly(*data, sizeof(BYTE), *size, file);
+  }
+  free(sections);
+  fail_if(!o->text || !o->pool, "Malformed object file");
+
+  for (WORD i = 0; i < o->symbol_n; i++) {
+    fail_if(o->symbols[i].name >= o->strings_size, "Malformed object file");
+  }
+  for (WORD i = 0; i < o->relocation_n; i++) {
+    relocation *r = &o->relocations[i];
+    bool valid = r->offset + 4 <= o->text_size && r->offset % 4 == 0;
+    if (r->type == BRANCH_RELOCATION) {
+      valid &= r->target < o->symbol_n;
+    } else if (r->type == LITERAL_RELOCATION) {
+      valid &= r->target + 4 <= o->pool_size;
+    } else {
+      valid &= r->type == ABSOLUTE_RELOCATION;
+    }
+    fail_if(!valid, "Malformed object file");
+  }
+  return o;
+}
+
+void object_free(object *o) {
+  free(o->text);
+  free(o->pool);
+  free(o->symbols);
+  free(o->relocations);
+  free(o->strings);
+  free(o);
+}
+
+void fail_for_label(const char *message, const char *label) {
+  char buffer[MAX_LINE_LENGTH + 64];
+  snprintf(buffer, sizeof(buffer), "%s: %.*s", message, MAX_LINE_LENGTH, label);
+  fail_if(true, buffer);
+}
+
+BYTE *link_objects(object **objects, int object_n, WORD *out_size) {
+  WORD *text_base = calloc(object_n + 1, sizeof(WORD));
+  WORD *pool_base = calloc(object_n + 1, sizeof(WORD));
+  fail_if(!text_base || !pool_base, "Failed to allocate memory");
+  WORD size = 0;
+  for (int i = 0; i < object_n; i++) {
+    text_base[i] = size;
+    size += objects[i]->text_size;
+  }
+  for (int i = 0; i < object_n; i++) {
+    pool_base[i] = size;
+    size += objects[i]->pool_size;
+  }
+
+  // labels defined by more than one module can not be referenced across them
+  table *globals = table_create();
+  table *ambiguous = table_create();
+  for (int i = 0; i < object_n; i++) {
+    for (WORD j = 0; j < objects[i]->symbol_n; j++) {
+      object_symbol *s = &objects[i]->symbols[j];
+      const char *name = objects[i]->strings + s->name;
+      WORD value;
+      if (s->section != TEXT_SECTION) {
+        continue;
+      }
+      if (table_get(globals, name, &value)) {
+        table_insert(ambiguous, name, 0);
+      }
+      table_insert(globals, name, text_base[i] + s->value);
+    }
+  }
+
+  BYTE *image = calloc(size + 1, sizeof(BYTE));
+  fail_if(!image, "Failed to allocate memory");
+  for (int i = 0; i < object_n; i++) {
+    memcpy(image + text_base[i], objects[i]->text, objects[i]->text_size);
+    memcpy(image + pool_base[i], objects[i]->pool, objects[i]->pool_size);
+  }
+
+  for (int i = 0; i < object_n; i++) {
+    for (WORD j = 0; j < objects[i]->relocation_n; j++) {
+      relocation *r = &objects[i]->relocations[j];
+      WORD address = text_base[i] + r->offset;
+      WORD instr = read_word(image, address);
+      if (r->type == LITERAL_RELOCATION) {
+        WORD offset = pool_base[i] + r->target - address - 8;
+        fail_if(offset > 0xFFF, "Literal pool is out of reach of a load");
+        single_data_transfer params = decode_single_data_transfer(instr);
+        params.offset = offset;
+        write_word(image, address, encode_single_data_transfer(params));
+        continue;
+      }
+      WORD target = r->target;
+      if (r->type == BRANCH_RELOCATION) {
+        const char *name = objects[i]->strings + objects[i]->symbols[r->target].name;
+        if (table_get(ambiguous, name, &target)) {
+          fail_for_label("Label defined in more than one object", name);
+        }
+        if (!table_get(globals, name, &target)) {
+          fail_for_label("Cannot branch to a non-existent label", name);
+        }
+      }
+      branch params = decode_branch(instr);
+      params.offset = get_bits((target - address - 8) >> 2, 0, 23);
+      write_word(image, address, encode_branch(params));
+    }
+  }
+
+  table_free(globals);
+  table_free(ambiguous);
+  free(text_base);
+  free(pool_base);
+  *out_size = size;
+  return image;
+}
@@ -0,0 +1,84 @@
+#ifndef OBJECT
+#define OBJECT
+#include <stdio.h>
+#include "utils.h"
+#include "symbol_table.h"
+#include "assembler.h"
+
+// Relocatable object file layout (all fields are little-endian WORDs):
+//   header      magic, version, section_n, symbol_n, relocation_n, strings_size
+//   sections    section_n x {type, file offset, size}
+//   symbols     symbol_n x {name offset, section, value}
+//   relocations relocation_n x {type, offset in .text, target}
+//   strings     NUL-terminated names
+//   data        contents of the sections
+//
+// Branches to labels of the same module are resolved by the assembler since
+// a module's text is never split; only branches to labels the module does
+// not define, absolute branches and literal loads need relocating.
+
+typedef enum section_type {
+  TEXT_SECTION,
+  POOL_SECTION,
+  UNDEFINED_SECTION   // section of a symbol the module only references
+} section_type;
+
+typedef enum relocation_type {
+  BRANCH_RELOCATION,    // target: symbol index
+  ABSOLUTE_RELOCATION,  // target: absolute branch address
+  LITERAL_RELOCATION    // target: offset of the literal in .pool
+} relocation_type;
+
+typedef struct {
+  WORD type;
+  WORD file_offset;
+  WORD size;
+} object_section;
+
+typedef struct {
+  WORD name;
+  WORD section;
+  WORD value;
+} object_symbol;
+
+typedef struct {
+  WORD type;
+  WORD offset;
+  WORD target;
+} relocation;
+
+typedef struct {
+  BYTE *text;
+  WORD text_size;
+  BYTE *pool;
+  WORD pool_size;
+  object_symbol *symbols;
+  WORD symbol_n;
+  relocation *relocations;
+  WORD relocation_n;
+  char *strings;
+  WORD strings_size;
+} object;
+
+// Adds every label the program branches to but does not define to its
+// symbol table, so the second pass can encode those branches
+// Returns the table of these external labels
+table *program_externals(program *p);
+
+// Builds the object of an encoded program; externals are the labels
+// returned by program_externals
+object *object_create(program *p, table *externals, const BYTE *output);
+
+void object_write(object *o, FILE *file);
+
+// Reads an object file, exits if it is malformed
+object *object_read(FILE *file);
+
+void object_free(object *o);
+
+// Lays out the text of every object in order followed by all of their
+// literal pools, resolves labels across objects and patches relocations
+// Returns the image and stores its size at out_size
+BYTE *link_objects(object **objects, int object_n, WORD *out_size);
+
+#endif
@@ -0,0 +1,236 @@
+#include "peephole.h"
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "instructions.h"
+#include "encode.h"
+
+#define MOV_OPCODE 13
+#define MAX_BRANCH_HOPS 16
+
+bool is_branch(WORD instr) {
+  return clarify_instruction(instr) == BRANCH && get_bit(instr, 25);
+}
+
+WORD branch_target(WORD address, WORD instr) {
+  WORD delta = decode_branch(instr).offset << 2;
+  if (get_bit(delta, 25)) {
+    delta |= 0x3F << 26;
+  }
+  return address + 8 + delta;
+}
+
+WORD retarget_branch(WORD address, WORD instr, WORD target) {
+  branch params = decode_branch(instr);
+  params.offset = get_bits((target - address - 8) >> 2, 0, 23);
+  return encode_branch(params);
+}
+
+// a load of a literal from the pool: ldr rd,[pc,#offset]
+bool is_pool_load(WORD instr, WORD address, WORD code_size, WORD out_size) {
+  if (clarify_instruction(instr) != SINGLE_DATA_TRANSFER) {
+    return false;
+  }
+  single_data_transfer params = decode_single_data_transfer(instr);
+  WORD target = address + 8 + params.offset;
+  return params.l && params.p && params.u && !params.i && params.rn == 15
+         && target >= code_size && target + 4 <= out_size && target % 4 == 0;
+}
+
+WORD pool_target(WORD instr, WORD address) {
+  return address + 8 + decode_single_data_transfer(instr).offset;
+}
+
+bool is_data_processing(WORD instr) {
+  return clarify_instruction(instr) == DATA_PROCESSING;
+}
+
+// op rd,rn,rm with an unshifted register rm as operand2
+bool has_register_operand(data_processing params) {
+  return !params.i && get_bits(params.operand2, 4, 11) == 0;
+}
+
+// opcodes that write their result to rd
+bool writes_result(WORD opcode) {
+  return opcode <= 4 || opcode == 12;
+}
+
+// an instruction that reads r15 as a value, which removing an
+// instruction before it would change; pool loads are relocated instead
+bool reads_pc(WORD instr, WORD address, WORD code_size, WORD out_size) {
+  switch (clarify_instruction(instr)) {
+    case DATA_PROCESSING: {
+      data_processing params = decode_data_processing(instr);
+      return params.rn == 15 || (!params.i && (get_bits(params.operand2, 0, 3) == 15
+             || (get_bit(params.operand2, 4) && get_bits(params.operand2, 8, 11) == 15)));
+    }
+    case MULTIPLY: {
+      multiply params = decode_multiply(instr);
+      return params.rm == 15 || params.rs == 15 || (params.a && params.rn == 15);
+    }
+    case SWAP:
+      return decode_swap(instr).rn == 15;
+    case SINGLE_DATA_TRANSFER: {
+      single_data_transfer params = decode_single_data_transfer(instr);
+      return (params.rn == 15 && !is_pool_load(instr, address, code_size, out_size))
+             || (params.i && get_bits(params.offset, 0, 3) == 15);
+    }
+    default:
+      return false;
+  }
+}
+
+WORD peephole(BYTE *image, WORD code_size, WORD out_size, WORD *address_map) {
+  WORD n = code_size / 4;
+  WORD *code = calloc(n + 1, sizeof(WORD));
+  bool *deleted = calloc(n + 1, sizeof(bool));
+  bool *targeted = calloc(n + 1, sizeof(bool));
+  WORD *new_address = calloc(n + 1, sizeof(WORD));
+  WORD pool_n = (out_size - code_size) / 4;
+  bool *pool_used = calloc(pool_n + 1, sizeof(bool));
+  WORD *new_pool = calloc(pool_n + 1, sizeof(WORD));
+  fail_if(!code || !deleted || !targeted || !new_address || !pool_used || !new_pool,
+    "Failed to allocate memory");
+  for (WORD i = 0; i < n; i++) {
+    code[i] = read_word(image, 4 * i);
+  }
+
+  // instructions that can be reached other than from the one before them
+  for (WORD i = 0; i < n; i++) {
+    if (is_branch(code[i])) {
+      WORD target = branch_target(4 * i, code[i]);
+      if (target < code_size && target % 4 == 0) {
+        targeted[target / 4] = true;
+      }
+    }
+  }
+
+  for (WORD i = 0; i < n; i++) {
+    WORD instr = code[i];
+    WORD address = 4 * i;
+
+    // branch to unconditional branch: follow the chain, a bounded number
+    // of hops since a cycle of branches would otherwise cost n each time
+    if (is_branch(instr)) {
+      WORD target = branch_target(address, instr);
+      for (WORD hop = 0; hop < MAX_BRANCH_HOPS && target < code_size && target % 4 == 0; hop++) {
+        WORD next = code[target / 4];
+        if (!is_branch(next) || decode_branch(next).cond != 14
+            || branch_target(target, next) == target) {
+          break;
+        }
+        target = branch_target(target, next);
+      }
+      code[i] = retarget_branch(address, instr, target);
+    }
+
+    // ldr rX,=const with a constant that fits an immediate
+    WORD operand2;
+    if (is_pool_load(instr, address, code_size, out_size)
+        && encode_immediate(read_word(image, pool_target(instr, address)), &operand2)) {
+      single_data_transfer load = decode_single_data_transfer(instr);
+      data_processing mov = {load.cond, 1, MOV_OPCODE, 0, 0, load.rd, operand2};
+      code[i] = encode_data_processing(mov);
+    }
+  }
+
+  // removing an instruction moves every later one, so it is only safe
+  // when nothing but pool loads (relocated below) depends on the pc
+  bool pc_read = false;
+  for (WORD i = 0; i < n; i++) {
+    pc_read |= reads_pc(code[i], 4 * i, code_size, out_size);
+  }
+
+  for (WORD i = 0; i < n && !pc_read; i++) {
+    if (!is_data_processing(code[i])) {
+      continue;
+    }
+    data_processing params = decode_data_processing(code[i]);
+
+    // mov rX,rX does nothing
+    if (params.opcode == MOV_OPCODE && !params.s && has_register_operand(params)
+        && get_bits(params.operand2, 0, 3) == params.rd) {
+      deleted[i] = true;
+      continue;
+    }
+
+    // mov rX,#imm; op rX,rn,rX => op rX,rn,#imm
+    // rX is overwritten by op, so the mov is dead afterwards
+    if (params.opcode != MOV_OPCODE || !params.i || params.s || params.cond != 14
+        || i + 1 >= n || targeted[i + 1] || !is_data_processing(code[i + 1])) {
+      continue;
+    }
+    data_processing op = decode_data_processing(code[i + 1]);
+    if (op.cond == 14 && writes_result(op.opcode) && has_register_operand(op)
+        && op.rd == params.rd && op.operand2 == params.rd && op.rn != params.rd
+        && op.rn != 15) {
+      op.i = 1;
+      op.operand2 = params.operand2;
+      code[i + 1] = encode_data_processing(op);
+      deleted[i] = true;
+    }
+  }
+
+  // new layout: deleted instructions map to the next kept one
+  WORD new_code_size = 0;
+  for (WORD i = 0; i < n; i++) {
+    new_address[i] = new_code_size;
+    if (!deleted[i]) {
+      new_code_size += 4;
+      if (is_pool_load(code[i], 4 * i, code_size, out_size)) {
+        pool_used[(pool_target(code[i], 4 * i) - code_size) / 4] = true;
+      }
+    }
+  }
+  new_address[n] = new_code_size;
+  WORD new_size = new_code_size;
+  for (WORD i = 0; i < pool_n; i++) {
+    new_pool[i] = new_size;
+    if (pool_used[i]) {
+      new_size += 4;
+    }
+  }
+
+  BYTE *pool = malloc(out_size - code_size + 1);
+  fail_if(!pool, "Failed to allocate memory");
+  memcpy(pool, image + code_size, out_size - code_size);
+
+  for (WORD i = 0; i < n; i++) {
+    if (deleted[i]) {
+      continue;
+    }
+    WORD instr = code[i];
+    WORD address = new_address[i];
+    if (is_branch(instr)) {
+      WORD target = branch_target(4 * i, instr);
+      // targets outside the code keep their absolute address
+      if (target <= code_size && target % 4 == 0) {
+        target = new_address[target / 4];
+      }
+      instr = retarget_branch(address, instr, target);
+    } else if (is_pool_load(instr, 4 * i, code_size, out_size)) {
+      single_data_transfer params = decode_single_data_transfer(instr);
+      params.offset = new_pool[(pool_target(instr, 4 * i) - code_size) / 4] - address - 8;
+      instr = encode_single_data_transfer(params);
+    }
+    write_word(image, address, instr);
+  }
+  for (WORD i = 0; i < pool_n; i++) {
+    if (pool_used[i]) {
+      memcpy(image + new_pool[i], pool + 4 * i, sizeof(WORD));
+    }
+  }
+  memset(image + new_size, 0, out_size - new_size);
+  if (address_map) {
+    memcpy(address_map, new_address, (n + 1) * sizeof(WORD));
+  }
+
+  free(pool);
+  free(code);
+  free(deleted);
+  free(targeted);
+  free(new_address);
+  free(pool_used);
+  free(new_pool);
+  return new_size;
+}
@@ -0,0 +1,22 @@
+#ifndef PEEPHOLE
+#define PEEPHOLE
+#include "utils.h"
+
+// Peephole optimisation of an assembled image: code_size bytes of
+// instructions followed by the literal pool, out_size bytes in total
+// - branches to unconditional branches go straight to the final target,
+//   following chains of up to 16 branches
+// - ldr rX,=const becomes mov rX,#const when const is a rotated immediate
+// - mov rX,rX is removed
+// - mov rX,#imm followed by op rX,rn,rX takes the immediate directly
+// Removed instructions and unused literals shrink the image; branch and
+// literal offsets are recomputed for the new layout. Any other read of
+// r15 would see the new layout, so if the code has one no instruction
+// is removed
+// If address_map is not NULL it receives the new address of each of the
+// code_size / 4 instructions, followed by the new code size; a removed
+// instruction maps to the address of the next one kept
+// Returns the new image size
+WORD peephole(BYTE *image, WORD code_size, WORD out_size, WORD *address_map);
+
+#endif
@@ -0,0 +1,477 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "utils.h"
+
+// seconds a stage may run before it is killed
+#define STAGE_TIMEOUT 10
+// differences below this are noise, whatever the threshold
+#define NOISE_SECONDS 0.01
+#define MAX_PATH 4096
+#define MAX_MESSAGE 256
+#define MAX_SHOWN_LINE 60
+
+typedef enum {
+  COMPILE,                 // .spl to .s, compared with the .s of the case
+  ASSEMBLE,                // .s to .bin, compared with golden/NAME.bin
+  EMULATE,                 // .bin to the final state, compared with golden/NAME.out
+  STAGE_N
+} stage;
+
+static const char *stage_names[] = {"compile", "assemble", "emulate"};
+static const char *golden_extensions[] = {".s", ".bin", ".out"};
+
+typedef struct {
+  char *name;
+  bool ran[STAGE_N];
+  double seconds[STAGE_N];  // fastest run
+  char error[MAX_MESSAGE];  // the first failure, empty if none
+  char slow[MAX_MESSAGE];   // the stages slower than the baseline
+} regress_case;
+
+typedef struct {
+  char *name;
+  stage s;
+  double seconds;
+} baseline_entry;
+
+typedef struct {
+  regress_case *cases;
+  WORD case_n;
+  WORD next;               // next case to hand out, shared by the workers
+  const char *directory;
+  const char *golden;
+  const char *work;
+  const char *compiler;
+  int runs;
+  bool update;
+} regress;
+
+double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// runs argv with its standard output in out_name, and returns its wall
+// time; *status is its exit status, or -1 if it was killed
+double run_stage(char **argv, const char *out_name, int *status) {
+  double start = now();
+  pid_t pid = fork();
+  fail_if(pid < 0, "Failed to start a stage");
+  if (pid == 0) {
+    int fd = open(out_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || dup2(fd, STDOUT_FILENO) < 0) {
+      _exit(127);
+    }
+    alarm(STAGE_TIMEOUT);
+    execvp(argv[0], argv);
+    _exit(127);
+  }
+  int wait_status;
+  fail_if(waitpid(pid, &wait_status, 0) != pid, "Failed to wait for a stage");
+  *status = WIFEXITED(wait_status) ? WEXITSTATUS(wait_status) : -1;
+  return now() - start;
+}
+
+// the whole file, NUL terminated, or NULL if it can not be read
+char *read_file(const char *name, size_t *size) {
+  FILE *file = fopen(name, "rb");
+  if (!file) {
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  long length = ftell(file);
+  rewind(file);
+  char *data = malloc(length + 1);
+  fail_if(!data, "Failed to allocate memory");
+  *size = fread(data, 1, length, file);
+  data[*size] = '\0';
+  fclose(file);
+  return data;
+}
+
+bool write_file(const char *name, const char *data, size_t size) {
+  FILE *file = fopen(name, "wb");
+  if (!file) {
+    return false;
+  }
+  bool written = fwrite(data, 1, size, file) == size;
+  return fclose(file) == 0 && written;
+}
+
+// copies the line of text starting at line, shortened, into shown
+void show_line(const char *line, const char *end, char *shown) {
+  size_t length = 0;
+  while (line + length < end && line[length] != '\n' && length < MAX_SHOWN_LINE) {
+    length++;
+  }
+  memcpy(shown, line, length);
+  shown[length] = '\0';
+}
+
+// describes the first difference between expected and actual into
+// message; text is compared by line, anything else by byte
+void describe_difference(const char *expected, size_t expected_size, const char *actual,
+                         size_t actual_size, bool text, char *message) {
+  size_t i = 0;
+  WORD line = 1;
+  const char *line_start = expected;
+  while (i < expected_size && i < actual_size && expected[i] == actual[i]) {
+    if (expected[i++] == '\n') {
+      line++;
+      line_start = expected + i;
+    }
+  }
+  if (!text) {
+    snprintf(message, MAX_MESSAGE, "byte 0x%zx: expected %s, got %s", i,
+             i < expected_size ? "more" : "end", i < actual_size ? "more" : "end");
+    if (i < expected_size && i < actual_size) {
+      snprintf(message, MAX_MESSAGE, "byte 0x%zx: expected 0x%02x, got 0x%02x", i,
+               (BYTE) expected[i], (BYTE) actual[i]);
+    }
+    return;
+  }
+  char expected_line[MAX_SHOWN_LINE + 1];
+  char actual_line[MAX_SHOWN_LINE + 1];
+  size_t offset = line_start - expected;
+  show_line(line_start, expected + expected_size, expected_line);
+  show_line(actual + offset, actual + actual_size, actual_line);
+  snprintf(message, MAX_MESSAGE, "line %u: expected \"%s\", got \"%s\"", line,
+           expected_line, actual_line);
+}
+
+// notes the failure in c->error, unless an earlier stage failed: the
+// first failure is the one reported
+void fail_case(regress_case *c, const char *format, ...) {
+  if (c->error[0]) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  vsnprintf(c->error, MAX_MESSAGE, format, args);
+  va_end(args);
+}
+
+// compares the output of a stage with its golden file, or makes it the
+// golden file when updating
+void check_output(regress *r, regress_case *c, stage s, const char *output,
+                  const char *golden) {
+  size_t actual_size;
+  char *actual = read_file(output, &actual_size);
+  if (!actual) {
+    fail_case(c, "%s: no output", stage_names[s]);
+    return;
+  }
+  if (r->update && s != COMPILE) {
+    if (!write_file(golden, actual, actual_size)) {
+      fail_case(c, "%s: failed to write %s", stage_names[s], golden);
+    }
+  } else {
+    size_t expected_size;
+    char *expected = read_file(golden, &expected_size);
+    if (!expected) {
+      fail_case(c, "%s: no golden file %s", stage_names[s], golden);
+    } else if (expected_size != actual_size || memcmp(expected, actual, actual_size)) {
+      char difference[MAX_MESSAGE];
+      describe_difference(expected, expected_size, actual, actual_size, s != ASSEMBLE,
+                          difference);
+      fail_case(c, "%s: %s", stage_names[s], difference);
+    }
+    free(expected);
+  }
+  free(actual);
+}
+
+// runs one stage of a case runs times, keeping the fastest time, and
+// checks its output; the emulator's exit status is part of its output
+void run_case_stage(regress *r, regress_case *c, stage s, char **argv, const char *output,
+                    const char *golden) {
+  int status = 0;
+  for (int run = 0; run < r->runs; run++) {
+    double seconds = run_stage(argv, s == EMULATE ? output : "/dev/null", &status);
+    if (!c->ran[s] || seconds < c->seconds[s]) {
+      c->seconds[s] = seconds;
+    }
+    c->ran[s] = true;
+  }
+  if (status == -1) {
+    fail_case(c, "%s: killed (timeout %ds)", stage_names[s], STAGE_TIMEOUT);
+    return;
+  }
+  if (s == EMULATE && status) {
+    FILE *file = fopen(output, "a");
+    if (file) {
+      fprintf(file, "Exit status: %d\n", status);
+      fclose(file);
+    }
+  } else if (status) {
+    fail_case(c, "%s: exit status %d", stage_names[s], status);
+    return;
+  }
+  check_output(r, c, s, output, golden);
+}
+
+// the stages are independent: the case's own .s is assembled even when
+// the compiled one differs from it
+void run_case(regress *r, regress_case *c) {
+  char source[MAX_PATH];
+  char spl[MAX_PATH];
+  char paths[STAGE_N][2][MAX_PATH];  // output and golden file of each stage
+  snprintf(source, MAX_PATH, "%s/%s.s", r->directory, c->name);
+  snprintf(spl, MAX_PATH, "%s/%s.spl", r->directory, c->name);
+  for (int s = 0; s < STAGE_N; s++) {
+    snprintf(paths[s][0], MAX_PATH, "%s/%s%s", r->work, c->name, golden_extensions[s]);
+    snprintf(paths[s][1], MAX_PATH, "%s/%s%s", s == COMPILE ? r->directory : r->golden,
+             c->name, golden_extensions[s]);
+  }
+
+  if (r->compiler && access(spl, R_OK) == 0) {
+    char *argv[] = {(char *) r->compiler, spl, paths[COMPILE][0], NULL};
+    run_case_stage(r, c, COMPILE, argv, paths[COMPILE][0], paths[COMPILE][1]);
+  }
+  char *assemble[] = {"./assemble", source, paths[ASSEMBLE][0], NULL};
+  run_case_stage(r, c, ASSEMBLE, assemble, paths[ASSEMBLE][0], paths[ASSEMBLE][1]);
+  // a binary that differs from the golden one is still run
+  if (access(paths[ASSEMBLE][0], R_OK) == 0) {
+    char *emulate[] = {"./emulate", paths[ASSEMBLE][0], NULL};
+    run_case_stage(r, c, EMULATE, emulate, paths[EMULATE][0], paths[EMULATE][1]);
+  }
+}
+
+void *regress_worker(void *arg) {
+  regress *r = (regress *) arg;
+  WORD i;
+  while ((i = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED)) < r->case_n) {
+    run_case(r, &r->cases[i]);
+  }
+  return NULL;
+}
+
+int select_source(const struct dirent *entry) {
+  size_t length = strlen(entry->d_name);
+  return length > 2 && !strcmp(entry->d_name + length - 2, ".s");
+}
+
+// the cases are the .s files of directory, in name order
+void find_cases(regress *r) {
+  struct dirent **entries;
+  int n = scandir(r->directory, &entries, &select_source, &alphasort);
+  fail_if(n < 0, "Failed to read the case directory");
+  r->cases = calloc(n ? n : 1, sizeof(regress_case));
+  fail_if(!r->cases, "Failed to allocate memory");
+  for (int i = 0; i < n; i++) {
+    r->cases[i].name = strndup(entries[i]->d_name, strlen(entries[i]->d_name) - 2);
+    fail_if(!r->cases[i].name, "Failed to allocate memory");
+    free(entries[i]);
+  }
+  free(entries);
+  r->case_n = n;
+}
+
+// lines of "case stage seconds"; no file is an empty baseline
+baseline_entry *read_baseline(const char *name, WORD *n) {
+  *n = 0;
+  FILE *file = fopen(name, "r");
+  if (!file) {
+    return NULL;
+  }
+  baseline_entry *entries = NULL;
+  WORD capacity = 0;
+  char case_name[MAX_PATH];
+  char stage_name[16];
+  double seconds;
+  while (fscanf(file, "%4095s %15s %lf", case_name, stage_name, &seconds) == 3) {
+    for (int s = 0; s < STAGE_N; s++) {
+      if (!strcmp(stage_name, stage_names[s])) {
+        entries = reserve(entries, *n, &capacity, sizeof(baseline_entry));
+        entries[*n] = (baseline_entry) {strdup(case_name), s, seconds};
+        fail_if(!entries[(*n)++].name, "Failed to allocate memory");
+      }
+    }
+  }
+  fclose(file);
+  return entries;
+}
+
+void write_baseline(const char *name, const regress *r) {
+  FILE *file = fopen(name, "w");
+  fail_if(!file, "Failed to write the timing baseline");
+  for (WORD i = 0; i < r->case_n; i++) {
+    for (int s = 0; s < STAGE_N; s++) {
+      if (r->cases[i].ran[s]) {
+        fprintf(file, "%s %s %.6f\n", r->cases[i].name, stage_names[s], r->cases[i].seconds[s]);
+      }
+    }
+  }
+  fclose(file);
+}
+
+// notes in c->slow the stages slower than their baseline by more than
+// threshold percent (and than the noise); returns true if any was
+bool compare_timing(regress_case *c, const baseline_entry *baseline, WORD baseline_n,
+                    double threshold) {
+  for (WORD i = 0; i < baseline_n; i++) {
+    const baseline_entry *b = &baseline[i];
+    if (strcmp(b->name, c->name) || !c->ran[b->s]) {
+      continue;
+    }
+    double seconds = c->seconds[b->s];
+    if (seconds > b->seconds * (1 + threshold / 100) && seconds - b->seconds > NOISE_SECONDS) {
+      size_t used = strlen(c->slow);
+      snprintf(c->slow + used, MAX_MESSAGE - used, "%s%s %.4fs (baseline %.4fs)",
+               used ? ", " : "", stage_names[b->s], seconds, b->seconds);
+    }
+  }
+  return c->slow[0];
+}
+
+void remove_work(const regress *r) {
+  for (WORD i = 0; i < r->case_n; i++) {
+    for (int s = 0; s < STAGE_N; s++) {
+      char path[MAX_PATH];
+      snprintf(path, MAX_PATH, "%s/%s%s", r->work, r->cases[i].name, golden_extensions[s]);
+      remove(path);
+    }
+  }
+  rmdir(r->work);
+}
+
+// usage: regress [-j workers] [-n runs] [-g golden] [-c compiler]
+//                [-b baseline] [-t percent] [-u] directory
+// Runs every case of directory (a NAME.s, with NAME.spl if -c names an
+// SPL compiler, run as "compiler NAME.spl out.s") through its stages on
+// -j workers (one per core by default), with ./assemble and ./emulate:
+//   compile   the compiled .spl must be NAME.s
+//   assemble  the binary must be golden/NAME.bin
+//   emulate   the state printed (and the exit status, if not 0) must be
+//             golden/NAME.out
+// -g names the golden directory, directory/golden by default; -u writes
+// the golden files from this run instead of checking them
+// Each stage is timed, the fastest of -n runs, and compared with the
+// timing baseline file of -b: a stage more than -t percent (25 by
+// default) slower is flagged. -u, or a missing baseline file, records
+// this run as the baseline
+// Prints one line per case and exits with failure if a case failed or
+// was flagged; the outputs of failed runs are kept for inspection
+int main(int argc, char **argv) {
+  int workers = sysconf(_SC_NPROCESSORS_ONLN);
+  char *golden = NULL;
+  char *baseline_name = NULL;
+  double threshold = 25;
+  regress r = {NULL, 0, 0, NULL, NULL, NULL, NULL, 1, false};
+  int opt;
+  while ((opt = getopt(argc, argv, "j:n:g:c:b:t:u")) != -1) {
+    switch (opt) {
+      case 'j':
+        workers = atoi(optarg);
+        break;
+      case 'n':
+        r.runs = atoi(optarg);
+        break;
+      case 'g':
+        golden = optarg;
+        break;
+      case 'c':
+        r.compiler = optarg;
+        break;
+      case 'b':
+        baseline_name = optarg;
+        break;
+      case 't':
+        threshold = atof(optarg);
+        break;
+      case 'u':
+        r.update = true;
+        break;
+      default:
+        fail_if(true, "Usage: regress [-j workers] [-n runs] [-g golden] [-c compiler] "
+                      "[-b baseline] [-t percent] [-u] directory");
+    }
+  }
+  fail_if(argc - optind != 1 || r.runs < 1,
+          "Usage: regress [-j workers] [-n runs] [-g golden] [-c compiler] "
+          "[-b baseline] [-t percent] [-u] directory");
+  r.directory = argv[optind];
+  char default_golden[MAX_PATH];
+  if (!golden) {
+    snprintf(default_golden, MAX_PATH, "%s/golden", r.directory);
+    golden = default_golden;
+  }
+  r.golden = golden;
+  if (r.update) {
+    mkdir(golden, 0755);
+  }
+  char work[] = "/tmp/regress_XXXXXX";
+  fail_if(!mkdtemp(work), "Failed to create a work directory");
+  r.work = work;
+  find_cases(&r);
+
+  if (workers < 1) {
+    workers = 1;
+  }
+  pthread_t *threads = calloc(workers, sizeof(pthread_t));
+  fail_if(!threads, "Failed to allocate memory");
+  for (int i = 0; i < workers; i++) {
+    fail_if(pthread_create(&threads[i], NULL, &regress_worker, &r),
+            "Failed to start regression thread");
+  }
+  for (int i = 0; i < workers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  WORD baseline_n = 0;
+  baseline_entry *baseline = baseline_name && !r.update
+                             ? read_baseline(baseline_name, &baseline_n) : NULL;
+  bool record = baseline_name && (r.update || !baseline);
+  WORD failed = 0;
+  WORD slow = 0;
+  for (WORD i = 0; i < r.case_n; i++) {
+    regress_case *c = &r.cases[i];
+    bool is_slow = compare_timing(c, baseline, baseline_n, threshold);
+    printf("%-24s %-4s", c->name, c->error[0] ? "FAIL" : is_slow ? "SLOW" : "ok");
+    for (int s = 0; s < STAGE_N; s++) {
+      if (c->ran[s]) {
+        printf(" %s %.4fs", stage_names[s], c->seconds[s]);
+      }
+    }
+    printf("\n");
+    if (c->error[0]) {
+      printf("  %s\n", c->error);
+      failed++;
+    }
+    if (is_slow) {
+      printf("  slower: %s\n", c->slow);
+      slow++;
+    }
+  }
+  printf("%u cases, %u failed, %u slower than the baseline\n", r.case_n, failed, slow);
+
+  if (record) {
+    write_baseline(baseline_name, &r);
+    printf("Timing baseline written to %s\n", baseline_name);
+  }
+  if (failed) {
+    printf("Outputs kept in %s\n", r.work);
+  } else {
+    remove_work(&r);
+  }
+  for (WORD i = 0; i < baseline_n; i++) {
+    free(baseline[i].name);
+  }
+  free(baseline);
+  for (WORD i = 0; i < r.case_n; i++) {
+    free(r.cases[i].name);
+  }
+  free(r.cases);
+  return failed || slow ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+#include "roundtrip.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "utils.h"
+#include "instructions.h"
+
+#define CHUNK_BITS 20
+
+static const char *type_names[] = {
+  "data processing", "multiply", "swap", "single data transfer", "branch",
+  "software interrupt", "halt"
+};
+
+typedef struct {
+  uint64_t first;
+  uint64_t end;            // one past the last word
+  uint64_t next;           // next chunk to hand out, shared by the workers
+  roundtrip_report *report;
+  pthread_mutex_t lock;
+} sweep;
+
+bool roundtrip_supported(instr_type type, WORD word) {
+  switch (type) {
+    case MULTIPLY:
+      return !(word & 0x00C00060);
+    case SWAP:
+      return !(word & 0x00B00F60);
+    case SINGLE_DATA_TRANSFER:
+      return !(word & 0x00600000);
+    case BRANCH:
+      return (word & 0x03000000) == 0x02000000;
+    case HALT:
+      return !word;
+    default:
+      return true;
+  }
+}
+
+WORD roundtrip_word(instr_type type, WORD word) {
+  switch (type) {
+    case DATA_PROCESSING:
+      return encode_data_processing(decode_data_processing(word));
+    case MULTIPLY:
+      return encode_multiply(decode_multiply(word));
+    case SWAP:
+      return encode_swap(decode_swap(word));
+    case SINGLE_DATA_TRANSFER:
+      return encode_single_data_transfer(decode_single_data_transfer(word));
+    case BRANCH:
+      return encode_branch(decode_branch(word));
+    case SOFTWARE_INTERRUPT:
+      return encode_software_interrupt(decode_software_interrupt(word));
+    default:
+      return word;
+  }
+}
+
+// adds words mismatches in bits to the group they belong to, keeping
+// the lowest word seen
+void add_mismatch(roundtrip_report *report, instr_type type, WORD bits, uint64_t words,
+                  WORD first, WORD encoded) {
+  for (WORD i = 0; i < report->group_n; i++) {
+    roundtrip_group *g = &report->groups[i];
+    if (g->type == type && g->bits == bits) {
+      g->words += words;
+      if (first < g->first) {
+        g->first = first;
+        g->encoded = encoded;
+      }
+      return;
+    }
+  }
+  if (report->group_n == ROUNDTRIP_GROUP_N) {
+    report->ungrouped += words;
+    return;
+  }
+  report->groups[report->group_n++] = (roundtrip_group) {type, bits, words, first, encoded};
+}
+
+void check_chunk(roundtrip_report *report, uint64_t first, uint64_t end) {
+  for (uint64_t i = first; i < end; i++) {
+    WORD word = (WORD) i;
+    instr_type type = clarify_instruction(word);
+    report->words[type]++;
+    if (!roundtrip_supported(type, word)) {
+      report->unsupported[type]++;
+      continue;
+    }
+    WORD encoded = roundtrip_word(type, word);
+    if (encoded != word) {
+      report->mismatched[type]++;
+      add_mismatch(report, type, encoded ^ word, 1, word, encoded);
+    }
+  }
+}
+
+void merge_report(roundtrip_report *into, const roundtrip_report *from) {
+  for (int i = 0; i < ROUNDTRIP_CLASS_N; i++) {
+    into->words[i] += from->words[i];
+    into->unsupported[i] += from->unsupported[i];
+    into->mismatched[i] += from->mismatched[i];
+  }
+  for (WORD i = 0; i < from->group_n; i++) {
+    const roundtrip_group *g = &from->groups[i];
+    add_mismatch(into, g->type, g->bits, g->words, g->first, g->encoded);
+  }
+  into->ungrouped += from->ungrouped;
+}
+
+void *sweep_worker(void *arg) {
+  sweep *s = (sweep *) arg;
+  roundtrip_report report;
+  memset(&report, 0, sizeof(report));
+  uint64_t chunk;
+  while ((chunk = __atomic_fetch_add(&s->next, 1, __ATOMIC_RELAXED))
+         <= (s->end - s->first - 1) >> CHUNK_BITS) {
+    uint64_t first = s->first + (chunk << CHUNK_BITS);
+    uint64_t end = first + (1ull << CHUNK_BITS);
+    check_chunk(&report, first, end < s->end ? end : s->end);
+  }
+  pthread_mutex_lock(&s->lock);
+  merge_report(s->report, &report);
+  pthread_mutex_unlock(&s->lock);
+  return NULL;
+}
+
+uint64_t roundtrip_sweep(WORD first, WORD last, int workers, roundtrip_report *report) {
+  fail_if(first > last, "The range to check is empty");
+  memset(report, 0, sizeof(roundtrip_report));
+  sweep s = {first, (uint64_t) last + 1, 0, report};
+  pthread_mutex_init(&s.lock, NULL);
+  if (workers < 1) {
+    workers = 1;
+  }
+
+  pthread_t *threads = calloc(workers, sizeof(pthread_t));
+  fail_if(!threads, "Failed to allocate memory");
+  for (int i = 0; i < workers; i++) {
+    fail_if(pthread_create(&threads[i], NULL, &sweep_worker, &s),
+            "Failed to start round trip thread");
+  }
+  for (int i = 0; i < workers; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&s.lock);
+
+  uint64_t mismatched = 0;
+  for (int i = 0; i < ROUNDTRIP_CLASS_N; i++) {
+    mismatched += report->mismatched[i];
+  }
+  return mismatched;
+}
+
+void roundtrip_print(const roundtrip_report *report) {
+  printf("%-22s %12s %12s %12s\n", "class", "words", "unsupported", "mismatched");
+  for (int i = 0; i < ROUNDTRIP_CLASS_N; i++) {
+    printf("%-22s %12" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n", type_names[i],
+           report->words[i], report->unsupported[i], report->mismatched[i]);
+  }
+  for (WORD i = 0; i < report->group_n; i++) {
+    const roundtrip_group *g = &report->groups[i];
+    printf("%s: %" PRIu64 " words differ in bits 0x%08x, first 0x%08x -> 0x%08x\n",
+           type_names[g->type], g->words, g->bits, g->first, g->encoded);
+  }
+  if (report->ungrouped) {
+    printf("%" PRIu64 " more mismatches in other bits\n", report->ungrouped);
+  }
+}
@@ -0,0 +1,61 @@
+#ifndef ROUNDTRIP
+#define ROUNDTRIP
+#include <stdint.h>
+#include "utils.h"
+#include "instructions.h"
+
+// Round trip of the instruction decoders and encoders over instruction words
+//
+// Every word of a range is classified with clarify_instruction(), decoded
+// with the decode_* function of its class and encoded again with the
+// matching encode_*; the result must be the word itself. Words of forms
+// the decoders do not read are unsupported and skipped:
+//   multiply              bits 23, 22 (long multiplies) or 6, 5
+//                         (halfword transfers) set
+//   swap                  bits 23, 21, 20, 11..8 or 6, 5 set
+//   single data transfer  bits 22 (byte) or 21 (write back) set
+//   branch                bit 24 (link) set, or bit 25 clear: block data
+//                         transfers, which clarify_instruction() takes
+//                         for branches
+//   halt                  every word but 0, and 0 has no fields
+// Data processing and software interrupt words are all supported
+//
+// Mismatches are grouped by class and by the bits that came back wrong,
+// each group keeping a count and its lowest word, so that a decoder bug
+// that breaks millions of words reports as one line
+// The range is cut into chunks shared out to worker threads
+
+#define ROUNDTRIP_CLASS_N (HALT + 1)
+#define ROUNDTRIP_GROUP_N 64
+
+typedef struct roundtrip_group {
+  instr_type type;
+  WORD bits;               // original xor re-encoded
+  uint64_t words;
+  WORD first;              // the lowest word of the group
+  WORD encoded;            // what first came back as
+} roundtrip_group;
+
+typedef struct roundtrip_report {
+  uint64_t words[ROUNDTRIP_CLASS_N];
+  uint64_t unsupported[ROUNDTRIP_CLASS_N];
+  uint64_t mismatched[ROUNDTRIP_CLASS_N];
+  WORD group_n;
+  roundtrip_group groups[ROUNDTRIP_GROUP_N];
+  uint64_t ungrouped;      // mismatches past the last group
+} roundtrip_report;
+
+// False if word, of class type, is of a form that is skipped
+bool roundtrip_supported(instr_type type, WORD word);
+
+// The word decoded and encoded again by its class
+WORD roundtrip_word(instr_type type, WORD word);
+
+// Checks every word from first to last inclusive on workers threads
+// (at least 1) into report; returns the number of mismatches
+uint64_t roundtrip_sweep(WORD first, WORD last, int workers, roundtrip_report *report);
+
+// One line per class, then one per group of mismatches
+void roundtrip_print(const roundtrip_report *report);
+
+#endif
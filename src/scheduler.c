@@ -0,0 +1,102 @@
+#include "scheduler.h"
+#include <stdlib.h>
+#include "utils.h"
+
+scheduler *scheduler_create(void) {
+  scheduler *s = calloc(1, sizeof(scheduler));
+  fail_if(!s, "Failed to allocate memory");
+  s->next_check = NO_EVENT;
+  return s;
+}
+
+void swap_events(event *a, event *b) {
+  event t = *a;
+  *a = *b;
+  *b = t;
+}
+
+void sift_up(scheduler *s, WORD i) {
+  while (i > 0 && s->heap[(i - 1) / 2].deadline > s->heap[i].deadline) {
+    swap_events(&s->heap[(i - 1) / 2], &s->heap[i]);
+    i = (i - 1) / 2;
+  }
+}
+
+void sift_down(scheduler *s, WORD i) {
+  for (;;) {
+    WORD least = i;
+    WORD left = 2 * i + 1;
+    WORD right = left + 1;
+    if (left < s->event_n && s->heap[left].deadline < s->heap[least].deadline) {
+      least = left;
+    }
+    if (right < s->event_n && s->heap[right].deadline < s->heap[least].deadline) {
+      least = right;
+    }
+    if (least == i) {
+      return;
+    }
+    swap_events(&s->heap[least], &s->heap[i]);
+    i = least;
+  }
+}
+
+WORD schedule_event(scheduler *s, uint64_t deadline, event_func fire, void *data) {
+  s->heap = reserve(s->heap, s->event_n, &s->capacity, sizeof(event));
+  WORD id = s->next_id++;
+  s->heap[s->event_n] = (event) {deadline, id, fire, data};
+  sift_up(s, s->event_n++);
+  // a cancelled event may leave next_check early, which only costs a
+  // call to scheduler_run
+  if (deadline < s->next_check) {
+    s->next_check = deadline;
+  }
+  return id;
+}
+
+void remove_event(scheduler *s, WORD i) {
+  s->heap[i] = s->heap[--s->event_n];
+  if (i < s->event_n) {
+    sift_up(s, i);
+    sift_down(s, i);
+  }
+}
+
+void cancel_event(scheduler *s, WORD id) {
+  for (WORD i = 0; i < s->event_n; i++) {
+    if (s->heap[i].id == id) {
+      remove_event(s, i);
+      break;
+    }
+  }
+}
+
+void scheduler_run(scheduler *s, uint64_t time) {
+  while (s->event_n && s->heap[0].deadline <= time) {
+    event e = s->heap[0];
+    remove_event(s, 0);
+    // the handler may schedule again, so the event is off the heap first
+    e.fire(e.data, e.deadline, time);
+  }
+  s->next_check = s->event_n ? s->heap[0].deadline : NO_EVENT;
+}
+
+void set_irq(scheduler *s, WORD line, bool asserted) {
+  if (asserted) {
+    s->irq |= 1u << line;
+    s->next_check = 0;
+  } else {
+    s->irq &= ~(1u << line);
+  }
+}
+
+void recheck_irq(scheduler *s) {
+  if (s->irq) {
+    s->next_check = 0;
+  }
+}
+
+void scheduler_free(scheduler *s) {
+  free(s->heap);
+  free(s);
+}
@@ -0,0 +1,57 @@
+#ifndef SCHEDULER
+#define SCHEDULER
+#include <stdint.h>
+#include "utils.h"
+
+// Event queue of the emulated devices, keyed on the instruction count
+// Events are kept in a binary min-heap on their deadline. cycle() only
+// compares the instruction count with next_check at block boundaries
+// (taken branches), so a program with nothing scheduled pays a single
+// comparison per taken branch
+//
+// Devices also drive interrupt lines through the scheduler; asserting a
+// line makes the next block boundary look at it
+
+#define TIMER_IRQ 0
+#define NO_EVENT UINT64_MAX
+
+// time is the instruction count when the event fires (its deadline or
+// later, up to the length of a block)
+typedef void (*event_func)(void *data, uint64_t deadline, uint64_t time);
+
+typedef struct {
+  uint64_t deadline;
+  WORD id;
+  event_func fire;
+  void *data;
+} event;
+
+typedef struct scheduler {
+  event *heap;
+  WORD event_n;
+  WORD capacity;
+  WORD next_id;
+  WORD irq;             // asserted interrupt lines, one bit each
+  uint64_t next_check;  // when cycle() must next call scheduler_run
+} scheduler;
+
+scheduler *scheduler_create(void);
+
+// Queues fire(data, ...) for deadline; returns an id for cancel_event
+WORD schedule_event(scheduler *s, uint64_t deadline, event_func fire, void *data);
+
+// Removes the event with id if it is still queued
+void cancel_event(scheduler *s, WORD id);
+
+// Fires, in deadline order, every event due at time
+void scheduler_run(scheduler *s, uint64_t time);
+
+void set_irq(scheduler *s, WORD line, bool asserted);
+
+// Makes the next block boundary look at the interrupt lines again (after
+// an exception return unmasked them)
+void recheck_irq(scheduler *s);
+
+void scheduler_free(scheduler *s);
+
+#endif
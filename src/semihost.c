@@ -0,0 +1,224 @@
+#include "semihost.h"
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "cycle.h"
+#include "source_map.h"
+#include "trace.h"
+#include "snapshot.h"
+
+#define HANDLE_IN 0
+#define HANDLE_OUT 1
+#define HANDLE_ERR 2
+#define OUTSIDE_MEMORY "Semihosting access outside memory at address"
+
+semihost *semihost_create(FILE *in, FILE *out) {
+  semihost *host = calloc(1, sizeof(semihost));
+  fail_if(!host, "Failed to allocate memory");
+  host->buffer = malloc(SEMIHOST_BUFFER_SIZE);
+  fail_if(!host->buffer, "Failed to allocate memory");
+  host->in = in;
+  host->out = out;
+  return host;
+}
+
+void semihost_flush(semihost *host) {
+  if (host->used) {
+    fwrite(host->buffer, 1, host->used, host->out);
+    host->used = 0;
+  }
+  fflush(host->out);
+}
+
+// prints an error about the SWI being executed, after the guest's output
+void semihost_error(State *arm_state, const char *message, WORD value) {
+  arm_state->errors++;
+  semihost_flush(arm_state->host);
+  printf("Error: %s 0x%08x", message, value);
+  print_source_location(arm_state->map, executing_pc(arm_state));
+  printf("\n");
+}
+
+// true if the length bytes at address are in the emulated memory
+bool in_memory(WORD address, WORD length) {
+  return address <= MEMORY_SIZE && length <= MEMORY_SIZE - address;
+}
+
+// writes length bytes to handle; returns the number of bytes not written
+WORD host_write(semihost *host, WORD handle, const BYTE *bytes, WORD length) {
+  if (handle == HANDLE_ERR) {
+    semihost_flush(host);
+    return length - fwrite(bytes, 1, length, stderr);
+  }
+  if (handle != HANDLE_OUT) {
+    return length;
+  }
+  if (host->used + length > SEMIHOST_BUFFER_SIZE) {
+    semihost_flush(host);
+    if (length > SEMIHOST_BUFFER_SIZE) {
+      return length - fwrite(bytes, 1, length, host->out);
+    }
+  }
+  memcpy(host->buffer + host->used, bytes, length);
+  host->used += length;
+  return 0;
+}
+
+WORD semihost_read(semihost *host, BYTE *bytes, WORD length) {
+  // a prompt must be out before the guest waits for its answer
+  semihost_flush(host);
+  WORD n = 0;
+  while (n < length) {
+    int c = getc(host->in);
+    if (c == EOF) {
+      break;
+    }
+    bytes[n++] = c;
+    if (c == '\n') {
+      break;
+    }
+  }
+  return n;
+}
+
+// reads from handle as semihost_read, or from the trace of the run;
+// returns the number of bytes not read
+WORD host_read(State *arm_state, WORD handle, BYTE *bytes, WORD length) {
+  if (handle != HANDLE_IN) {
+    return length;
+  }
+  return length - (arm_state->trace
+                   ? trace_input(arm_state, bytes, length)
+                   : semihost_read(arm_state->host, bytes, length));
+}
+
+// runs the call in r0; returns false if the program stops
+bool semihost_call(State *arm_state, semihost *host) {
+  WORD *reg = arm_state->reg;
+  BYTE *memory = arm_state->memory;
+  WORD argument = reg[1];
+  switch (reg[0]) {
+    case SYS_WRITEC: {
+      if (!in_memory(argument, 1)) {
+        semihost_error(arm_state, OUTSIDE_MEMORY, argument);
+        return false;
+      }
+      host_write(host, HANDLE_OUT, memory + argument, 1);
+      return true;
+    }
+    case SYS_WRITE0: {
+      if (!in_memory(argument, 0)) {
+        semihost_error(arm_state, OUTSIDE_MEMORY, argument);
+        return false;
+      }
+      // the end of memory ends an unterminated string
+      const BYTE *end = memchr(memory + argument, 0, MEMORY_SIZE - argument);
+      WORD length = end ? end - (memory + argument) : MEMORY_SIZE - argument;
+      host_write(host, HANDLE_OUT, memory + argument, length);
+      return true;
+    }
+    case SYS_WRITE:
+    case SYS_READ: {
+      if (!in_memory(argument, 3 * sizeof(WORD))) {
+        semihost_error(arm_state, OUTSIDE_MEMORY, argument);
+        return false;
+      }
+      WORD handle = read_word(memory, argument);
+      WORD buffer = read_word(memory, argument + 4);
+      WORD length = read_word(memory, argument + 8);
+      if (!in_memory(buffer, length)) {
+        semihost_error(arm_state, OUTSIDE_MEMORY, buffer);
+        return false;
+      }
+      reg[0] = reg[0] == SYS_WRITE
+        ? host_write(host, handle, memory + buffer, length)
+        : host_read(arm_state, handle, memory + buffer, length);
+      return true;
+    }
+    case SYS_READC: {
+      BYTE c;
+      reg[0] = host_read(arm_state, HANDLE_IN, &c, 1) ? (WORD) -1 : (WORD) c;
+      return true;
+    }
+    case SYS_EXIT: {
+      host->exited = true;
+      host->exit_code = argument == ADP_STOPPED_APPLICATION_EXIT ? 0 : 1;
+      return false;
+    }
+    case SYS_EXIT_EXTENDED: {
+      if (!in_memory(argument, 2 * sizeof(WORD))) {
+        semihost_error(arm_state, OUTSIDE_MEMORY, argument);
+        return false;
+      }
+      WORD reason = read_word(memory, argument);
+      host->exited = true;
+      host->exit_code = reason == ADP_STOPPED_APPLICATION_EXIT
+        ? (int) read_word(memory, argument + 4) : 1;
+      return false;
+    }
+    case SYS_ELAPSED: {
+      if (!in_memory(argument, 2 * sizeof(WORD))) {
+        semihost_error(arm_state, OUTSIDE_MEMORY, argument);
+        return false;
+      }
+      write_word(memory, argument, (WORD) arm_state->instructions);
+      write_word(memory, argument + 4, (WORD) (arm_state->instructions >> 32));
+      reg[0] = 0;
+      return true;
+    }
+    case SYS_SNAPSHOT: {
+      // the runs started from the snapshot resume past the SWI with r0 1
+      reg[0] = 1;
+      bool saved = host->snapshot
+        && snapshot_save(host->snapshot, arm_state, reg[PC_INDEX] - 4);
+      reg[0] = saved ? 0 : (WORD) -1;
+      return true;
+    }
+    default: {
+      semihost_error(arm_state, "Unsupported semihosting call", reg[0]);
+      return false;
+    }
+  }
+}
+
+bool execute_software_interrupt(State *arm_state, software_interrupt *params) {
+  WORD nzcv = get_bits(arm_state->reg[16], 28, 31);
+  if (!cond_check(nzcv, params->cond)) {
+    return true;
+  }
+  if (!arm_state->host) {
+    return false;
+  }
+  if (params->comment != SEMIHOST_SWI) {
+    semihost_error(arm_state, "Unsupported software interrupt", params->comment);
+    return false;
+  }
+  return semihost_call(arm_state, arm_state->host);
+}
+
+bool semihost_stores(const State *arm_state, WORD *address, WORD *length) {
+  WORD argument = arm_state->reg[1];
+  switch (arm_state->reg[0]) {
+    case SYS_READ: {
+      if (!in_memory(argument, 3 * sizeof(WORD))) {
+        return false;
+      }
+      *address = read_word(arm_state->memory, argument + 4);
+      *length = read_word(arm_state->memory, argument + 8);
+      return true;
+    }
+    case SYS_ELAPSED: {
+      *address = argument;
+      *length = 2 * sizeof(WORD);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+void semihost_free(semihost *host) {
+  semihost_flush(host);
+  free(host->buffer);
+  free(host);
+}
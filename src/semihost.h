@@ -0,0 +1,78 @@
+#ifndef SEMIHOST
+#define SEMIHOST
+#include <stdio.h>
+#include <stdbool.h>
+#include "utils.h"
+#include "instructions.h"
+
+// ARM semihosting: the guest runs SWI 0x123456 with the operation in r0
+// and its argument in r1 (mostly the address of a block of words); the
+// result comes back in r0
+//   0x03  SYS_WRITEC         r1: address of a character to write
+//   0x04  SYS_WRITE0         r1: address of a NUL-terminated string
+//   0x05  SYS_WRITE          r1: {handle, buffer, length}; returns the
+//                            number of bytes not written
+//   0x06  SYS_READ           r1: {handle, buffer, length}; returns the
+//                            number of bytes not read
+//   0x07  SYS_READC          returns the next input byte, -1 at the end
+//   0x18  SYS_EXIT           r1: reason; application exit is code 0,
+//                            any other reason code 1
+//   0x20  SYS_EXIT_EXTENDED  r1: {reason, exit code}
+//   0x30  SYS_ELAPSED        r1: address of two words, set to the
+//                            instruction count (low word first)
+//   0x100 SYS_SNAPSHOT       saves a snapshot of the run into the host's
+//                            snapshot file (see snapshot.h); returns 0,
+//                            1 in the runs started from it, and -1 if
+//                            there is no such file or it was not written
+// The handles are fixed: 0 is the input, 1 the output, 2 stderr
+//
+// Output to handle 1 is collected in a buffer of SEMIHOST_BUFFER_SIZE
+// bytes and written when it fills, before input is read and on
+// semihost_flush, so a guest writing one character at a time does not
+// cost a write per character
+
+#define SEMIHOST_SWI 0x123456
+#define SYS_WRITEC 0x03
+#define SYS_WRITE0 0x04
+#define SYS_WRITE 0x05
+#define SYS_READ 0x06
+#define SYS_READC 0x07
+#define SYS_EXIT 0x18
+#define SYS_EXIT_EXTENDED 0x20
+#define SYS_ELAPSED 0x30
+#define SYS_SNAPSHOT 0x100
+#define ADP_STOPPED_APPLICATION_EXIT 0x20026
+#define SEMIHOST_BUFFER_SIZE (1u << 16)
+
+typedef struct semihost {
+  FILE *in;
+  FILE *out;
+  char *buffer;
+  size_t used;
+  bool exited;
+  int exit_code;
+  const char *snapshot;   // where SYS_SNAPSHOT saves, or NULL
+} semihost;
+
+semihost *semihost_create(FILE *in, FILE *out);
+
+// Executes a SWI on arm_state->host
+// Returns false if the program stops: it exited, or there is no host (a
+// SWI then halts like any other unknown instruction)
+bool execute_software_interrupt(State *arm_state, software_interrupt *params);
+
+// Stores in *address and *length the guest memory that the call in r0
+// would write, and returns false if it writes none
+bool semihost_stores(const State *arm_state, WORD *address, WORD *length);
+
+// Reads at most length bytes of input, up to and including a newline;
+// returns the number read
+WORD semihost_read(semihost *host, BYTE *bytes, WORD length);
+
+// Writes the buffered output
+void semihost_flush(semihost *host);
+
+// Flushes, then frees host
+void semihost_free(semihost *host);
+
+#endif
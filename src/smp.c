@@ -0,0 +1,160 @@
+#include "smp.h"
+#include <stdlib.h>
+#include "utils.h"
+#include "cycle.h"
+#include "semihost.h"
+
+smp *smp_create(WORD core_n, smp_mode mode, FILE *log) {
+  fail_if(core_n == 0 || core_n > MAX_CORE_N, "Unsupported number of cores");
+  smp *m = calloc(1, sizeof(smp));
+  fail_if(!m, "Failed to allocate memory");
+  m->core_n = core_n;
+  m->mode = mode;
+  m->log = log;
+  pthread_mutex_init(&m->lock, NULL);
+  for (WORD i = 0; i < core_n; i++) {
+    pthread_cond_init(&m->turn[i], NULL);
+  }
+  if (mode == SMP_REPLAY) {
+    WORD header[3];
+    fail_if(fread(header, sizeof(WORD), 3, log) != 3 || header[0] != SMP_LOG_MAGIC,
+            "Not a multicore replay log");
+    fail_if(header[1] != core_n, "The replay log is for another number of cores");
+    m->order_n = m->capacity = header[2];
+    m->order = malloc(m->order_n * sizeof(smp_order) + 1);
+    fail_if(!m->order, "Failed to allocate memory");
+    fail_if(fread(m->order, sizeof(smp_order), m->order_n, log) != m->order_n,
+            "The replay log is truncated");
+  }
+  return m;
+}
+
+// wakes every core waiting for its turn; with the lock held
+void wake_all(smp *m) {
+  for (WORD i = 0; i < m->core_n; i++) {
+    pthread_cond_broadcast(&m->turn[i]);
+  }
+}
+
+// stops the run; with the lock held
+void stop(smp *m) {
+  __atomic_store_n(&m->stopped, true, __ATOMIC_RELAXED);
+  wake_all(m);
+}
+
+void replay_mismatch(smp *m, const char *message) {
+  printf("Error: %s\n", message);
+  stop(m);
+}
+
+// waits until the log gives core the next operation; with the lock held
+// Returns false if the run stopped meanwhile
+bool wait_turn(smp *m, WORD core) {
+  while (!m->stopped) {
+    if (m->position == m->order_n) {
+      replay_mismatch(m, "The replay log ends before the run does");
+      return false;
+    }
+    WORD next = m->order[m->position].core;
+    if (next == core) {
+      return true;
+    }
+    if (next >= m->core_n || m->halted[next]) {
+      replay_mismatch(m, "The replay log does not match the program");
+      return false;
+    }
+    pthread_cond_wait(&m->turn[core], &m->lock);
+  }
+  return false;
+}
+
+bool smp_enter(State *arm_state, bool exclusive) {
+  smp *m = arm_state->smp;
+  if (m->mode == SMP_FREE && !exclusive) {
+    return !__atomic_load_n(&m->stopped, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_lock(&m->lock);
+  bool go = m->mode == SMP_REPLAY ? wait_turn(m, arm_state->core) : !m->stopped;
+  if (!go) {
+    pthread_mutex_unlock(&m->lock);
+  }
+  return go;
+}
+
+void smp_leave(State *arm_state, bool exclusive) {
+  smp *m = arm_state->smp;
+  if (m->mode == SMP_FREE && !exclusive) {
+    return;
+  }
+  WORD core = arm_state->core;
+  if (m->mode == SMP_RECORD) {
+    smp_order *last = m->order_n ? &m->order[m->order_n - 1] : NULL;
+    if (last && last->core == core && last->count != (WORD) -1) {
+      last->count++;
+    } else {
+      m->order = reserve(m->order, m->order_n, &m->capacity, sizeof(smp_order));
+      m->order[m->order_n++] = (smp_order) {core, 1};
+    }
+  } else if (m->mode == SMP_REPLAY) {
+    if (++m->done == m->order[m->position].count) {
+      m->position++;
+      m->done = 0;
+      if (m->position < m->order_n && m->order[m->position].core < m->core_n) {
+        pthread_cond_signal(&m->turn[m->order[m->position].core]);
+      }
+    }
+  }
+  // semihosting exits end the program on every core
+  if (arm_state->host && arm_state->host->exited) {
+    stop(m);
+  }
+  pthread_mutex_unlock(&m->lock);
+}
+
+void *core_thread(void *arg) {
+  State *core = (State *) arg;
+  cycle(core);
+  smp *m = core->smp;
+  pthread_mutex_lock(&m->lock);
+  m->halted[core->core] = true;
+  // a replay waiting for this core will not get its turn
+  wake_all(m);
+  pthread_mutex_unlock(&m->lock);
+  return NULL;
+}
+
+void smp_run(smp *m, State *cores) {
+  pthread_t threads[MAX_CORE_N];
+  for (WORD i = 0; i < m->core_n; i++) {
+    cores[i].smp = m;
+    cores[i].core = i;
+    cores[i].reg[0] = i;
+    fail_if(pthread_create(&threads[i], NULL, &core_thread, &cores[i]) != 0,
+            "Failed to start a core");
+  }
+  for (WORD i = 0; i < m->core_n; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+void smp_print_state(const smp *m, State *cores) {
+  for (WORD i = 0; i < m->core_n; i++) {
+    printf("Core %u:\n", i);
+    print_registers(cores[i].reg);
+  }
+  print_nonzero_memory(cores[0].memory);
+}
+
+void smp_free(smp *m) {
+  if (m->mode == SMP_RECORD) {
+    WORD header[3] = {SMP_LOG_MAGIC, m->core_n, m->order_n};
+    fwrite(header, sizeof(WORD), 3, m->log);
+    fwrite(m->order, sizeof(smp_order), m->order_n, m->log);
+  }
+  for (WORD i = 0; i < m->core_n; i++) {
+    pthread_cond_destroy(&m->turn[i]);
+  }
+  pthread_mutex_destroy(&m->lock);
+  free(m->order);
+  free(m);
+}
@@ -0,0 +1,84 @@
+#ifndef SMP
+#define SMP
+#include <stdio.h>
+#include <pthread.h>
+#include "utils.h"
+
+// Multicore runs: the program in memory runs on core_n cores, each a
+// State with its own register file, on a host thread of its own. The
+// cores share the memory, the device bus and the semihosting host, and
+// all start at address 0 with their number in r0. There is no timer.
+//
+// Memory ordering
+//   ldr/str to memory   each aligned word access is atomic, but relaxed:
+//                       without synchronisation a core may see another
+//                       core's stores late, or in a different order
+//   swp/swpb            atomic and sequentially consistent
+//   device registers    serialised (bus_share) and sequentially
+//   and SWIs            consistent
+// The last two act as full barriers: stores made before one of them are
+// visible to a core that has seen its effect (taken the lock a swp
+// released, seen the mailbox bit, ...)
+//
+// Record and replay
+// Free-running cores are not deterministic. With SMP_RECORD every shared
+// operation (ldr, str, swp, swi) is serialised and the order in which
+// the cores performed them is logged; SMP_REPLAY runs the operations in
+// the logged order again. As the cores only interact through those
+// operations, the replay ends in the state the recorded run ended in
+// (input read through semihosting is not part of the log)
+//
+// The log is the WORDs {SMP_LOG_MAGIC, core_n, order_n}, followed by
+// order_n {core, count} runs of operations of one core
+
+#define MAX_CORE_N 8
+#define SMP_LOG_MAGIC 0x31504D53
+
+typedef enum {
+  SMP_FREE,
+  SMP_RECORD,
+  SMP_REPLAY
+} smp_mode;
+
+typedef struct {
+  WORD core;
+  WORD count;
+} smp_order;
+
+typedef struct smp {
+  WORD core_n;
+  smp_mode mode;
+  pthread_mutex_t lock;
+  pthread_cond_t turn[MAX_CORE_N];   // replay: signalled on the core's turn
+  bool halted[MAX_CORE_N];
+  bool stopped;                      // an exit, or a replay gone wrong
+  smp_order *order;
+  WORD order_n;
+  WORD capacity;
+  WORD position;                     // replay: the current run
+  WORD done;                         // replay: operations done in it
+  FILE *log;
+} smp;
+
+// With SMP_RECORD, log is written when m is freed; with SMP_REPLAY, it
+// is read now
+smp *smp_create(WORD core_n, smp_mode mode, FILE *log);
+
+// Runs cores[0..core_n) until they all halt; each must have its memory,
+// register file and devices set, the same for all but the registers
+void smp_run(smp *m, State *cores);
+
+// Bracket each shared operation of a core; exclusive ones (SWIs) are
+// serialised in every mode
+// smp_enter returns false if the run was stopped (after an exit, or a
+// replay log that does not match the program)
+bool smp_enter(State *arm_state, bool exclusive);
+void smp_leave(State *arm_state, bool exclusive);
+
+// Prints the registers of each core, then the memory
+void smp_print_state(const smp *m, State *cores);
+
+// Writes the recorded log, then frees m
+void smp_free(smp *m);
+
+#endif
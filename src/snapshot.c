@@ -0,0 +1,86 @@
+#include "snapshot.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cycle.h"
+#include "utils.h"
+
+static const BYTE zero_page[SNAPSHOT_PAGE_SIZE];
+
+bool snapshot_save(const char *name, const State *arm_state, WORD resume) {
+  snapshot_header header = {SNAPSHOT_MAGIC, SNAPSHOT_PAGE_SIZE};
+  memcpy(header.reg, arm_state->reg, sizeof(header.reg));
+  header.reg[PC_INDEX] = resume;
+  header.spsr = arm_state->spsr;
+  memcpy(header.banked, arm_state->banked, sizeof(header.banked));
+  header.instructions = arm_state->instructions;
+  for (WORD page = 0; page < SNAPSHOT_PAGE_N; page++) {
+    if (memcmp(arm_state->memory + page * SNAPSHOT_PAGE_SIZE, zero_page, SNAPSHOT_PAGE_SIZE)) {
+      header.pages[header.page_n++] = page;
+    }
+  }
+
+  FILE *file = fopen(name, "wb");
+  if (!file) {
+    return false;
+  }
+  bool written = fwrite(&header, sizeof(snapshot_header), 1, file) == 1
+    && fwrite(zero_page, 1, SNAPSHOT_PAGE_SIZE - sizeof(snapshot_header), file)
+       == SNAPSHOT_PAGE_SIZE - sizeof(snapshot_header);
+  for (WORD i = 0; written && i < header.page_n; i++) {
+    written = fwrite(arm_state->memory + header.pages[i] * SNAPSHOT_PAGE_SIZE, 1,
+                     SNAPSHOT_PAGE_SIZE, file) == SNAPSHOT_PAGE_SIZE;
+  }
+  return fclose(file) == 0 && written;
+}
+
+void snapshot_due(void *data, uint64_t deadline, uint64_t time) {
+  snapshot_request *request = (snapshot_request *) data;
+  // events fire at a taken branch, with the PC at its target
+  if (!snapshot_save(request->name, request->state, request->state->reg[PC_INDEX])) {
+    printf("Error: Failed to write the snapshot %s\n", request->name);
+  }
+}
+
+BYTE *snapshot_map(const char *name, State *arm_state) {
+  int fd = open(name, O_RDONLY);
+  fail_if(fd < 0, "Failed to open file");
+  snapshot_header header;
+  struct stat st;
+  fail_if(pread(fd, &header, sizeof(snapshot_header), 0) != sizeof(snapshot_header)
+          || header.magic != SNAPSHOT_MAGIC || header.page_size != SNAPSHOT_PAGE_SIZE
+          || header.page_n > SNAPSHOT_PAGE_N || fstat(fd, &st) < 0
+          || st.st_size < (off_t) (header.page_n + 1) * SNAPSHOT_PAGE_SIZE,
+          "Not a snapshot");
+
+  // the pages not saved are zero
+  BYTE *memory = mmap(NULL, MEMORY_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  fail_if(memory == MAP_FAILED, "Failed to allocate emulated memory");
+  // on hosts with larger pages than the snapshot's, pages are read instead
+  bool mappable = sysconf(_SC_PAGESIZE) <= SNAPSHOT_PAGE_SIZE;
+  for (WORD i = 0; i < header.page_n; i++) {
+    fail_if(header.pages[i] >= SNAPSHOT_PAGE_N, "Not a snapshot");
+    BYTE *page = memory + header.pages[i] * SNAPSHOT_PAGE_SIZE;
+    off_t offset = (off_t) (i + 1) * SNAPSHOT_PAGE_SIZE;
+    bool restored = mappable
+      ? mmap(page, SNAPSHOT_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fd, offset) != MAP_FAILED
+      : pread(fd, page, SNAPSHOT_PAGE_SIZE, offset) == SNAPSHOT_PAGE_SIZE;
+    fail_if(!restored, "Failed to map the snapshot into memory");
+  }
+  close(fd);
+
+  memcpy(arm_state->reg, header.reg, sizeof(header.reg));
+  arm_state->spsr = header.spsr;
+  memcpy(arm_state->banked, header.banked, sizeof(header.banked));
+  arm_state->instructions = header.instructions;
+  arm_state->memory = memory;
+  return memory;
+}
+
+void snapshot_unmap(BYTE *memory) {
+  munmap(memory, MEMORY_SIZE);
+}
@@ -0,0 +1,60 @@
+#ifndef SNAPSHOT
+#define SNAPSHOT
+#include <stdint.h>
+#include "utils.h"
+
+// Snapshots of a single-core run, for warm starts
+//
+// A snapshot holds the registers (the CPSR among them), the SPSR, the
+// banked r13 and r14, the instruction count and the pages of memory that are not all zero. It is
+// taken at a point where the run can resume, with the PC at the next
+// instruction to fetch: at the first taken branch after a given
+// instruction count (snapshot_due), or at a SYS_SNAPSHOT semihosting call
+// (see semihost.h), which returns 0 to the run that saved and 1 to the
+// runs that start from the snapshot
+// The state of devices (timer, GPIO, ...) is not saved; snapshots are
+// meant for programs that have not started them yet
+//
+// The file is a snapshot_header and the page numbers in a first page of
+// SNAPSHOT_PAGE_SIZE bytes, then the saved pages, so that a restore maps
+// each page of the file into memory copy-on-write rather than reading it:
+// starting from a snapshot costs a few mmap calls, and only the pages a
+// run writes are copied
+
+#define SNAPSHOT_MAGIC 0x50414E53
+#define SNAPSHOT_PAGE_SIZE 4096
+#define SNAPSHOT_PAGE_N (MEMORY_SIZE / SNAPSHOT_PAGE_SIZE)
+
+typedef struct {
+  WORD magic;
+  WORD page_size;
+  WORD reg[REGISTER_N];
+  WORD spsr;
+  WORD banked[2];
+  WORD page_n;
+  uint64_t instructions;
+  WORD pages[SNAPSHOT_PAGE_N];
+} snapshot_header;
+
+// An event (see scheduler.h) that saves the run of state into name
+typedef struct snapshot_request {
+  const char *name;
+  State *state;
+} snapshot_request;
+
+// Saves arm_state into name as it will resume at address resume; returns
+// false if the file could not be written
+bool snapshot_save(const char *name, const State *arm_state, WORD resume);
+
+// The event handler of a snapshot_request, scheduled at the instruction
+// count to save at
+void snapshot_due(void *data, uint64_t deadline, uint64_t time);
+
+// Maps the memory of the snapshot in name into a new memory, and restores
+// its registers, SPSR and instruction count into arm_state
+// Returns the memory, to be freed with snapshot_unmap
+BYTE *snapshot_map(const char *name, State *arm_state);
+
+void snapshot_unmap(BYTE *memory);
+
+#endif
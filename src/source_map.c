@@ -0,0 +1,124 @@
+#include "source_map.h"
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "assembler.h"
+
+#define SOURCE_MAP_MAGIC 0x534d5241 // "ARMS"
+#define SOURCE_MAP_VERSION 1
+#define HEADER_WORDS 4
+
+WORD add_map_string(source_map *m, const char *string, WORD *capacity) {
+  WORD offset = m->strings_size;
+  WORD length = strlen(string) + 1;
+  while (m->strings_size + length > *capacity) {
+    m->strings = reserve(m->strings, *capacity, capacity, sizeof(char));
+  }
+  memcpy(m->strings + offset, string, length);
+  m->strings_size += length;
+  return offset;
+}
+
+source_map *source_map_build(const char *file_name, const char *source, size_t size) {
+  source_map *m = calloc(1, sizeof(source_map));
+  fail_if(!m, "Failed to allocate memory");
+  WORD capacity = 0;
+  WORD strings_capacity = 0;
+  add_map_string(m, file_name, &strings_capacity);
+
+  WORD label = NO_LABEL;
+  WORD label_address = 0;
+  WORD line_number = 1;
+  char line[MAX_LINE_LENGTH];
+  const char *cursor = source;
+  size_t length;
+  // lines are read exactly as the assembler reads them
+  while ((length = read_line(&cursor, source + size, line, sizeof(line)))) {
+    if (is_label(line)) {
+      *strchr(line, ':') = '\0';
+      label = add_map_string(m, line, &strings_capacity);
+      label_address = 4 * m->record_n;
+    } else if (!is_empty(line)) {
+      m->records = reserve(m->records, m->record_n, &capacity, sizeof(source_record));
+      m->records[m->record_n++] = (source_record) {line_number, label, label_address};
+    }
+    if (line[length - 1] == '\n') {
+      line_number++;
+    }
+  }
+  return m;
+}
+
+void source_map_remap(source_map *m, const WORD *new_address) {
+  WORD record_n = new_address[m->record_n] / 4;
+  source_record *records = calloc(record_n + 1, sizeof(source_record));
+  fail_if(!records, "Failed to allocate memory");
+  for (WORD i = 0; i < m->record_n; i++) {
+    if (new_address[i] == new_address[i + 1]) {
+      continue;
+    }
+    source_record r = m->records[i];
+    if (r.label != NO_LABEL) {
+      r.label_address = new_address[r.label_address / 4];
+    }
+    records[new_address[i] / 4] = r;
+  }
+  free(m->records);
+  m->records = records;
+  m->record_n = record_n;
+}
+
+void source_map_write(source_map *m, FILE *file) {
+  WORD header[HEADER_WORDS] =
+    {SOURCE_MAP_MAGIC, SOURCE_MAP_VERSION, m->record_n, m->strings_size};
+  fwrite(header, sizeof(WORD), HEADER_WORDS, file);
+  fwrite(m->records, sizeof(source_record), m->record_n, file);
+  fwrite(m->strings, sizeof(char), m->strings_size, file);
+}
+
+source_map *source_map_read(FILE *file) {
+  WORD header[HEADER_WORDS];
+  fail_if(fread(header, sizeof(WORD), HEADER_WORDS, file) != HEADER_WORDS
+          || header[0] != SOURCE_MAP_MAGIC || header[1] != SOURCE_MAP_VERSION,
+          "Not a source map");
+  source_map *m = calloc(1, sizeof(source_map));
+  fail_if(!m, "Failed to allocate memory");
+  m->record_n = header[2];
+  m->strings_size = header[3];
+  m->records = calloc(m->record_n + 1, sizeof(source_record));
+  m->strings = calloc(m->strings_size + 1, sizeof(char));
+  fail_if(!m->records || !m->strings, "Failed to allocate memory");
+  fail_if(fread(m->records, sizeof(source_record), m->record_n, file) != m->record_n
+          || fread(m->strings, sizeof(char), m->strings_size, file) != m->strings_size
+          || m->strings_size == 0,
+          "Source map is truncated");
+  for (WORD i = 0; i < m->record_n; i++) {
+    fail_if(m->records[i].label != NO_LABEL && m->records[i].label >= m->strings_size,
+            "Source map has a bad label");
+  }
+  return m;
+}
+
+const source_record *source_map_find(const source_map *m, WORD address) {
+  if (!m || address % 4 || address / 4 >= m->record_n) {
+    return NULL;
+  }
+  return &m->records[address / 4];
+}
+
+void print_source_location(const source_map *m, WORD address) {
+  const source_record *r = source_map_find(m, address);
+  if (!r) {
+    return;
+  }
+  printf(" at %s:%u", m->strings, r->line);
+  if (r->label != NO_LABEL) {
+    printf(" (%s+%u)", m->strings + r->label, address - r->label_address);
+  }
+}
+
+void source_map_free(source_map *m) {
+  free(m->records);
+  free(m->strings);
+  free(m);
+}
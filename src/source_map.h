@@ -0,0 +1,52 @@
+#ifndef SOURCE_MAP
+#define SOURCE_MAP
+#include <stdio.h>
+#include "utils.h"
+
+// Source map file layout (all fields are little-endian WORDs):
+//   header   magic, version, record_n, strings_size
+//   records  record_n x {line, label, label address}
+//   strings  NUL-terminated names, the source file name first
+//
+// Record i describes the instruction at address 4 * i, so an address is
+// resolved by indexing with address / 4; the literal pool has no records.
+
+#define NO_LABEL 0xFFFFFFFF
+
+typedef struct {
+  WORD line;            // 1-based line number in the source
+  WORD label;           // offset in strings of the nearest label before
+  WORD label_address;   // the line, or NO_LABEL if there is none
+} source_record;
+
+typedef struct source_map {
+  WORD record_n;
+  source_record *records;
+  WORD strings_size;
+  char *strings;
+} source_map;
+
+// Builds the map of the instructions in source, named file_name
+source_map *source_map_build(const char *file_name, const char *source, size_t size);
+
+// Moves the records to the layout left by peephole: the instruction at
+// address now lives at new_address[address / 4], new_address[record_n]
+// being the new code size; records of removed instructions are dropped
+void source_map_remap(source_map *m, const WORD *new_address);
+
+void source_map_write(source_map *m, FILE *file);
+
+// Reads a map file, exits if it is malformed
+source_map *source_map_read(FILE *file);
+
+// Returns the record of the instruction at address, or NULL if the map is
+// NULL or has no record for it
+const source_record *source_map_find(const source_map *m, WORD address);
+
+// Prints " at file:line (label+offset)" for address, or nothing when the
+// map does not cover it
+void print_source_location(const source_map *m, WORD address);
+
+void source_map_free(source_map *m);
+
+#endif
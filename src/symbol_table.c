@@ -2,67 +2,115 @@
 #include <string.h>
 #include <assert.h>
 
+#define INITIAL_BUCKET_N 64
+
+void reset_buckets(table *t, WORD bucket_n) {
+  t->bucket_n = bucket_n;
+  t->buckets = arena_alloc(t->arena, bucket_n * sizeof(node *));
+  memset(t->buckets, 0, bucket_n * sizeof(node *));
+}
+
 table* table_create(void) {
   table *new_table = malloc(sizeof(table));
   fail_if(!new_table, "Failed to allocate memory");
   new_table->start = NULL;
+  new_table->end = &new_table->start;
+  new_table->size = 0;
+  new_table->arena = arena_create();
+  reset_buckets(new_table, INITIAL_BUCKET_N);
   return new_table;
 }
 
 void table_free(table *t) {
-  node *curr = t->start;
-  while(curr) {
-    node *next = curr->next;
-    free(curr->key);
-    free(curr);
-    curr = next;
-  }
+  arena_free(t->arena);
   free(t);
 }
 
-void table_insert(table *t, const char *key, WORD value) {
-  node *prev = NULL;
-  node *curr = t->start;
-  int bigger = curr? strcmp(key, curr->key): -1;
-  while(bigger > 0) {
-    prev = curr;
-    curr = curr->next;
-    bigger = curr? strcmp(key, curr->key): -1;
+node **bucket_of(table *t, const char *key) {
+  return &t->buckets[hash_bytes(key, strlen(key)) & (t->bucket_n - 1)];
+}
+
+node *find_node(table *t, const char *key) {
+  node *curr = *bucket_of(t, key);
+  while (curr && strcmp(key, curr->key)) {
+    curr = curr->chain;
   }
-  if (bigger == 0) {
-    curr->value = value;
-    return;
+  return curr;
+}
+
+// rehashes every entry into twice the buckets; the old ones stay in the
+// arena until the table is freed, at most as much again
+void grow(table *t) {
+  reset_buckets(t, t->bucket_n * 2);
+  for (node *n = t->start; n; n = n->next) {
+    node **bucket = bucket_of(t, n->key);
+    n->chain = *bucket;
+    *bucket = n;
   }
+}
 
-  node *new_node = malloc(sizeof(node));
-  fail_if(!new_node, "Failed to allocate memory");
-  new_node->key = calloc(strlen(key) + 1, sizeof(char));
-  fail_if(!new_node->key, "Failed to allocate memory");
+// links a node whose key is not in the table yet at the end of the order
+void add_node(table *t, node *n) {
+  if (t->size == t->bucket_n) {
+    grow(t);
+  }
+  node **bucket = bucket_of(t, n->key);
+  n->chain = *bucket;
+  *bucket = n;
+  n->next = NULL;
+  *t->end = n;
+  t->end = &n->next;
+  t->size++;
+}
 
-  strcpy(new_node->key, key);
+void table_insert(table *t, const char *key, WORD value) {
+  node *existing = find_node(t, key);
+  if (existing) {
+    existing->value = value;
+    return;
+  }
+  node *new_node = arena_alloc(t->arena, sizeof(node));
+  new_node->key = arena_strdup(t->arena, key);
   new_node->value = value;
-  new_node->next = curr;
-  if (prev) {
-    prev->next = new_node;
-  } else {
-    t->start = new_node;
+  add_node(t, new_node);
+}
+
+void table_merge(table *dst, table *src, WORD offset) {
+  arena_adopt(dst->arena, src->arena);
+  node *curr = src->start;
+  while (curr) {
+    node *next = curr->next;
+    node *existing = find_node(dst, curr->key);
+    if (existing) {
+      // the value from src replaces the one in dst
+      existing->value = curr->value + offset;
+    } else {
+      curr->value += offset;
+      add_node(dst, curr);
+    }
+    curr = next;
   }
+  // src's buckets went to dst with the rest of its arena
+  src->start = NULL;
+  src->end = &src->start;
+  src->size = 0;
+  reset_buckets(src, INITIAL_BUCKET_N);
 }
 
 bool table_get(table *t, const char *key, WORD *value) {
-  node *curr = t->start;
-  int bigger = curr? strcmp(key, curr->key): -1;
-  while(bigger > 0) {
-    curr = curr->next;
-    bigger = curr? strcmp(key, curr->key): -1;
-  }
-  if (bigger == 0) {
-    *value = curr->value;
+  node *found = find_node(t, key);
+  if (found) {
+    *value = found->value;
     return true;
   }
   return false;
 }
 
+const char *table_key(table *t, const char *key) {
+  node *found = find_node(t, key);
+  return found ? found->key : NULL;
+}
+
 ftable* ftable_create(void) {
   ftable *new_table = malloc(sizeof(ftable));
   fail_if(!new_table, "Failed to allocate memory");
@@ -96,7 +144,7 @@ void ftable_insert(ftable *t, const char *key, word_func func) {
     return;
   }
 
-  fnode *new_node = malloc(sizeof(node));
+  fnode *new_node = malloc(sizeof(fnode));
   fail_if(!new_node, "Failed to allocate memory");
   new_node->key = calloc(strlen(key) + 1, sizeof(char));
   fail_if(!new_node->key, "Failed to allocate memory");
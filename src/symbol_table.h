@@ -1,16 +1,27 @@
 #ifndef SYMBOL_TABLE
 #define SYMBOL_TABLE
 #include "utils.h"
+#include "arena.h"
 #include <stdbool.h>
 
 typedef struct node {
   char *key;
   WORD value;
-  struct node *next;
+  struct node *next;       // the next entry in insertion order
+  struct node *chain;      // the next entry of the same bucket
 } node;
 
+// A hash table of labels: entries are found through buckets and can be
+// walked from start in the order they were first inserted
+// Nodes, keys and buckets live in the table's arena; the buckets double
+// when the table holds as many entries as it has buckets
 typedef struct {
   node *start;
+  node **end;              // the link to append the next entry at
+  node **buckets;
+  WORD bucket_n;           // a power of two
+  WORD size;
+  arena *arena;
 } table;
 
 typedef WORD (*word_func) ();
@@ -28,16 +39,26 @@ typedef struct {
 // Creates a new heap-allocated symbol table
 table* table_create(void);
 
-// Frees the table recursively at the given pointer
+// Frees the table and every key in it
 void table_free(table *);
 
 // Inserts a key-value pair into the table
 void table_insert(table *, const char *key, WORD value);
 
+// Moves every entry of src into dst, adding offset to its value
+// Entries of src replace the values of entries of dst with the same key,
+// which keep their place in the order; the others are rehashed into dst
+// after its own. src is left empty and its memory is handed over to dst
+void table_merge(table *dst, table *src, WORD offset);
+
 // If the key exists in the table, store the corresponding value
 // at the given pointer, and return true. Otherwise, return false.
 bool table_get(table *, const char *key, WORD *value);
 
+// Returns the table's own copy of key, which lives as long as the table,
+// or NULL if the key is not in the table
+const char *table_key(table *, const char *key);
+
 // Creates a new heap-allocated symbol table
 ftable* ftable_create(void);
 
@@ -0,0 +1,107 @@
+#include "timer.h"
+#include <stdlib.h>
+#include "utils.h"
+
+#define LOAD 0x00
+#define VALUE 0x04
+#define CONTROL 0x08
+#define IRQ_CLR 0x0C
+#define RAW_IRQ 0x10
+#define MSK_IRQ 0x14
+
+arm_timer *arm_timer_create(scheduler *events) {
+  arm_timer *t = calloc(1, sizeof(arm_timer));
+  fail_if(!t, "Failed to allocate memory");
+  t->events = events;
+  return t;
+}
+
+void timer_update_irq(arm_timer *t) {
+  set_irq(t->events, TIMER_IRQ, t->raw_irq && (t->control & TIMER_IRQ_ENABLE));
+}
+
+void timer_expire(void *data, uint64_t deadline, uint64_t time);
+
+void timer_start(arm_timer *t, uint64_t from) {
+  if (t->running) {
+    cancel_event(t->events, t->event);
+  }
+  t->running = (t->control & TIMER_ENABLE) && t->load;
+  if (t->running) {
+    t->deadline = from + t->load;
+    t->event = schedule_event(t->events, t->deadline, &timer_expire, t);
+  }
+}
+
+// periods follow each other from the deadline, however late the
+// block boundary that fired it
+void timer_expire(void *data, uint64_t deadline, uint64_t time) {
+  arm_timer *t = (arm_timer *) data;
+  t->running = false;
+  t->raw_irq = true;
+  timer_update_irq(t);
+  timer_start(t, deadline);
+}
+
+bool timer_load(void *data, WORD offset, WORD *value, uint64_t time) {
+  arm_timer *t = (arm_timer *) data;
+  switch (offset) {
+    case LOAD:
+      *value = t->load;
+      return true;
+    case VALUE:
+      *value = t->running && t->deadline > time ? t->deadline - time : 0;
+      return true;
+    case CONTROL:
+      *value = t->control;
+      return true;
+    case RAW_IRQ:
+      *value = t->raw_irq;
+      return true;
+    case MSK_IRQ:
+      *value = t->raw_irq && (t->control & TIMER_IRQ_ENABLE);
+      return true;
+    case IRQ_CLR:
+      *value = 0;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool timer_store(void *data, WORD offset, WORD value, uint64_t time) {
+  arm_timer *t = (arm_timer *) data;
+  switch (offset) {
+    case LOAD:
+      t->load = value;
+      timer_start(t, time);
+      return true;
+    case CONTROL: {
+      bool was_enabled = t->control & TIMER_ENABLE;
+      t->control = value;
+      if (!(value & TIMER_ENABLE) || !was_enabled) {
+        timer_start(t, time);
+      }
+      timer_update_irq(t);
+      return true;
+    }
+    case IRQ_CLR:
+      t->raw_irq = false;
+      timer_update_irq(t);
+      return true;
+    case VALUE:
+    case RAW_IRQ:
+    case MSK_IRQ:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void arm_timer_attach(arm_timer *t, bus *b) {
+  bus_register(b, (device) {"timer", TIMER_BASE, TIMER_SIZE, &timer_load, &timer_store, t});
+}
+
+void arm_timer_free(arm_timer *t) {
+  free(t);
+}
@@ -0,0 +1,47 @@
+#ifndef TIMER
+#define TIMER
+#include <stdint.h>
+#include "utils.h"
+#include "bus.h"
+#include "scheduler.h"
+
+// Periodic timer at the Raspberry Pi's ARM timer addresses, counting
+// instructions instead of clock ticks:
+//   0x2000b400  LOAD     period in instructions; writing restarts the count
+//   0x2000b404  VALUE    instructions left in the period (read only)
+//   0x2000b408  CONTROL  bit 7 enables the timer, bit 5 its interrupt
+//   0x2000b40c  IRQ_CLR  writing acknowledges the interrupt
+//   0x2000b410  RAW_IRQ  bit 0 is set when a period has elapsed
+//   0x2000b414  MSK_IRQ  RAW_IRQ and the interrupt enable
+// While the interrupt is enabled and not acknowledged, TIMER_IRQ is
+// asserted
+// cycle() takes an asserted interrupt at the next taken branch unless the
+// CPSR's I bit masks it: the CPSR goes to the SPSR and I is set, r13 and
+// r14 are exchanged for IRQ mode's own (State's banked), r14 gets the
+// branch target + 4 and the PC 0x18. subs pc,r14,#4 returns, restoring
+// the CPSR and exchanging r13 and r14 back, so the handler does not
+// clobber the interrupted code's
+
+#define TIMER_BASE 0x2000B400
+#define TIMER_SIZE 0x18
+#define TIMER_ENABLE (1u << 7)
+#define TIMER_IRQ_ENABLE (1u << 5)
+
+typedef struct {
+  scheduler *events;
+  WORD load;
+  WORD control;
+  bool raw_irq;
+  bool running;
+  WORD event;           // id of the queued expiry, while running
+  uint64_t deadline;
+} arm_timer;
+
+arm_timer *arm_timer_create(scheduler *events);
+
+// Registers the timer's registers on b
+void arm_timer_attach(arm_timer *t, bus *b);
+
+void arm_timer_free(arm_timer *t);
+
+#endif
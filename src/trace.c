@@ -0,0 +1,285 @@
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "utils.h"
+#include "bus.h"
+#include "semihost.h"
+
+// the line the replayed interrupts are raised on
+#define REPLAY_IRQ 31
+
+void write_record(trace *t, WORD type, const void *payload, WORD size) {
+  trace_record r = {type, size, t->state->instructions};
+  fwrite(&r, sizeof(trace_record), 1, t->file);
+  if (size) {
+    fwrite(payload, 1, size, t->file);
+  }
+}
+
+void write_checkpoint(trace *t) {
+  State *s = t->state;
+  t->index = reserve(t->index, t->index_n, &t->index_capacity, sizeof(trace_index));
+  t->index[t->index_n++] = (trace_index) {s->instructions, ftell(t->file)};
+  trace_checkpoint c;
+  memcpy(c.reg, s->reg, sizeof(c.reg));
+  c.spsr = s->spsr;
+  memcpy(c.banked, s->banked, sizeof(c.banked));
+  trace_record r = {TRACE_CHECKPOINT, sizeof(trace_checkpoint) + MEMORY_SIZE, s->instructions};
+  fwrite(&r, sizeof(trace_record), 1, t->file);
+  fwrite(&c, sizeof(trace_checkpoint), 1, t->file);
+  fwrite(s->memory, 1, MEMORY_SIZE, t->file);
+}
+
+// fires at a taken branch, where a replay can start from
+void checkpoint_due(void *data, uint64_t deadline, uint64_t time) {
+  trace *t = (trace *) data;
+  write_checkpoint(t);
+  schedule_event(t->state->scheduler, time + t->interval, &checkpoint_due, t);
+}
+
+// reads the next record that is not a checkpoint into t->next
+// Returns false at the end of the trace
+bool read_next(trace *t) {
+  trace_record r;
+  while (fread(&r, sizeof(trace_record), 1, t->file) == 1) {
+    if (r.type == TRACE_CHECKPOINT) {
+      fseek(t->file, r.size, SEEK_CUR);
+      continue;
+    }
+    if (r.type == TRACE_INDEX) {
+      return false;
+    }
+    BYTE *payload = t->next_payload;
+    if (r.type == TRACE_INPUT) {
+      t->input = realloc(t->input, r.size + 1);
+      fail_if(!t->input, "Failed to allocate memory");
+      payload = t->input;
+    }
+    fail_if(r.type != TRACE_INPUT && r.size > sizeof(t->next_payload), "Corrupt trace");
+    if (fread(payload, 1, r.size, t->file) != r.size) {
+      return false;
+    }
+    t->next = r;
+    return true;
+  }
+  return false;
+}
+
+void replay_irq_due(void *data, uint64_t deadline, uint64_t time) {
+  trace *t = (trace *) data;
+  set_irq(t->state->scheduler, REPLAY_IRQ, true);
+}
+
+// moves on to the next record; a recorded interrupt is raised when due
+void advance(trace *t) {
+  t->has_next = read_next(t);
+  if (t->has_next && t->next.type == TRACE_IRQ) {
+    schedule_event(t->state->scheduler, t->next.instructions, &replay_irq_due, t);
+  }
+}
+
+// true if the next record is of type and due now; otherwise the run has
+// diverged from the trace, and it is stopped after this instruction
+bool expect(trace *t, WORD type) {
+  State *s = t->state;
+  if (t->has_next && t->next.type == type && t->next.instructions == s->instructions) {
+    return true;
+  }
+  printf("Error: The run diverged from the trace at instruction %" PRIu64 "\n",
+         s->instructions);
+  s->stop_at = s->instructions;
+  return false;
+}
+
+// a load (store false) or store at offset into the device p stands in for
+// Returns whether the device handled it (true, too, if the replay
+// diverged: that was reported, and the run stops)
+bool proxy_access(trace_proxy *p, bool store, WORD offset, WORD *value, uint64_t time) {
+  trace *t = p->t;
+  WORD address = p->real->base + offset;
+  if (!t->replaying) {
+    bool handled = store
+      ? p->real->store(p->real->data, offset, *value, time)
+      : p->real->load(p->real->data, offset, value, time);
+    trace_device d = {address, *value, store, handled};
+    write_record(t, TRACE_DEVICE, &d, sizeof(trace_device));
+    return handled;
+  }
+  if (!expect(t, TRACE_DEVICE)) {
+    return true;
+  }
+  trace_device d;
+  memcpy(&d, t->next_payload, sizeof(trace_device));
+  if (d.address != address || d.store != store) {
+    t->has_next = false;
+    expect(t, TRACE_DEVICE);
+    return true;
+  }
+  if (!store) {
+    *value = d.value;
+  }
+  advance(t);
+  return d.handled;
+}
+
+bool proxy_load(void *data, WORD offset, WORD *value, uint64_t time) {
+  return proxy_access((trace_proxy *) data, false, offset, value, time);
+}
+
+bool proxy_store(void *data, WORD offset, WORD value, uint64_t time) {
+  return proxy_access((trace_proxy *) data, true, offset, &value, time);
+}
+
+// puts a bus of proxies for the devices of the run in their place, so
+// that their accesses go through the trace
+void attach_proxies(trace *t) {
+  const bus *devices = t->state->bus;
+  t->devices = devices;
+  t->proxy = bus_create();
+  for (WORD i = 0; devices && i < devices->device_n; i++) {
+    device d = devices->devices[i];
+    // mapped input is mapped again on replay, not logged
+    if (!d.direct) {
+      t->proxies[i] = (trace_proxy) {t, &devices->devices[i]};
+      d.load = d.load ? &proxy_load : NULL;
+      d.store = d.store ? &proxy_store : NULL;
+      d.data = &t->proxies[i];
+    }
+    bus_register(t->proxy, d);
+  }
+  t->state->bus = t->proxy;
+}
+
+// the offset of the last checkpoint at or before seek (of the first
+// checkpoint if seek is 0), from the index or else by scanning
+long find_checkpoint(FILE *file, uint64_t seek) {
+  uint64_t index_at;
+  trace_record r;
+  if (fseek(file, -(long) sizeof(uint64_t), SEEK_END) == 0
+      && fread(&index_at, sizeof(uint64_t), 1, file) == 1
+      && fseek(file, index_at, SEEK_SET) == 0
+      && fread(&r, sizeof(trace_record), 1, file) == 1
+      && r.type == TRACE_INDEX && r.size % sizeof(trace_index) == 0 && r.size) {
+    WORD n = r.size / sizeof(trace_index);
+    trace_index *index = malloc(r.size);
+    fail_if(!index, "Failed to allocate memory");
+    fail_if(fread(index, sizeof(trace_index), n, file) != n, "Corrupt trace");
+    // the checkpoints are in order: binary search for the last one <= seek
+    WORD low = 0;
+    WORD high = n;
+    while (seek && high - low > 1) {
+      WORD middle = (low + high) / 2;
+      if (index[middle].instructions <= seek) {
+        low = middle;
+      } else {
+        high = middle;
+      }
+    }
+    long offset = index[low].offset;
+    free(index);
+    return offset;
+  }
+
+  long best = -1;
+  fseek(file, sizeof(trace_header), SEEK_SET);
+  long offset = ftell(file);
+  while (fread(&r, sizeof(trace_record), 1, file) == 1 && r.type != TRACE_INDEX) {
+    if (r.type == TRACE_CHECKPOINT && (best < 0 || (seek && r.instructions <= seek))) {
+      best = offset;
+    }
+    fseek(file, r.size, SEEK_CUR);
+    offset = ftell(file);
+  }
+  fail_if(best < 0, "The trace has no checkpoint");
+  return best;
+}
+
+trace *trace_record_run(FILE *file, uint64_t interval, State *arm_state) {
+  fail_if(!arm_state->scheduler || interval == 0, "Recording needs a scheduler and an interval");
+  trace *t = calloc(1, sizeof(trace));
+  fail_if(!t, "Failed to allocate memory");
+  t->file = file;
+  t->state = arm_state;
+  t->interval = interval;
+  trace_header header = {TRACE_MAGIC, 0, interval};
+  fwrite(&header, sizeof(trace_header), 1, file);
+  write_checkpoint(t);
+  schedule_event(arm_state->scheduler, arm_state->instructions + interval, &checkpoint_due, t);
+  arm_state->trace = t;
+  attach_proxies(t);
+  return t;
+}
+
+trace *trace_replay_run(FILE *file, uint64_t seek, State *arm_state) {
+  fail_if(!arm_state->scheduler, "Replaying needs a scheduler");
+  trace_header header;
+  fail_if(fread(&header, sizeof(trace_header), 1, file) != 1 || header.magic != TRACE_MAGIC,
+          "Not a trace");
+
+  fseek(file, find_checkpoint(file, seek), SEEK_SET);
+  trace_record r;
+  trace_checkpoint c;
+  fail_if(fread(&r, sizeof(trace_record), 1, file) != 1 || r.type != TRACE_CHECKPOINT
+          || fread(&c, sizeof(trace_checkpoint), 1, file) != 1
+          || fread(arm_state->memory, 1, MEMORY_SIZE, file) != MEMORY_SIZE,
+          "Corrupt trace");
+  memcpy(arm_state->reg, c.reg, sizeof(c.reg));
+  arm_state->spsr = c.spsr;
+  memcpy(arm_state->banked, c.banked, sizeof(c.banked));
+  arm_state->instructions = r.instructions;
+
+  trace *t = calloc(1, sizeof(trace));
+  fail_if(!t, "Failed to allocate memory");
+  t->replaying = true;
+  t->file = file;
+  t->state = arm_state;
+  t->interval = header.interval;
+  arm_state->trace = t;
+  attach_proxies(t);
+  arm_state->stop_at = seek;
+  advance(t);
+  return t;
+}
+
+WORD trace_input(State *arm_state, BYTE *bytes, WORD length) {
+  trace *t = arm_state->trace;
+  if (!t->replaying) {
+    WORD n = semihost_read(arm_state->host, bytes, length);
+    write_record(t, TRACE_INPUT, bytes, n);
+    return n;
+  }
+  if (!expect(t, TRACE_INPUT)) {
+    return 0;
+  }
+  WORD n = t->next.size < length ? t->next.size : length;
+  memcpy(bytes, t->input, n);
+  advance(t);
+  return n;
+}
+
+void trace_irq(State *arm_state) {
+  trace *t = arm_state->trace;
+  if (!t->replaying) {
+    write_record(t, TRACE_IRQ, NULL, 0);
+    return;
+  }
+  set_irq(arm_state->scheduler, REPLAY_IRQ, false);
+  if (expect(t, TRACE_IRQ)) {
+    advance(t);
+  }
+}
+
+void trace_close(trace *t) {
+  if (!t->replaying) {
+    uint64_t index_at = ftell(t->file);
+    write_record(t, TRACE_INDEX, t->index, t->index_n * sizeof(trace_index));
+    fwrite(&index_at, sizeof(uint64_t), 1, t->file);
+  }
+  t->state->bus = t->devices;
+  t->state->trace = NULL;
+  bus_free(t->proxy);
+  free(t->index);
+  free(t->input);
+  free(t);
+}
@@ -0,0 +1,120 @@
+#ifndef TRACE
+#define TRACE
+#include <stdio.h>
+#include <stdint.h>
+#include "utils.h"
+#include "scheduler.h"
+#include "bus.h"
+
+// Deterministic record and replay of single-core runs
+//
+// Recording writes a trace of the run: a checkpoint of the machine state
+// at the first taken branch after every interval instructions, and
+// between checkpoints whatever does not follow from that state: device
+// accesses with the values they loaded, semihosting input and the
+// interrupts taken
+// Replaying restores the last checkpoint at or before the instruction
+// count sought and runs forward from it, with the trace standing in for
+// the devices and the input; so seeking costs at most one interval of
+// execution, however long the run was. Device stores are checked against
+// the trace but not performed
+// The devices are reached through a bus of proxies that the trace puts in
+// place of the run's bus. Mapped input (see input.h) is not logged: a
+// replay maps the same file again
+//
+// The file is a trace_header, then records (a trace_record and size
+// bytes of payload):
+//   TRACE_CHECKPOINT  trace_checkpoint, then the memory
+//   TRACE_DEVICE      trace_device
+//   TRACE_INPUT       the bytes the guest read (none at the end of input)
+//   TRACE_IRQ         nothing; an interrupt was taken
+//   TRACE_INDEX       {instructions, offset} of every checkpoint, as
+//                     uint64_t pairs
+// and, once recording finished, the offset of the TRACE_INDEX record as
+// a uint64_t. Without the index (a recording that crashed), replaying
+// scans the records for the checkpoint
+
+#define TRACE_MAGIC 0x43525441
+#define TRACE_DEFAULT_INTERVAL 1000000
+
+typedef enum {
+  TRACE_CHECKPOINT,
+  TRACE_DEVICE,
+  TRACE_INPUT,
+  TRACE_IRQ,
+  TRACE_INDEX
+} trace_type;
+
+typedef struct {
+  WORD magic;
+  WORD reserved;
+  uint64_t interval;
+} trace_header;
+
+typedef struct {
+  WORD type;
+  WORD size;
+  uint64_t instructions;   // when it happened
+} trace_record;
+
+typedef struct {
+  WORD reg[REGISTER_N];
+  WORD spsr;
+  WORD banked[2];
+} trace_checkpoint;
+
+typedef struct {
+  WORD address;
+  WORD value;              // loaded or stored
+  WORD store;
+  WORD handled;
+} trace_device;
+
+typedef struct {
+  uint64_t instructions;
+  uint64_t offset;
+} trace_index;
+
+typedef struct trace_proxy {
+  struct trace *t;
+  const device *real;
+} trace_proxy;
+
+typedef struct trace {
+  bool replaying;
+  FILE *file;
+  State *state;
+  uint64_t interval;
+  trace_index *index;      // recording: the checkpoints written
+  WORD index_n;
+  WORD index_capacity;
+  trace_record next;       // replaying: the next record to consume
+  BYTE next_payload[sizeof(trace_device)];
+  BYTE *input;             // replaying: the bytes of a TRACE_INPUT
+  bool has_next;
+  const bus *devices;      // the run's bus, and the proxies standing in
+  bus *proxy;              // for its devices
+  trace_proxy proxies[MAX_DEVICE_N];
+} trace;
+
+// Starts recording the run of arm_state, which must have a scheduler,
+// into file, with a first checkpoint now
+trace *trace_record_run(FILE *file, uint64_t interval, State *arm_state);
+
+// Restores into arm_state (which must have a scheduler) the last
+// checkpoint of the trace in file at or before instruction seek, and
+// sets the run to stop after exactly seek instructions (0 runs to the
+// end)
+trace *trace_replay_run(FILE *file, uint64_t seek, State *arm_state);
+
+// Reads semihosting input as semihost_read does
+WORD trace_input(State *arm_state, BYTE *bytes, WORD length);
+
+// Called as an interrupt is taken
+void trace_irq(State *arm_state);
+
+// Finishes a recording with its index, gives the run its bus back, then
+// frees t
+void trace_close(trace *t);
+
+#endif
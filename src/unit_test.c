@@ -1,7 +1,31 @@
 #include "utils.h"
 #include "instructions.h"
+#include "execute.h"
 #include "symbol_table.h"
+#include "arena.h"
 #include "encode.h"
+#include "assembler.h"
+#include "cache.h"
+#include "object.h"
+#include "peephole.h"
+#include "cycle.h"
+#include "source_map.h"
+#include "bus.h"
+#include "gpio.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "semihost.h"
+#include "input.h"
+#include "smp.h"
+#include "mailbox.h"
+#include "trace.h"
+#include "snapshot.h"
+#include "fuzz.h"
+#include "lockstep.h"
+#include "roundtrip.h"
+#include "cache_sim.h"
+#include <unistd.h>
+#include <string.h>
 
 #define ASSERT(a) do { \
   asserts_ran++; \
@@ -141,6 +165,569 @@ void test_execute_multiply(void) {
   }
 }
 
+// assembles source into a new memory, stored at memory, and returns
+// fresh registers to run it with
+WORD *load_source(const char *source, BYTE **memory) {
+  program *p = program_scan(source, strlen(source), 1);
+  *memory = calloc(1, MEMORY_SIZE);
+  fail_if(!*memory, "Failed to allocate memory");
+  program_encode(p, *memory);
+  program_free(p);
+  return allocate_register();
+}
+
+void test_fast_forward(void) {
+  // the second loop wraps around: r3 goes 0, -4, ... until it is 8
+  const char *source = "mov r2,#100\nwait:\nsub r2,r2,#1\ncmp r2,#0\nbne wait\n"
+                       "wrap:\nsub r3,r3,#4\ncmp r3,#8\nbne wrap\n"
+                       "andeq r0,r0,r0\n";
+  BYTE *memory;
+  WORD *reg = load_source(source, &memory);
+  State state = {memory, reg};
+  cycle(&state);
+
+  ASSERT_INT_EQ(reg[2], 0);
+  ASSERT_INT_EQ(reg[3], 8);
+  ASSERT_HEX_EQ(reg[16], 0x60000000);
+  ASSERT_HEX_EQ(reg[15], 0x24);
+  // mov, both loops and the halt
+  uint64_t expected = 1 + 3 * 100 + 3 * 0x3FFFFFFEull + 1;
+  ASSERT(state.instructions == expected);
+
+  free(reg);
+  free(memory);
+}
+
+void test_gpio(void) {
+  FILE *log = tmpfile();
+  bus *devices = bus_create();
+  gpio *pins = gpio_create(log);
+  gpio_attach(pins, devices);
+  ASSERT(bus_find(devices, GPIO_BASE + 0xFFF) != NULL);
+  ASSERT(bus_find(devices, GPIO_BASE + 0x1000) == NULL);
+
+  BYTE *memory = calloc(1, MEMORY_SIZE);
+  WORD *reg = allocate_register();
+  State state = {memory, reg, NULL, devices};
+  single_data_transfer store = {.cond = 0xe, .p = 1, .u = 1, .rn = 1, .rd = 2};
+  single_data_transfer load = {.cond = 0xe, .p = 1, .u = 1, .l = 1, .rn = 1, .rd = 3};
+
+  // pin 16 as an output (GPFSEL1), then set, then cleared
+  reg[1] = GPIO_BASE + 0x4;
+  reg[2] = 1 << 18;
+  ASSERT(execute_single_data_transfer(&state, &store));
+  reg[1] = GPIO_BASE + 0x1C;
+  reg[2] = 1 << 16;
+  state.instructions = 5;
+  ASSERT(execute_single_data_transfer(&state, &store));
+  reg[1] = GPIO_BASE + 0x34;
+  ASSERT(execute_single_data_transfer(&state, &load));
+  ASSERT_HEX_EQ(reg[3], 1 << 16);
+  reg[1] = GPIO_BASE + 0x28;
+  state.instructions = 9;
+  ASSERT(execute_single_data_transfer(&state, &store));
+  ASSERT(pins->level == 0);
+
+  // setting an input pin changes nothing
+  reg[1] = GPIO_BASE + 0x1C;
+  reg[2] = 1 << 3;
+  ASSERT(execute_single_data_transfer(&state, &store));
+  ASSERT(pins->level == 0);
+
+  // neither unmapped nor unaligned addresses decode
+  WORD value;
+  ASSERT(!bus_load(devices, GPIO_BASE + 0x2000, &value, 0));
+  ASSERT(!bus_load(devices, GPIO_BASE + 0x2, &value, 0));
+
+  gpio_flush(pins);
+  char text[64] = {0};
+  rewind(log);
+  fread(text, 1, sizeof(text) - 1, log);
+  ASSERT(strcmp(text, "5 pin 16 high\n9 pin 16 low\n") == 0);
+
+  gpio_free(pins);
+  bus_free(devices);
+  fclose(log);
+  free(reg);
+  free(memory);
+}
+
+void test_timer_interrupt(void) {
+  // every 40 instructions the handler at the IRQ vector counts in r6
+  const char *source = "b main\n"
+                       "mov r0,r0\nmov r0,r0\nmov r0,r0\nmov r0,r0\nmov r0,r0\n"
+                       "b handler\n"
+                       "main:\nmov r13,#0x1000\nmov r14,#7\n"
+                       "ldr r1,=0x2000B400\nmov r2,#40\nstr r2,[r1]\n"
+                       "mov r2,#0xA0\nstr r2,[r1,#8]\n"
+                       "wait:\ncmp r6,#3\nbne wait\n"
+                       "str r6,[r1,#8]\nandeq r0,r0,r0\n"
+                       "handler:\nadd r6,r6,#1\nstr r6,[r1,#12]\nsubs r15,r14,#4\n";
+  BYTE *memory;
+  WORD *reg = load_source(source, &memory);
+  bus *devices = bus_create();
+  scheduler *events = scheduler_create();
+  arm_timer *clock = arm_timer_create(events);
+  arm_timer_attach(clock, devices);
+  State state = {memory, reg, NULL, devices, events};
+  cycle(&state);
+
+  ASSERT_INT_EQ(reg[6], 3);
+  // interrupts are unmasked again after each return
+  ASSERT(!get_bit(reg[16], 7));
+  // the handler's r14 was IRQ mode's own
+  ASSERT_INT_EQ(reg[13], 0x1000);
+  ASSERT_INT_EQ(reg[14], 7);
+  ASSERT(state.banked[1] != 0);
+  ASSERT(state.instructions > 3 * 40 && state.instructions < 4 * 40);
+
+  arm_timer_free(clock);
+  scheduler_free(events);
+  bus_free(devices);
+  free(reg);
+  free(memory);
+}
+
+void test_semihosting(void) {
+  // echoes an input line one character at a time, then exits with code 3
+  const char *source = "mov r0,#6\nmov r1,#0x100\nswi 0x123456\n"
+                       "mov r4,#0x200\n"
+                       "echo:\nldr r2,[r4]\ncmp r2,#0\nbeq done\n"
+                       "mov r0,#3\nmov r1,r4\nswi 0x123456\nadd r4,r4,#1\nb echo\n"
+                       "done:\nmov r0,#0x30\nmov r1,#0x300\nswi #0x123456\n"
+                       "mov r1,#0x400\nldr r2,=0x20026\nstr r2,[r1]\n"
+                       "mov r2,#3\nstr r2,[r1,#4]\nmov r0,#0x20\nswi 0x123456\n"
+                       "mov r9,#1\n";
+  BYTE *memory;
+  WORD *reg = load_source(source, &memory);
+  // SYS_READ block: handle 0, buffer 0x200, 8 bytes
+  write_word(memory, 0x100, 0);
+  write_word(memory, 0x104, 0x200);
+  write_word(memory, 0x108, 8);
+  FILE *in = tmpfile();
+  FILE *out = tmpfile();
+  fputs("hi\nrest", in);
+  rewind(in);
+  semihost *host = semihost_create(in, out);
+  State state = {memory, reg, NULL, NULL, NULL, host};
+  cycle(&state);
+
+  ASSERT(host->exited);
+  ASSERT_INT_EQ(host->exit_code, 3);
+  ASSERT_INT_EQ(reg[9], 0);
+  // the read stops after the newline
+  ASSERT_INT_EQ(read_word(memory, 0x200), 0x000a6968);
+  // the output is only written once flushed
+  ASSERT(ftell(out) == 0);
+  semihost_flush(host);
+  char text[16] = {0};
+  rewind(out);
+  ASSERT(fread(text, 1, sizeof(text) - 1, out) == 3);
+  ASSERT(strcmp(text, "hi\n") == 0);
+  // the count at the SYS_ELAPSED call: 4, 8 per character, 3 at the end
+  // of the string and 3 more
+  ASSERT_INT_EQ(read_word(memory, 0x300), 4 + 8 * 3 + 3 + 3);
+  ASSERT_INT_EQ(read_word(memory, 0x304), 0);
+
+  semihost_free(host);
+  fclose(in);
+  fclose(out);
+  free(reg);
+  free(memory);
+}
+
+void test_input_window(void) {
+  char input_name[] = "/tmp/unit_test_inputXXXXXX";
+  int fd = mkstemp(input_name);
+  write(fd, "\x11\x22\x33\x44\x55\x66", 6);
+  close(fd);
+  bus *devices = bus_create();
+  input_window *w = input_open(input_name, 0x50000000);
+  input_attach(w, devices);
+
+  WORD value;
+  ASSERT(bus_load(devices, INPUT_STATUS_BASE, &value, 0));
+  ASSERT_INT_EQ(value, 6);
+  ASSERT(bus_load(devices, INPUT_STATUS_BASE + 4, &value, 0));
+  ASSERT_HEX_EQ(value, 0x50000000);
+  ASSERT(bus_load(devices, 0x50000000, &value, 0));
+  ASSERT_HEX_EQ(value, read_word((const BYTE *) "\x11\x22\x33\x44", 0));
+  // past the end of the file, the page reads as 0
+  ASSERT(bus_load(devices, 0x50000004, &value, 0));
+  ASSERT_HEX_EQ(value, read_word((const BYTE *) "\x55\x66\0\0", 0));
+  ASSERT(bus_load(devices, 0x50000FFC, &value, 0));
+  ASSERT_HEX_EQ(value, 0);
+  ASSERT(!bus_load(devices, 0x50000FFD, &value, 0));
+  ASSERT(!bus_load(devices, 0x50001000, &value, 0));
+  // the window is read only
+  ASSERT(!bus_store(devices, 0x50000000, 0, 0));
+
+  input_free(w);
+  bus_free(devices);
+  remove(input_name);
+}
+
+// runs source on core_n cores; returns the memory they leave
+BYTE *run_cores(const char *source, WORD core_n, smp_mode mode, FILE *log) {
+  BYTE *memory;
+  WORD *first_reg = load_source(source, &memory);
+  bus *devices = bus_create();
+  mailbox *boxes = mailbox_create();
+  mailbox_attach(boxes, devices);
+  bus_share(devices);
+  smp *m = smp_create(core_n, mode, log);
+  State cores[MAX_CORE_N];
+  for (WORD i = 0; i < core_n; i++) {
+    cores[i] = (State) {memory, i ? allocate_register() : first_reg, NULL, devices};
+  }
+  smp_run(m, cores);
+  for (WORD i = 0; i < core_n; i++) {
+    ASSERT_INT_EQ(cores[i].reg[0], i);
+    free(cores[i].reg);
+  }
+  smp_free(m);
+  mailbox_free(boxes);
+  bus_free(devices);
+  return memory;
+}
+
+void test_smp(void) {
+  // each core adds 500 to 0x104 under a swp lock, then the others signal
+  // core 0 through its mailbox
+  const char *locked = "mov r1,#0x100\nmov r2,#0x104\nmov r7,#500\n"
+                       "loop:\nmov r3,#1\n"
+                       "lock:\nswp r4,r3,[r1]\ncmp r4,#0\nbne lock\n"
+                       "ldr r5,[r2]\nadd r5,r5,#1\nstr r5,[r2]\nmov r4,#0\nstr r4,[r1]\n"
+                       "sub r7,r7,#1\ncmp r7,#0\nbne loop\n"
+                       "ldr r9,=0x2000D000\ncmp r0,#0\nbeq wait\n"
+                       "str r0,[r9]\nandeq r0,r0,r0\n"
+                       "wait:\nldr r10,[r9,#4]\ncmp r10,#3\nbne wait\n"
+                       "mov r10,#0x108\nstr r10,[r10]\n";
+  BYTE *memory = run_cores(locked, 3, SMP_FREE, NULL);
+  ASSERT_INT_EQ(read_word(memory, 0x104), 3 * 500);
+  ASSERT_INT_EQ(read_word(memory, 0x108), 0x108);
+  free(memory);
+
+  // without the lock increments are lost, but a replay loses the same ones
+  const char *racy = "mov r2,#0x104\nmov r7,#200\n"
+                     "loop:\nldr r5,[r2]\nadd r5,r5,#1\nstr r5,[r2]\n"
+                     "sub r7,r7,#1\ncmp r7,#0\nbne loop\n";
+  FILE *log = tmpfile();
+  BYTE *recorded = run_cores(racy, 4, SMP_RECORD, log);
+  rewind(log);
+  BYTE *replayed = run_cores(racy, 4, SMP_REPLAY, log);
+  ASSERT(read_word(recorded, 0x104) <= 4 * 200);
+  ASSERT(!memcmp(recorded, replayed, MEMORY_SIZE));
+  fclose(log);
+  free(recorded);
+  free(replayed);
+}
+
+// runs the program in memory with the timer until it halts or stop_at
+// instructions ran; with file, recording the run into it (value being the
+// checkpoint interval) or replaying it (value being the seek)
+void run_timed(BYTE *memory, WORD *reg, FILE *file, bool replaying, uint64_t value,
+               uint64_t stop_at) {
+  bus *devices = bus_create();
+  scheduler *events = scheduler_create();
+  arm_timer *clock = arm_timer_create(events);
+  arm_timer_attach(clock, devices);
+  State state = {memory, reg, NULL, devices, events};
+  state.stop_at = stop_at;
+  trace *t = NULL;
+  if (file) {
+    t = replaying ? trace_replay_run(file, value, &state)
+                  : trace_record_run(file, value, &state);
+  }
+  cycle(&state);
+  if (t) {
+    trace_close(t);
+  }
+  arm_timer_free(clock);
+  scheduler_free(events);
+  bus_free(devices);
+}
+
+void test_trace(void) {
+  // interrupts every 50 instructions while the loop sums the timer's
+  // count, which only the trace can reproduce
+  const char *source = "b main\n"
+                       "mov r0,r0\nmov r0,r0\nmov r0,r0\nmov r0,r0\nmov r0,r0\n"
+                       "b handler\n"
+                       "main:\nldr r1,=0x2000B400\nmov r2,#50\nstr r2,[r1]\n"
+                       "mov r2,#0xA0\nstr r2,[r1,#8]\n"
+                       "wait:\nldr r3,[r1,#4]\nadd r7,r7,r3\nmov r5,#7\n"
+                       "spin:\nsub r5,r5,#1\ncmp r5,#0\nbne spin\n"
+                       "cmp r6,#40\nbne wait\n"
+                       "str r6,[r1,#8]\nandeq r0,r0,r0\n"
+                       "handler:\nadd r6,r6,#1\nstr r6,[r1,#12]\nsubs r15,r14,#4\n";
+  BYTE *recorded;
+  WORD *recorded_reg = load_source(source, &recorded);
+  BYTE *straight = malloc(MEMORY_SIZE);
+  memcpy(straight, recorded, MEMORY_SIZE);
+  FILE *file = tmpfile();
+  run_timed(recorded, recorded_reg, file, false, 100, 0);
+  ASSERT_INT_EQ(recorded_reg[6], 40);
+
+  // replaying to the end needs neither the binary nor the timer's state
+  BYTE *replayed = calloc(1, MEMORY_SIZE);
+  WORD *replayed_reg = allocate_register();
+  rewind(file);
+  run_timed(replayed, replayed_reg, file, true, 0, 0);
+  ASSERT(!memcmp(recorded_reg, replayed_reg, REGISTER_N * sizeof(WORD)));
+  ASSERT(!memcmp(recorded, replayed, MEMORY_SIZE));
+
+  // seeking from a checkpoint ends where a run stopped there ends
+  WORD *straight_reg = allocate_register();
+  run_timed(straight, straight_reg, NULL, false, 0, 777);
+  rewind(file);
+  run_timed(replayed, replayed_reg, file, true, 777, 0);
+  ASSERT(!memcmp(straight_reg, replayed_reg, REGISTER_N * sizeof(WORD)));
+  ASSERT(!memcmp(straight, replayed, MEMORY_SIZE));
+
+  fclose(file);
+  free(recorded_reg);
+  free(replayed_reg);
+  free(straight_reg);
+  free(recorded);
+  free(replayed);
+  free(straight);
+}
+
+void test_snapshot(void) {
+  // fills a table, saves a snapshot, then sums the table into r5
+  const char *source = "mov r2,#0x400\nmov r3,#100\n"
+                       "fill:\nstr r3,[r2]\nadd r2,r2,#4\nsub r3,r3,#1\ncmp r3,#0\nbne fill\n"
+                       "mov r0,#0x100\nswi 0x123456\nmov r8,r0\n"
+                       "mov r2,#0x400\nmov r3,#100\n"
+                       "sum:\nldr r4,[r2]\nadd r5,r5,r4\nadd r2,r2,#4\nsub r3,r3,#1\n"
+                       "cmp r3,#0\nbne sum\n";
+  char name[] = "/tmp/unit_test_snapshotXXXXXX";
+  close(mkstemp(name));
+  BYTE *memory;
+  WORD *reg = load_source(source, &memory);
+  semihost *host = semihost_create(stdin, stdout);
+  host->snapshot = name;
+  State state = {memory, reg, NULL, NULL, NULL, host};
+  cycle(&state);
+  ASSERT_INT_EQ(reg[5], 5050);
+  ASSERT_INT_EQ(reg[8], 0);
+
+  // a warm start resumes after the SWI, with the table already filled
+  WORD *warm_reg = allocate_register();
+  State warm = {NULL, warm_reg, NULL, NULL, NULL, host};
+  BYTE *mapped = snapshot_map(name, &warm);
+  ASSERT(warm.memory == mapped);
+  ASSERT_INT_EQ(read_word(mapped, 0x400), 100);
+  ASSERT_INT_EQ(warm_reg[0], 1);
+  cycle(&warm);
+  ASSERT_INT_EQ(warm_reg[5], 5050);
+  ASSERT_INT_EQ(warm_reg[8], 1);
+  ASSERT(warm.instructions == state.instructions);
+  ASSERT(!memcmp(mapped, memory, MEMORY_SIZE));
+
+  snapshot_unmap(mapped);
+  semihost_free(host);
+  free(warm_reg);
+  free(reg);
+  free(memory);
+  remove(name);
+}
+
+void test_fuzz(void) {
+  // counts its runs at 0x800, then loads from outside memory on "FU" and
+  // spins forever on "FX"
+  const char *source = "ldr r5,[r6,#0x800]\nadd r5,r5,#1\nstr r5,[r6,#0x800]\n"
+                       "ldr r2,[r0]\nand r2,r2,#0xFF\ncmp r2,#0x46\nbne done\n"
+                       "ldr r2,[r0,#1]\nand r2,r2,#0xFF\ncmp r2,#0x58\n"
+                       "spin:\nbeq spin\n"
+                       "cmp r2,#0x55\nbne done\n"
+                       "ldr r3,=0x30000000\nldr r4,[r3]\n"
+                       "done:\nandeq r0,r0,r0\n";
+  BYTE *memory;
+  WORD *reg = load_source(source, &memory);
+  fuzz_target *target = fuzz_create(memory, 0x1000, 1000);
+  coverage *edges = coverage_create();
+  BYTE *seen = calloc(COVERAGE_MAP_SIZE, 1);
+  State state = {memory, reg};
+  state.coverage = edges;
+
+  ASSERT(fuzz_run(target, &state, (const BYTE *) "A", 1) == FUZZ_OK);
+  WORD shallow = coverage_merge(edges, seen);
+  ASSERT(shallow > 0);
+  ASSERT(fuzz_run(target, &state, (const BYTE *) "B", 1) == FUZZ_OK);
+  ASSERT_INT_EQ(coverage_merge(edges, seen), 0);
+  // getting further into the parser covers new edges
+  ASSERT(fuzz_run(target, &state, (const BYTE *) "FA", 2) == FUZZ_OK);
+  ASSERT(coverage_merge(edges, seen) > 0);
+  ASSERT(fuzz_run(target, &state, (const BYTE *) "FU", 2) == FUZZ_CRASH);
+  ASSERT(fuzz_run(target, &state, (const BYTE *) "FX", 2) == FUZZ_HANG);
+  // each run starts from the memory the program was loaded into
+  ASSERT(fuzz_run(target, &state, (const BYTE *) "A", 1) == FUZZ_OK);
+  ASSERT_INT_EQ(read_word(memory, 0x800), 1);
+  ASSERT_INT_EQ(reg[1], 1);
+
+  free(reg);
+  free(seen);
+  coverage_free(edges);
+  fuzz_free(target);
+  free(memory);
+}
+
+void test_lockstep(void) {
+  // a fast-forwarded loop, then a load that only a GPIO decodes
+  const char *source = "ldr r2,=3000\n"
+                       "wait:\nsub r2,r2,#1\ncmp r2,#0\nbne wait\n"
+                       "ldr r1,=0x20200000\nldr r3,[r1]\nmov r4,#1\nandeq r0,r0,r0\n";
+  BYTE *memory;
+  WORD *reg = load_source(source, &memory);
+  BYTE *reference_memory = malloc(MEMORY_SIZE);
+  bus *devices = bus_create();
+  gpio *pins = gpio_create(NULL);
+  gpio_attach(pins, devices);
+  WORD *reference_reg = allocate_register();
+
+  memcpy(reference_memory, memory, MEMORY_SIZE);
+  State fast = {memory, reg, NULL, devices};
+  State reference = {reference_memory, reference_reg, NULL, devices};
+  ASSERT(lockstep_run(&reference, &fast, 1000, 0));
+  ASSERT_INT_EQ(reg[4], 1);
+  // the halt counts too
+  ASSERT(fast.instructions == 3000 * 3 + 5);
+
+  // without the GPIO the reference fails the load: the check stops on it
+  free(reg);
+  free(memory);
+  reg = load_source(source, &memory);
+  memcpy(reference_memory, memory, MEMORY_SIZE);
+  memset(reference_reg, 0, REGISTER_N * sizeof(WORD));
+  fast = (State) {memory, reg, NULL, devices};
+  reference = (State) {reference_memory, reference_reg};
+  ASSERT(!lockstep_run(&reference, &fast, 1000, 0));
+  ASSERT(reference.instructions == 3000 * 3 + 3);
+  ASSERT_INT_EQ(reference.errors, 1);
+  ASSERT_INT_EQ(fast.errors, 0);
+
+  free(reg);
+  free(reference_reg);
+  gpio_free(pins);
+  bus_free(devices);
+  free(reference_memory);
+  free(memory);
+}
+
+void test_lockstep_output(void) {
+  // a character written in the interval the backends diverge in, which
+  // the bisection reruns
+  const char *source = "mov r5,#65\nldr r1,=0x1000\nstr r5,[r1]\nmov r0,#3\n"
+                       "swi 0x123456\nldr r1,=0x20200000\nldr r3,[r1]\n"
+                       "andeq r0,r0,r0\n";
+  BYTE *memory;
+  WORD *reg = load_source(source, &memory);
+  BYTE *reference_memory = malloc(MEMORY_SIZE);
+  memcpy(reference_memory, memory, MEMORY_SIZE);
+  bus *devices = bus_create();
+  gpio *pins = gpio_create(NULL);
+  gpio_attach(pins, devices);
+  FILE *out = tmpfile();
+  FILE *reference_out = tmpfile();
+  semihost *host = semihost_create(NULL, out);
+  semihost *reference_host = semihost_create(NULL, reference_out);
+  WORD *reference_reg = allocate_register();
+  State fast = {memory, reg, NULL, devices, NULL, host};
+  State reference = {reference_memory, reference_reg, NULL, NULL, NULL, reference_host};
+
+  ASSERT(!lockstep_run(&reference, &fast, 1000, 0));
+  ASSERT(fast.host == host);
+  semihost_flush(host);
+  semihost_flush(reference_host);
+  ASSERT_INT_EQ((int) ftell(out), 1);
+  ASSERT_INT_EQ((int) ftell(reference_out), 1);
+
+  semihost_free(host);
+  semihost_free(reference_host);
+  fclose(out);
+  fclose(reference_out);
+  free(reg);
+  free(reference_reg);
+  gpio_free(pins);
+  bus_free(devices);
+  free(reference_memory);
+  free(memory);
+}
+
+void test_roundtrip(void) {
+  roundtrip_report report;
+  // ldr with every offset and register: all come back
+  ASSERT(roundtrip_sweep(0xE59F0000, 0xE59FFFFF, 2, &report) == 0);
+  ASSERT(report.words[SINGLE_DATA_TRANSFER] == 0x10000);
+  ASSERT(report.unsupported[SINGLE_DATA_TRANSFER] == 0);
+  // bl is read as b, so it is skipped
+  ASSERT(roundtrip_sweep(0xEAFF0000, 0xEB00FFFF, 2, &report) == 0);
+  ASSERT(report.words[BRANCH] == 0x20000);
+  ASSERT(report.unsupported[BRANCH] == 0x10000);
+  ASSERT_HEX_EQ(roundtrip_word(BRANCH, 0xEB000010), 0xEA000010);
+  // ldmia sp!,{r0}, classified as a branch
+  ASSERT(!roundtrip_supported(BRANCH, 0xE8BD0001));
+  ASSERT_INT_EQ(report.group_n, 0);
+}
+
+void test_cache_sim(void) {
+  cache_config config;
+  ASSERT(cache_config_parse("16k:4:32:random", &config));
+  ASSERT_INT_EQ(config.size, 16384);
+  ASSERT(!cache_config_parse("16k:3:32", &config));
+  ASSERT(!cache_config_parse("16k:4:32:mru", &config));
+
+  // two sets of two 16-byte lines: 0x00, 0x20 and 0x40 share set 0. After
+  // a, b, a, c, LRU has evicted b and FIFO a
+  ASSERT(cache_config_parse("64:2:16", &config));
+  cache_sim *lru = cache_sim_create(NULL, &config);
+  config.policy = CACHE_FIFO;
+  cache_sim *fifo = cache_sim_create(NULL, &config);
+  WORD accesses[] = {0x00, 0x20, 0x04, 0x40, 0x08};
+  for (int i = 0; i < 5; i++) {
+    cache_data(lru, 0, accesses[i], i == 1);
+    cache_data(fifo, 0, accesses[i], i == 1);
+  }
+  ASSERT(lru->dcache->total.misses == 3);
+  ASSERT(fifo->dcache->total.misses == 4);
+  // the dirty line of b went back, for c in LRU and a again in FIFO
+  ASSERT(lru->dcache->write_backs == 1);
+  ASSERT(fifo->dcache->write_backs == 1);
+  cache_sim_free(lru);
+  cache_sim_free(fifo);
+
+  // a run feeds the fetches and the load and store of the loop at 0x10
+  const char *source = "ldr r1,=0x100\nmov r2,#4\n"
+                       "loop:\nldr r3,[r1]\nstr r3,[r1,#4]\n"
+                       "sub r2,r2,#1\ncmp r2,#0\nbne loop\n"
+                       "ldr r4,=0x20200000\nldr r5,[r4]\nandeq r0,r0,r0\n";
+  BYTE *memory;
+  WORD *reg = load_source(source, &memory);
+  bus *devices = bus_create();
+  gpio *pins = gpio_create(NULL);
+  gpio_attach(pins, devices);
+  ASSERT(cache_config_parse("1k:2:32", &config));
+  cache_sim *caches = cache_sim_create(&config, &config);
+  State arm_state = {memory, reg, NULL, devices};
+  arm_state.caches = caches;
+  cycle(&arm_state);
+  ASSERT(caches->dcache->pcs[0x8 / 4].accesses == 4);
+  ASSERT(caches->dcache->pcs[0x8 / 4].misses == 1);
+  ASSERT(caches->dcache->pcs[0xC / 4].misses == 0);
+  ASSERT(caches->uncached == 1);
+  // the loop runs every time, not fast-forwarded
+  ASSERT(caches->icache->pcs[0x18 / 4].accesses == 4);
+  ASSERT(caches->icache->regions[0].misses == caches->icache->total.misses);
+
+  cache_sim_free(caches);
+  free(reg);
+  gpio_free(pins);
+  bus_free(devices);
+  free(memory);
+}
+
 void test_symbol_table(void) {
   table *t = table_create();
   WORD value;
@@ -166,6 +753,328 @@ void test_symbol_table(void) {
   table_free(t);
 }
 
+void test_table_merge(void) {
+  table *t = table_create();
+  table *other = table_create();
+  WORD value;
+
+  table_insert(t, "alpha", 1);
+  table_insert(t, "gamma", 2);
+  table_insert(other, "beta", 3);
+  table_insert(other, "gamma", 4);
+  table_insert(other, "zeta", 5);
+  table_merge(t, other, 0x100);
+
+  ASSERT(table_get(t, "alpha", &value));
+  ASSERT_INT_EQ(value, 1);
+  ASSERT(table_get(t, "beta", &value));
+  ASSERT_INT_EQ(value, 0x103);
+  ASSERT(table_get(t, "gamma", &value));
+  ASSERT_INT_EQ(value, 0x104);
+  ASSERT(table_get(t, "zeta", &value));
+  ASSERT_INT_EQ(value, 0x105);
+  ASSERT(!table_get(other, "beta", &value));
+  ASSERT(table_key(t, "zeta") && !strcmp(table_key(t, "zeta"), "zeta"));
+  ASSERT(!table_key(t, "delta"));
+
+  // entries of dst keep their place, new ones follow in src's order
+  const char *order[] = {"alpha", "gamma", "beta", "zeta"};
+  int i = 0;
+  for (node *n = t->start; n; n = n->next, i++) {
+    ASSERT(i < 4 && !strcmp(n->key, order[i]));
+  }
+  ASSERT_INT_EQ(i, 4);
+  ASSERT_INT_EQ(t->size, 4);
+
+  // other gave its memory to t but can still be filled
+  table_insert(other, "delta", 6);
+  table_free(other);
+  ASSERT(table_get(t, "beta", &value));
+  ASSERT_INT_EQ(value, 0x103);
+
+  table_free(t);
+}
+
+void fail_with_message(void *message) {
+  fail_if(message != NULL, (char *) message);
+}
+
+void fail_after_inner(void *arg) {
+  const char **inner = (const char **) arg;
+  *inner = catch_failure(&fail_with_message, "inner");
+  fail_if(true, "outer");
+}
+
+void test_catch_failure(void) {
+  ASSERT(!catch_failure(&fail_with_message, NULL));
+  ASSERT(!strcmp(catch_failure(&fail_with_message, "failed"), "failed"));
+
+  // the inner handler only catches its own work
+  const char *inner = NULL;
+  ASSERT(!strcmp(catch_failure(&fail_after_inner, &inner), "outer"));
+  ASSERT(inner && !strcmp(inner, "inner"));
+}
+
+void test_arena(void) {
+  arena *a = arena_create();
+  arena *other = arena_create();
+
+  char *small = arena_alloc(a, 3);
+  char *next = arena_alloc(a, 8);
+  ASSERT((uintptr_t) next % _Alignof(max_align_t) == 0);
+  ASSERT(next - small >= 3);
+  // larger than any block: gets a block of its own
+  char *big = arena_alloc(a, 4 << 20);
+  memset(big, 0xAB, 4 << 20);
+
+  char *copy = arena_strdup(other, "label");
+  arena_adopt(a, other);
+  ASSERT(!other->head);
+  arena_free(other);
+  ASSERT(!strcmp(copy, "label"));
+
+  arena_free(a);
+}
+
+void test_assemble_chunks(void) {
+  // labels, forward and backward branches and literals in every chunk
+  char source[4096] = "";
+  for (int i = 0; i < 20; i++) {
+    char block[128];
+    sprintf(block, "l%d:\nmov r1,#%d\nldr r2,=0x%x\nbne l%d\n\nb l%d\n",
+            i, i, 0x1000 + i, (i + 3) % 20, i);
+    strcat(source, block);
+  }
+  size_t size = strlen(source);
+
+  program *sequential = program_scan(source, size, 1);
+  BYTE *expected = calloc(sequential->out_size, sizeof(BYTE));
+  program_encode(sequential, expected);
+  ASSERT_INT_EQ(sequential->code_size, 20 * 16);
+  ASSERT_INT_EQ(sequential->out_size, 20 * 20);
+
+  for (int threads = 2; threads <= 7; threads++) {
+    program *parallel = program_scan(source, size, threads);
+    ASSERT_INT_EQ(parallel->out_size, sequential->out_size);
+    BYTE *output = calloc(parallel->out_size, sizeof(BYTE));
+    program_encode(parallel, output);
+    ASSERT(!memcmp(output, expected, sequential->out_size));
+    free(output);
+    program_free(parallel);
+  }
+
+  free(expected);
+  program_free(sequential);
+}
+
+// assembles source with the cache file at cache_name, returns the image
+BYTE *assemble_cached(const char *source, char *cache_name, WORD *out_size) {
+  line_cache *cache = cache_load(cache_name);
+  program *p = program_scan(source, strlen(source), 2);
+  BYTE *output = calloc(p->out_size, sizeof(BYTE));
+  cache_prepare(cache, p);
+  p->cache = cache;
+  program_encode(p, output);
+  cache_save(cache, cache_name, p, output);
+  *out_size = p->out_size;
+  cache_free(cache);
+  program_free(p);
+  return output;
+}
+
+void test_assemble_cache(void) {
+  char cache_name[] = "/tmp/unit_test_cacheXXXXXX";
+  close(mkstemp(cache_name));
+  WORD size;
+  BYTE *first = assemble_cached("start:\nmov r1,#1\nldr r2,=0x1234\nb end\n"
+                                "end:\nbne start\n", cache_name, &size);
+  ASSERT_INT_EQ(size, 20);
+  free(first);
+
+  // plant a marker in the cached encoding of mov to see it being reused
+  FILE *file = fopen(cache_name, "r+b");
+  line_record record;
+  fseek(file, -4 * (long) sizeof(line_record), SEEK_END);
+  fread(&record, sizeof(line_record), 1, file);
+  record.encoding = 0xE3A010FF;
+  fseek(file, -4 * (long) sizeof(line_record), SEEK_END);
+  fwrite(&record, sizeof(line_record), 1, file);
+  fclose(file);
+
+  // one more line moves everything, so only mov can be reused as it is
+  const char *edited = "add r3,r3,r3\nstart:\nmov r1,#1\nldr r2,=0x1234\nb end\n"
+                       "end:\nbne start\n";
+  BYTE *second = assemble_cached(edited, cache_name, &size);
+  program *p = program_scan(edited, strlen(edited), 1);
+  BYTE *expected = calloc(p->out_size, sizeof(BYTE));
+  program_encode(p, expected);
+  ASSERT_INT_EQ(size, p->out_size);
+  ASSERT_HEX_EQ(*(WORD *) (second + 4), 0xE3A010FF);
+  ASSERT(!memcmp(second + 8, expected + 8, size - 8));
+
+  free(second);
+  free(expected);
+  program_free(p);
+  remove(cache_name);
+}
+
+// assembles source into an object and reads it back from a file
+object *assemble_object(const char *source) {
+  program *p = program_scan(source, strlen(source), 1);
+  table *externals = program_externals(p);
+  BYTE *output = calloc(p->out_size + 1, sizeof(BYTE));
+  program_encode(p, output);
+  object *o = object_create(p, externals, output);
+
+  FILE *file = tmpfile();
+  object_write(o, file);
+  rewind(file);
+  object *read = object_read(file);
+  fclose(file);
+
+  object_free(o);
+  free(output);
+  table_free(externals);
+  program_free(p);
+  return read;
+}
+
+void test_link_objects(void) {
+  const char *first = "main:\nldr r0,=0x1234\nb helper\nend:\nb #0x0\n";
+  const char *second = "helper:\nldr r1,=0x5678\nmov r2,#1\nbeq end\nbne helper\n";
+  object *objects[2] = {assemble_object(first), assemble_object(second)};
+  ASSERT_INT_EQ(objects[0]->relocation_n, 3);
+  ASSERT_INT_EQ(objects[1]->relocation_n, 2);
+
+  WORD size;
+  BYTE *linked = link_objects(objects, 2, &size);
+
+  char whole[256];
+  sprintf(whole, "%s%s", first, second);
+  program *p = program_scan(whole, strlen(whole), 1);
+  BYTE *expected = calloc(p->out_size, sizeof(BYTE));
+  program_encode(p, expected);
+  ASSERT_INT_EQ(size, p->out_size);
+  ASSERT(!memcmp(linked, expected, size));
+
+  free(expected);
+  program_free(p);
+  free(linked);
+  object_free(objects[0]);
+  object_free(objects[1]);
+}
+
+void test_peephole(void) {
+  const char *source = "mov r1,#1\nldr r2,=0x100\nldr r3,=0x12345\nmov r4,r4\n"
+                       "mov r5,#7\nadd r5,r1,r5\nb skip\nskip:\nb end\nend:\n"
+                       "andeq r0,r0,r0\n";
+  program *p = program_scan(source, strlen(source), 1);
+  BYTE *plain = calloc(1, MEMORY_SIZE);
+  BYTE *optimised = calloc(1, MEMORY_SIZE);
+  program_encode(p, plain);
+  program_encode(p, optimised);
+  ASSERT_INT_EQ(p->out_size, 44);
+
+  WORD size = peephole(optimised, p->code_size, p->out_size, NULL);
+  ASSERT_INT_EQ(size, 32);
+  ASSERT_HEX_EQ(read_word(optimised, 4), 0xE3A02C01); // mov r2,#0x100
+  ASSERT_HEX_EQ(read_word(optimised, 8), 0xE59F300C); // ldr r3,[pc,#12]
+  ASSERT_HEX_EQ(read_word(optimised, 12), 0xE2815007); // add r5,r1,#7
+  ASSERT_HEX_EQ(read_word(optimised, 16), 0xEA000000); // b end
+  ASSERT_HEX_EQ(read_word(optimised, 28), 0x12345);
+
+  WORD *plain_reg = allocate_register();
+  WORD *optimised_reg = allocate_register();
+  State plain_state = {plain, plain_reg};
+  State optimised_state = {optimised, optimised_reg};
+  cycle(&plain_state);
+  cycle(&optimised_state);
+  for (int i = 0; i <= 12; i++) {
+    ASSERT_INT_EQ(optimised_reg[i], plain_reg[i]);
+  }
+
+  free(plain_reg);
+  free(optimised_reg);
+  free(plain);
+  free(optimised);
+  program_free(p);
+}
+
+void test_peephole_reads_pc(void) {
+  // removing mov r2,r2 or folding mov r1,#4 would move the r15 reads
+  const char *sources[] = {
+    "mov r2,r2\nadd r1,r15,#0\nandeq r0,r0,r0\n",
+    "mov r1,#4\nadd r1,r15,r1\nandeq r0,r0,r0\n",
+    "mov r2,r2\nldr r3,[r15,#-4]\nandeq r0,r0,r0\n"
+  };
+  for (int s = 0; s < 3; s++) {
+    program *p = program_scan(sources[s], strlen(sources[s]), 1);
+    BYTE *plain = calloc(1, MEMORY_SIZE);
+    BYTE *optimised = calloc(1, MEMORY_SIZE);
+    program_encode(p, plain);
+    program_encode(p, optimised);
+    ASSERT_INT_EQ(peephole(optimised, p->code_size, p->out_size, NULL), p->out_size);
+
+    WORD *plain_reg = allocate_register();
+    WORD *optimised_reg = allocate_register();
+    State plain_state = {plain, plain_reg};
+    State optimised_state = {optimised, optimised_reg};
+    cycle(&plain_state);
+    cycle(&optimised_state);
+    for (int i = 0; i < REGISTER_N; i++) {
+      ASSERT_INT_EQ(optimised_reg[i], plain_reg[i]);
+    }
+
+    free(plain_reg);
+    free(optimised_reg);
+    free(plain);
+    free(optimised);
+    program_free(p);
+  }
+}
+
+void test_source_map(void) {
+  const char *source = "mov r1,#1\nmov r4,r4\n\nloop:\nsub r1,r1,#1\n"
+                       "cmp r1,#0\nbne loop\nandeq r0,r0,r0\n";
+  source_map *map = source_map_build("loop.s", source, strlen(source));
+  ASSERT_INT_EQ(map->record_n, 6);
+  ASSERT(!source_map_find(map, 24));
+  ASSERT(!source_map_find(NULL, 0));
+  const source_record *r = source_map_find(map, 0);
+  ASSERT_INT_EQ(r->line, 1);
+  ASSERT_INT_EQ(r->label, NO_LABEL);
+  r = source_map_find(map, 12);
+  ASSERT_INT_EQ(r->line, 6);
+  ASSERT(!strcmp(map->strings + r->label, "loop"));
+  ASSERT_INT_EQ(r->label_address, 8);
+
+  // the records follow the instructions peephole keeps
+  program *p = program_scan(source, strlen(source), 1);
+  BYTE *image = calloc(1, p->out_size);
+  program_encode(p, image);
+  WORD address_map[7];
+  peephole(image, p->code_size, p->out_size, address_map);
+  source_map_remap(map, address_map);
+  ASSERT_INT_EQ(map->record_n, 5);
+  r = source_map_find(map, 4);
+  ASSERT_INT_EQ(r->line, 5);
+  ASSERT_INT_EQ(r->label_address, 4);
+
+  FILE *file = tmpfile();
+  source_map_write(map, file);
+  rewind(file);
+  source_map *read = source_map_read(file);
+  fclose(file);
+  ASSERT_INT_EQ(read->record_n, 5);
+  ASSERT(!strcmp(read->strings, "loop.s"));
+  ASSERT_INT_EQ(source_map_find(read, 16)->line, 8);
+
+  source_map_free(read);
+  source_map_free(map);
+  free(image);
+  program_free(p);
+}
+
 void test_assemble_branch(void) {
   table *sym_table = table_create();
 
@@ -267,10 +1176,11 @@ void test_assemble_branch(void) {
 void test_assemble_single_data_transfer(void) {
 
   WORD current_address = 0x0;
+  // the literal pool starts at out_size, so leave room for the literals
   WORD out_size1 = 0x1000;
-  BYTE *output1 = calloc(out_size1,sizeof(BYTE));
+  BYTE *output1 = calloc(out_size1 + 0x10,sizeof(BYTE));
   WORD out_size2 = 0xABC;
-  BYTE *output2 = calloc(out_size2,sizeof(BYTE));
+  BYTE *output2 = calloc(out_size2 + 0x10,sizeof(BYTE));
 
   // Similar to the tests on branch, these functions assume the first token to be correct.
   // Therefore I will not be specifying the ldr/str functions in the tokens.
@@ -431,39 +1341,39 @@ void test_assemble_dp(void) {
   expected = 0xE38420AB;
   ASSERT_HEX_EQ(assemble_orr(instr_tokens1, 4, NULL, NULL, NULL, 0), expected);
 
-  instr_tokens1[3] = "#2815";
-  expected = 0xE2042AFF;
+  instr_tokens1[3] = "#0xAB00";
+  expected = 0xE2042CAB;
   ASSERT_HEX_EQ(assemble_and(instr_tokens1, 4, NULL, NULL, NULL, 0), expected);
-  expected = 0xE2242AFF;
+  expected = 0xE2242CAB;
   ASSERT_HEX_EQ(assemble_eor(instr_tokens1, 4, NULL, NULL, NULL, 0), expected);
-  expected = 0xE2442AFF;
+  expected = 0xE2442CAB;
   ASSERT_HEX_EQ(assemble_sub(instr_tokens1, 4, NULL, NULL, NULL, 0), expected);
-  expected = 0xE2642AFF;
+  expected = 0xE2642CAB;
   ASSERT_HEX_EQ(assemble_rsb(instr_tokens1, 4, NULL, NULL, NULL, 0), expected);
-  expected = 0xE2842AFF;
+  expected = 0xE2842CAB;
   ASSERT_HEX_EQ(assemble_add(instr_tokens1, 4, NULL, NULL, NULL, 0), expected);
-  expected = 0xE3842AFF;
+  expected = 0xE3842CAB;
   ASSERT_HEX_EQ(assemble_orr(instr_tokens1, 4, NULL, NULL, NULL, 0), expected);
 
   // Case 2: tst, teq, cmp, mov
-  char *instr_tokens2[3] = {"tst", "r1", "#0x4A8"};
-  expected = 0xE31100A8;
+  char *instr_tokens2[3] = {"tst", "r1", "#0x4A0"};
+  expected = 0xE3110E4A;
   ASSERT_HEX_EQ(assemble_tst(instr_tokens2, 3, NULL, NULL, NULL, 0), expected);
-  expected = 0xE33100A8;
+  expected = 0xE3310E4A;
   ASSERT_HEX_EQ(assemble_teq(instr_tokens2, 3, NULL, NULL, NULL, 0), expected);
-  expected = 0xE35100A8;
+  expected = 0xE3510E4A;
   ASSERT_HEX_EQ(assemble_cmp(instr_tokens2, 3, NULL, NULL, NULL, 0), expected);
-  expected = 0xE3A010A8;
+  expected = 0xE3A01E4A;
   ASSERT_HEX_EQ(assemble_mov(instr_tokens2, 3, NULL, NULL, NULL, 0), expected);
 
   instr_tokens2[1] = "r10";
-  expected = 0xE31A00A8;
+  expected = 0xE31A0E4A;
   ASSERT_HEX_EQ(assemble_tst(instr_tokens2, 3, NULL, NULL, NULL, 0), expected);
-  expected = 0xE33A00A8;
+  expected = 0xE33A0E4A;
   ASSERT_HEX_EQ(assemble_teq(instr_tokens2, 3, NULL, NULL, NULL, 0), expected);
-  expected = 0xE35A00A8;
+  expected = 0xE35A0E4A;
   ASSERT_HEX_EQ(assemble_cmp(instr_tokens2, 3, NULL, NULL, NULL, 0), expected);
-  expected = 0xE3A0A0A8;
+  expected = 0xE3A0AE4A;
   ASSERT_HEX_EQ(assemble_mov(instr_tokens2, 3, NULL, NULL, NULL, 0), expected);
 
   instr_tokens2[2] = "#10";
@@ -475,6 +1385,34 @@ void test_assemble_dp(void) {
   ASSERT_HEX_EQ(assemble_cmp(instr_tokens2, 3, NULL, NULL, NULL, 0), expected);
   expected = 0xE3A0A00A;
   ASSERT_HEX_EQ(assemble_mov(instr_tokens2, 3, NULL, NULL, NULL, 0), expected);
+
+  // Case 3: immediates that only encode through the complementary opcode
+  char *instr_tokens3[4] = {"add", "r1", "r1", "#4294967292"};
+  expected = 0xE2411004; // sub r1,r1,#4
+  ASSERT_HEX_EQ(assemble_add(instr_tokens3, 4, NULL, NULL, NULL, 0), expected);
+  expected = 0xE2811004; // add r1,r1,#4
+  ASSERT_HEX_EQ(assemble_sub(instr_tokens3, 4, NULL, NULL, NULL, 0), expected);
+  instr_tokens3[3] = "#0xFFFFFF00";
+  expected = 0xE3C110FF; // bic r1,r1,#0xFF
+  ASSERT_HEX_EQ(assemble_and(instr_tokens3, 4, NULL, NULL, NULL, 0), expected);
+  char *instr_tokens4[3] = {"cmp", "r2", "#0xFFFFFFFE"};
+  expected = 0xE3720002; // cmn r2,#2
+  ASSERT_HEX_EQ(assemble_cmp(instr_tokens4, 3, NULL, NULL, NULL, 0), expected);
+  instr_tokens4[0] = "mov";
+  expected = 0xE3E02001; // mvn r2,#1
+  ASSERT_HEX_EQ(assemble_mov(instr_tokens4, 3, NULL, NULL, NULL, 0), expected);
+
+  // no immediate encoding at all: mov becomes a literal load
+  instr_tokens4[2] = "#0x12345678";
+  BYTE literal[0x10] = {0};
+  BYTE *output = literal;
+  WORD pool_address = 0x8;
+  expected = 0xE59F2000; // ldr r2,[pc,#0]
+  WORD instr = assemble_mov(instr_tokens4, 3, NULL, &output, &pool_address, 0);
+  ASSERT_HEX_EQ(instr, expected);
+  ASSERT_HEX_EQ(read_word(literal, 0x8), 0x12345678);
+  ASSERT_INT_EQ(literal_pool_size("mov r2,#0x12345678"), 4);
+  ASSERT_INT_EQ(literal_pool_size("mov r2,#0xFFFFFFFE"), 0);
 }
 
 int main(int argc, char **argv) {
@@ -482,7 +1420,29 @@ int main(int argc, char **argv) {
   tests_failed = 0;
   RUN_TEST(test_execute_branch);
   RUN_TEST(test_execute_multiply);
+  RUN_TEST(test_fast_forward);
+  RUN_TEST(test_gpio);
+  RUN_TEST(test_timer_interrupt);
+  RUN_TEST(test_semihosting);
+  RUN_TEST(test_input_window);
+  RUN_TEST(test_smp);
+  RUN_TEST(test_trace);
+  RUN_TEST(test_snapshot);
+  RUN_TEST(test_fuzz);
+  RUN_TEST(test_lockstep);
+  RUN_TEST(test_lockstep_output);
+  RUN_TEST(test_roundtrip);
+  RUN_TEST(test_cache_sim);
   RUN_TEST(test_symbol_table);
+  RUN_TEST(test_table_merge);
+  RUN_TEST(test_arena);
+  RUN_TEST(test_catch_failure);
+  RUN_TEST(test_assemble_chunks);
+  RUN_TEST(test_assemble_cache);
+  RUN_TEST(test_link_objects);
+  RUN_TEST(test_peephole);
+  RUN_TEST(test_peephole_reads_pc);
+  RUN_TEST(test_source_map);
   RUN_TEST(test_assemble_branch);
   RUN_TEST(test_assemble_single_data_transfer);
   RUN_TEST(test_assemble_multiply);
@@ -4,6 +4,11 @@
 #include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 BYTE *allocate_memory() {
   BYTE *memory = calloc(1, MEMORY_SIZE);
@@ -11,20 +16,42 @@ BYTE *allocate_memory() {
   return memory;
 }
 
+// set by catch_failure for the thread running the caught work
+static _Thread_local jmp_buf *failure_handler;
+static _Thread_local const char *failure_message;
+
 void fail_if(int cond, char *fail_message) {
   if (cond) {
+    if (failure_handler) {
+      failure_message = fail_message;
+      longjmp(*failure_handler, 1);
+    }
     printf("ERROR: %s\n", fail_message);
     exit(EXIT_FAILURE);
   }
 }
 
+const char *catch_failure(void (*work)(void *), void *arg) {
+  jmp_buf handler;
+  jmp_buf *outer = failure_handler;
+  const char *message = NULL;
+  failure_handler = &handler;
+  if (!setjmp(handler)) {
+    work(arg);
+  } else {
+    message = failure_message;
+  }
+  failure_handler = outer;
+  return message;
+}
+
 void verbose_print(char *message) {
   if (VERBOSE) {
     printf("%s", message);
   }
 }
 
-FILE *open_file(char *file_name, char *mode) {
+FILE *open_file(char *file_name, char mode[2]) {
   verbose_print("Opening given file");
   FILE *input_file = fopen(file_name, mode);
   fail_if(!input_file,
@@ -39,6 +66,69 @@ int get_file_size(FILE *file) {
   return size;
 }
 
+const char *map_file(char *file_name, size_t *size) {
+  int fd = open(file_name, O_RDONLY);
+  fail_if(fd < 0, "Failed to open file");
+  struct stat st;
+  fail_if(fstat(fd, &st) < 0, "Failed to read file size");
+  *size = st.st_size;
+  if (*size == 0) {
+    close(fd);
+    return NULL;
+  }
+  void *mapped = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  fail_if(mapped == MAP_FAILED, "Failed to map file into memory");
+  return mapped;
+}
+
+void unmap_file(const char *mapped, size_t size) {
+  if (mapped) {
+    munmap((void *) mapped, size);
+  }
+}
+
+BYTE *map_output_file(char *file_name, size_t size) {
+  int fd = open(file_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  fail_if(fd < 0, "Failed to open file");
+  if (size == 0) {
+    close(fd);
+    return NULL;
+  }
+  if (ftruncate(fd, size) < 0) {
+    close(fd);
+    fail_if(true, "Failed to resize output file");
+  }
+  void *mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  fail_if(mapped == MAP_FAILED, "Failed to map file into memory");
+  return mapped;
+}
+
+void unmap_output_file(char *file_name, BYTE *mapped, size_t size, size_t final_size) {
+  if (mapped) {
+    munmap(mapped, size);
+  }
+  if (final_size != size) {
+    fail_if(truncate(file_name, final_size) < 0, "Failed to resize output file");
+  }
+}
+
+size_t read_line(const char **cursor, const char *end, char *line, int size) {
+  const char *start = *cursor;
+  int length = 0;
+  while (start + length < end && length < size - 1) {
+    line[length] = start[length];
+    length++;
+    if (line[length - 1] == '\n') {
+      break;
+    }
+  }
+  line[length] = '\0';
+  *cursor += length;
+  return length;
+}
+
 void load_file_to_array(BYTE *array, int size, FILE *file) {
   size_t ret_code = fread(array, sizeof(BYTE), size, file);
   fail_if(ret_code != size,
@@ -55,6 +145,37 @@ void load_memory(FILE *input_file, int size,  BYTE *memory) {
   verbose_print("File loaded succesfully\n");
 }
 
+// grows a heap array so that it can hold at least n + 1 elements
+void *reserve(void *array, WORD n, WORD *capacity, size_t element_size) {
+  if (n < *capacity) {
+    return array;
+  }
+  *capacity = *capacity ? 2 * *capacity : 16;
+  array = realloc(array, *capacity * element_size);
+  fail_if(!array, "Failed to allocate memory");
+  return array;
+}
+
+uint64_t hash_bytes(const void *data, size_t size) {
+  const BYTE *bytes = data;
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+WORD read_word(const BYTE *memory, WORD address) {
+  WORD word;
+  memcpy(&word, memory + address, sizeof(WORD));
+  return word;
+}
+
+void write_word(BYTE *memory, WORD address, WORD word) {
+  memcpy(memory + address, &word, sizeof(WORD));
+}
+
 void print_binary(WORD c, int n) {
   for(int i = n-1; i >= 0; i--) {
     printf("%d", 1 & (c >> i));
@@ -99,7 +220,7 @@ WORD *allocate_register() {
 }
 
 void print_register(WORD *reg, int index) {
-  char register_name[5];
+  char register_name[16];
   int value = (int)reg[index];
   if(index == 15) {
     sprintf(register_name, "PC  ");
@@ -128,6 +249,10 @@ void print_state(State *state) {
   print_nonzero_memory(state->memory);
 }
 
+WORD executing_pc(const State *arm_state) {
+  return arm_state->reg[15] - 8;
+}
+
 WORD get_bits(WORD src, int start, int end) {
   int bit_mask = 0;
   for (int i = 0; i < end - start + 1; i++) {
@@ -244,13 +369,15 @@ void write_binary_file(FILE *output_file, BYTE *output, int size){
 int tokenize(char *line, char **token){
   // tokenize opcode (first token)
   int index = 0;
-  char *tok = strtok(line, " ,\n");
+  char *save;
+  char *tok = strtok_r(line, " ,\n", &save);
 
   // then tokenize operands (following tokens)
   while(tok != NULL){
+    fail_if(index == 1 + MAX_OPERAND_N, "Too many operands");
     token[index] = tok;
     index++;
-    tok = strtok(NULL, " ,\n");
+    tok = strtok_r(NULL, " ,\n", &save);
   }
   return index;
 }
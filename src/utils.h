@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define MEMORY_SIZE (1u << 16u)
 #define REGISTER_N 17
@@ -14,9 +15,47 @@ typedef unsigned int WORD;
 
 //Struct for the arm machine's state
 //Consist of 2^16 memory and 17 registers
+//map is optional: when set, errors name the source line of the PC
+//bus is optional: when set, accesses outside memory go to its devices
+//scheduler is optional: when set, its events fire and its interrupts
+//are taken at taken branches (see cycle.h)
+//host is optional: when set, SWIs are semihosting calls (see semihost.h)
+//instructions counts the instructions executed, including those of
+//busy-wait loops that were fast-forwarded
+//spsr holds the CPSR of the code an interrupt stopped
+//banked holds the r13 and r14 of the mode not running: IRQ mode's outside
+//an interrupt handler, the interrupted code's inside one
+//smp is set for the cores of a multicore run, core being this one's
+//number (see smp.h)
+//trace is set while a run is recorded or replayed (see trace.h)
+//a run with stop_at set pauses once that many instructions were executed
+//(see cycle.h)
+//coverage is optional: when set, the branches executed are recorded in
+//its bitmap (see fuzz.h)
+//errors counts the errors the run reported (out of bounds accesses,
+//unsupported semihosting calls, ...)
+//reference runs every instruction through execute.c, without the
+//fast paths (see lockstep.h)
+//caches is optional: when set, fetches, loads and stores go through its
+//cache models (see cache_sim.h)
 typedef struct {
   BYTE *memory;
   WORD *reg;
+  const struct source_map *map;
+  const struct bus *bus;
+  struct scheduler *scheduler;
+  struct semihost *host;
+  uint64_t instructions;
+  WORD spsr;
+  WORD banked[2];
+  struct smp *smp;
+  WORD core;
+  struct trace *trace;
+  uint64_t stop_at;
+  struct coverage *coverage;
+  WORD errors;
+  bool reference;
+  struct cache_sim *caches;
 } State;
 
 // allocate memory in heap for machine memory
@@ -24,8 +63,14 @@ BYTE *allocate_memory();
 
 //If cond is true, exit the program
 //Print the fail_message if VERBOSE is set in utils.h
+//Inside catch_failure, return to it instead of exiting
 void fail_if(int cond, char *fail_message);
 
+//Runs work(arg) so that a failing fail_if on this thread abandons work
+//instead of exiting; whatever work allocated is left to the caller
+//Returns the failure message, or NULL if work completed
+const char *catch_failure(void (*work)(void *), void *arg);
+
 void verbose_print(char *message);
 
 //Read the file with the given filename
@@ -35,6 +80,27 @@ FILE *open_file(char *file_name, char mode[2]);
 //Returns file size in bytes
 int get_file_size(FILE *file);
 
+//Maps the whole file read-only into memory and stores its size at size
+//Returns NULL for an empty file
+const char *map_file(char *file_name, size_t *size);
+
+//Releases a mapping returned by map_file
+void unmap_file(const char *mapped, size_t size);
+
+//Creates (or truncates) the file with room for size bytes and maps it
+//writable, so that an image can be built directly in the file
+//Returns NULL when size is 0
+BYTE *map_output_file(char *file_name, size_t size);
+
+//Releases a mapping returned by map_output_file, leaving final_size
+//(at most size) bytes in the file
+void unmap_output_file(char *file_name, BYTE *mapped, size_t size, size_t final_size);
+
+//Copies the next line starting at *cursor (but not past end) into line,
+//with the same semantics as fgets: at most size - 1 chars, newline kept
+//Advances *cursor and returns the number of chars copied (0 at the end)
+size_t read_line(const char **cursor, const char *end, char *line, int size);
+
 //Loads size bytes from the given file stream into the given array
 void load_file_to_array(BYTE *array, int size, FILE *file);
 
@@ -42,6 +108,19 @@ void load_file_to_array(BYTE *array, int size, FILE *file);
 //Try to load file, then load the memory
 void load_memory(FILE *input_file, int size,  BYTE *memory);
 
+//Grows a heap array of elements of element_size so that it can hold at
+//least n + 1 elements, doubling *capacity; returns the (moved) array
+void *reserve(void *array, WORD n, WORD *capacity, size_t element_size);
+
+//Returns the 64-bit FNV-1a hash of size bytes at data
+uint64_t hash_bytes(const void *data, size_t size);
+
+//Reads the word stored at address in memory (host byte order)
+WORD read_word(const BYTE *memory, WORD address);
+
+//Stores word at address in memory (host byte order)
+void write_word(BYTE *memory, WORD address, WORD word);
+
 //Print first n bits of input c
 void print_binary(WORD c, int n);
 
@@ -65,6 +144,10 @@ void print_register(WORD *reg, int index);
 // print the current state (content of memory and registers) of the machine
 void print_state(State *arm_state);
 
+// the address of the instruction being executed, which the pc is 8 bytes
+// ahead of
+WORD executing_pc(const State *arm_state);
+
 //return the bits of src from start to end
 WORD get_bits(WORD src, int start, int end);
 
@@ -109,6 +192,7 @@ void write_binary_file(FILE *output_file, BYTE *output, int size);
 
 //a tokenizer that parse a line into token (parse result in **token)
 //first token is the opcode, following tokens are the operands
+//token must have room for 1 + MAX_OPERAND_N tokens
 //return the number of tokens
 int tokenize(char *line, char **token);
 
@@ -0,0 +1,37 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "utils.h"
+#include "roundtrip.h"
+
+// usage: verify [-j threads] [first last]
+// Decodes and encodes again every instruction word from first to last
+// (all 2^32 by default) and reports the words that do not come back as
+// they were (see roundtrip.h); -j defaults to one thread per core
+// Exits with failure if any word did not
+int main(int argc, char **argv) {
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+  while ((opt = getopt(argc, argv, "j:")) != -1) {
+    switch (opt) {
+      case 'j':
+        threads = atoi(optarg);
+        break;
+      default:
+        fail_if(true, "Usage: verify [-j threads] [first last]");
+    }
+  }
+  WORD first = 0;
+  WORD last = 0xFFFFFFFF;
+  if (argc - optind == 2) {
+    first = strtoul(argv[optind], NULL, 0);
+    last = strtoul(argv[optind + 1], NULL, 0);
+  } else {
+    fail_if(argc != optind, "Usage: verify [-j threads] [first last]");
+  }
+
+  roundtrip_report report;
+  uint64_t mismatched = roundtrip_sweep(first, last, threads, &report);
+  roundtrip_print(&report);
+  return mismatched ? EXIT_FAILURE : EXIT_SUCCESS;
+}